@@ -29,7 +29,8 @@ typedef enum {
     DIFF_UNCHANGED = 0,
     DIFF_ADDED,
     DIFF_REMOVED,
-    DIFF_MODIFIED
+    DIFF_MODIFIED,
+    DIFF_RENUMBERED     /* same content under a new ID */
 } diff_change_t;
 
 /* Cell change flags (bitfield) */
@@ -0,0 +1,118 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+#include "git_helpers.h"
+#include "geom_fingerprint.h"
+#include "fp_cache.h"
+#include "history_pipe.h"
+#include "util.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    ag_fp_notes_t*  notes;
+    int             written;
+    int             present;
+    int             failed;
+} backfill_ctx_t;
+
+static int backfill_callback(git_commit* commit, const char* path,
+                             const git_oid* blob_oid,
+                             const ag_fingerprint_set_t* fp, void* payload) {
+    backfill_ctx_t* ctx = payload;
+    (void)commit; (void)path;
+
+    /* fp came from the cache, the notes ref or a parse; an existing
+       note is reported as present by ag_fp_notes_add */
+    if (!fp) {
+        ctx->failed++;
+        return 0;
+    }
+
+    int ret = ag_fp_notes_add(ctx->notes, blob_oid, fp);
+    if (ret > 0)      ctx->written++;
+    else if (ret == 0) ctx->present++;
+    else               ctx->failed++;
+    return 0;
+}
+
+static void print_usage(void) {
+    printf("Usage: aleagit backfill [<file>...]\n\n");
+    printf("Fingerprint every historical revision of the given geometry files\n");
+    printf("(default: all geometry files at HEAD) and store the results in\n");
+    printf("%s, so other clones can skip reparsing them.\n", AG_FP_NOTES_REF);
+}
+
+int cmd_backfill(int argc, char** argv) {
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            print_usage();
+            return 0;
+        }
+    }
+
+    git_repository* repo = ag_repo_open();
+    if (!repo) return 1;
+
+    ag_file_list_t* files = NULL;
+    int nfiles = 0;
+    for (int i = 0; i < argc; i++) {
+        if (argv[i][0] != '-') nfiles++;
+    }
+
+    if (nfiles == 0) {
+        git_commit* head = ag_resolve_commit(repo, "HEAD");
+        if (head) {
+            files = ag_find_geometry_files(repo, head);
+            git_commit_free(head);
+        }
+        if (!files || files->count == 0) {
+            ag_error("no geometry files found at HEAD");
+            if (files) ag_file_list_free(files);
+            git_repository_free(repo);
+            return 1;
+        }
+    }
+
+    /* Every note of the run goes into one notes commit */
+    backfill_ctx_t ctx = { .notes = ag_fp_notes_begin(repo) };
+    if (!ctx.notes) {
+        ag_error("cannot read %s", AG_FP_NOTES_REF);
+        if (files) ag_file_list_free(files);
+        git_repository_free(repo);
+        return 1;
+    }
+
+    if (files) {
+        for (size_t i = 0; i < files->count; i++) {
+            printf("  %s\n", files->paths[i]);
+            ag_walk_history_fp(repo, files->paths[i], backfill_callback, &ctx);
+        }
+    } else {
+        for (int i = 0; i < argc; i++) {
+            if (argv[i][0] == '-') continue;
+            printf("  %s\n", argv[i]);
+            ag_walk_history_fp(repo, argv[i], backfill_callback, &ctx);
+        }
+    }
+
+    if (ag_fp_notes_commit(ctx.notes) < 0) {
+        ag_error("cannot update %s", AG_FP_NOTES_REF);
+        ctx.failed += ctx.written;
+        ctx.written = 0;
+    }
+    ag_fp_notes_free(ctx.notes);
+
+    printf("\n");
+    ag_color_printf(COL_GREEN, "%d fingerprint%s written", ctx.written,
+                    ctx.written == 1 ? "" : "s");
+    printf(", %d already present", ctx.present);
+    if (ctx.failed > 0)
+        ag_color_printf(COL_RED, ", %d failed", ctx.failed);
+    printf(" in %s\n", AG_FP_NOTES_REF);
+
+    if (files) ag_file_list_free(files);
+    git_repository_free(repo);
+    return ctx.failed > 0 ? 1 : 0;
+}
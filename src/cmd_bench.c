@@ -0,0 +1,94 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+#include "geom_load.h"
+#include "geom_fingerprint.h"
+#include "workers.h"
+#include "util.h"
+#include <alea.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now_seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* Best wall time of runs fingerprinting passes, or a negative value if
+   fingerprinting failed */
+static double time_fingerprint(const alea_system_t* sys, int runs) {
+    double best = -1.0;
+    for (int r = 0; r < runs; r++) {
+        double t0 = now_seconds();
+        ag_fingerprint_set_t* fp = ag_fingerprint(sys);
+        double dt = now_seconds() - t0;
+        if (!fp) return -1.0;
+        ag_fingerprint_set_free(fp);
+        if (best < 0 || dt < best) best = dt;
+    }
+    return best;
+}
+
+int cmd_bench(int argc, char** argv) {
+    const char* file = NULL;
+    int runs = 3;
+    int max_threads = ag_thread_count();
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-threads") == 0 && i + 1 < argc) {
+            max_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--help") == 0) {
+            printf("Usage: aleagit bench <file> [--runs N] [--max-threads N]\n\n");
+            printf("Time fingerprinting of one geometry file at 1, 2, 4, ...\n");
+            printf("threads up to --max-threads (default: -j or CPUs).\n");
+            return 0;
+        } else if (argv[i][0] != '-') {
+            file = argv[i];
+        }
+    }
+
+    if (!file) {
+        ag_error("no geometry file specified");
+        return 1;
+    }
+    if (runs < 1) runs = 1;
+    if (max_threads < 1) max_threads = 1;
+
+    double t0 = now_seconds();
+    alea_system_t* sys = ag_load_geometry_file(file);
+    if (!sys) {
+        ag_error("failed to load '%s'", file);
+        return 1;
+    }
+    double load_time = now_seconds() - t0;
+
+    ag_color_printf(COL_BOLD, "%s", file);
+    printf(": %zu cells, %zu surfaces, loaded in %.1f ms\n\n",
+           alea_cell_count(sys), alea_surface_count(sys), load_time * 1e3);
+    printf("  threads   fingerprint   speedup\n");
+
+    double base = -1.0;
+    int rc = 0;
+    for (int n = 1; ; n = n * 2 < max_threads ? n * 2 : max_threads) {
+        ag_set_thread_count(n);
+        double t = time_fingerprint(sys, runs);
+        if (t < 0) {
+            ag_error("fingerprinting failed");
+            rc = 1;
+            break;
+        }
+        if (base < 0) base = t;
+        printf("  %7d   %8.1f ms   %6.2fx\n", n, t * 1e3, t > 0 ? base / t : 1.0);
+        if (n >= max_threads) break;
+    }
+
+    ag_set_thread_count(0);
+    alea_destroy(sys);
+    return rc;
+}
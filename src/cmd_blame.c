@@ -3,10 +3,10 @@
 // SPDX-License-Identifier: MPL-2.0
 
 #include "git_helpers.h"
-#include "geom_load.h"
 #include "geom_fingerprint.h"
+#include "fp_cache.h"
+#include "history_pipe.h"
 #include "util.h"
-#include <alea.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -28,6 +28,35 @@ typedef struct {
     char      date[20];
 } surface_blame_t;
 
+/* Resolved-element bitmap */
+static bool bit_test(const uint64_t* bits, size_t i) {
+    return (bits[i / 64] >> (i % 64)) & 1;
+}
+
+static void bit_set(uint64_t* bits, size_t i) {
+    bits[i / 64] |= (uint64_t)1 << (i % 64);
+}
+
+/* Row a[i] matches b[j]: bit-identical columns first, then the
+   tolerance-aware row comparison */
+static bool cell_same(const ag_fingerprint_set_t* a, size_t i,
+                      const ag_fingerprint_set_t* b, size_t j) {
+    if (ag_cell_fp_equal_run(a, i, b, j) > 0) return true;
+    ag_cell_fp_t x, y;
+    ag_cell_fp_at(a, i, &x);
+    ag_cell_fp_at(b, j, &y);
+    return ag_cell_fp_compare(&x, &y) == 0;
+}
+
+static bool surface_same(const ag_fingerprint_set_t* a, size_t i,
+                         const ag_fingerprint_set_t* b, size_t j) {
+    if (ag_surface_fp_equal_run(a, i, b, j) > 0) return true;
+    ag_surface_fp_t x, y;
+    ag_surface_fp_at(a, i, &x);
+    ag_surface_fp_at(b, j, &y);
+    return ag_surface_fp_compare(&x, &y) == 0;
+}
+
 typedef struct {
     git_repository*       repo;
     const char*           path;
@@ -35,11 +64,25 @@ typedef struct {
     cell_blame_t*         cell_blames;
     surface_blame_t*      surf_blames;
     size_t                nc, ns;
+    uint64_t*             cell_resolved;  /* bit set once blame is final */
+    uint64_t*             surf_resolved;
+    size_t                open;           /* elements not yet resolved */
     bool                  first;
 } blame_walk_t;
 
+static void set_blame(char* sha_out, char* author_out, char* date_out,
+                      const char* sha, const char* author, const char* date) {
+    strncpy(sha_out, sha, 7);
+    sha_out[7] = '\0';
+    strncpy(author_out, author, 63);
+    author_out[63] = '\0';
+    strncpy(date_out, date, 19);
+    date_out[19] = '\0';
+}
+
 static int blame_walk_cb(git_commit* commit, const char* p,
-                         const git_oid* blob_oid, void* payload) {
+                         const git_oid* blob_oid,
+                         const ag_fingerprint_set_t* old_fp, void* payload) {
     blame_walk_t* w = payload;
     (void)p; (void)blob_oid;
 
@@ -53,73 +96,61 @@ static int blame_walk_cb(git_commit* commit, const char* p,
     if (w->first) {
         /* HEAD commit: set as default blame for everything */
         for (size_t i = 0; i < w->nc; i++) {
-            strncpy(w->cell_blames[i].sha, sha, 7);
-            w->cell_blames[i].sha[7] = '\0';
-            strncpy(w->cell_blames[i].author, author->name, 63);
-            w->cell_blames[i].author[63] = '\0';
-            strncpy(w->cell_blames[i].date, timebuf, 19);
-            w->cell_blames[i].date[19] = '\0';
+            cell_blame_t* b = &w->cell_blames[i];
+            set_blame(b->sha, b->author, b->date, sha, author->name, timebuf);
         }
         for (size_t i = 0; i < w->ns; i++) {
-            strncpy(w->surf_blames[i].sha, sha, 7);
-            w->surf_blames[i].sha[7] = '\0';
-            strncpy(w->surf_blames[i].author, author->name, 63);
-            w->surf_blames[i].author[63] = '\0';
-            strncpy(w->surf_blames[i].date, timebuf, 19);
-            w->surf_blames[i].date[19] = '\0';
+            surface_blame_t* b = &w->surf_blames[i];
+            set_blame(b->sha, b->author, b->date, sha, author->name, timebuf);
         }
         w->first = false;
         free(sha);
-        return 0;
+        return w->open == 0;
     }
 
-    /* Load this commit's geometry and fingerprint */
-    alea_system_t* sys = ag_load_geometry_commit(w->repo, commit, w->path);
-    if (!sys) { free(sha); return 0; }
-
-    ag_fingerprint_set_t* old_fp = ag_fingerprint(sys);
-    alea_destroy(sys);
+    /* This commit's geometry, fingerprinted by the history pipeline */
     if (!old_fp) { free(sha); return 0; }
 
-    /* For each element: if it existed in old with same fingerprint,
-       blame goes further back */
+    /* Merge join over the two id-sorted arrays. An element whose
+       fingerprint is unchanged in this older revision moves its blame
+       back; one that differs or is missing is resolved for good. */
+    const ag_fingerprint_set_t* cur = w->current_fp;
+    size_t j = 0;
     for (size_t i = 0; i < w->nc; i++) {
-        int cid = w->cell_blames[i].cell_id;
-        for (size_t j = 0; j < old_fp->cell_count; j++) {
-            if (old_fp->cells[j].cell_id == cid) {
-                if (ag_cell_fp_compare(&w->current_fp->cells[i], &old_fp->cells[j]) == 0) {
-                    strncpy(w->cell_blames[i].sha, sha, 7);
-                    w->cell_blames[i].sha[7] = '\0';
-                    strncpy(w->cell_blames[i].author, author->name, 63);
-                    w->cell_blames[i].author[63] = '\0';
-                    strncpy(w->cell_blames[i].date, timebuf, 19);
-                    w->cell_blames[i].date[19] = '\0';
-                }
-                break;
-            }
+        if (bit_test(w->cell_resolved, i)) continue;
+        int cid = cur->cell_id[i];
+        while (j < old_fp->cell_count && old_fp->cell_id[j] < cid) j++;
+
+        if (j < old_fp->cell_count && old_fp->cell_id[j] == cid &&
+            cell_same(cur, i, old_fp, j)) {
+            cell_blame_t* b = &w->cell_blames[i];
+            set_blame(b->sha, b->author, b->date, sha, author->name, timebuf);
+        } else {
+            bit_set(w->cell_resolved, i);
+            w->open--;
         }
     }
 
+    j = 0;
     for (size_t i = 0; i < w->ns; i++) {
-        int sid = w->surf_blames[i].surface_id;
-        for (size_t j = 0; j < old_fp->surface_count; j++) {
-            if (old_fp->surfaces[j].surface_id == sid) {
-                if (ag_surface_fp_compare(&w->current_fp->surfaces[i], &old_fp->surfaces[j]) == 0) {
-                    strncpy(w->surf_blames[i].sha, sha, 7);
-                    w->surf_blames[i].sha[7] = '\0';
-                    strncpy(w->surf_blames[i].author, author->name, 63);
-                    w->surf_blames[i].author[63] = '\0';
-                    strncpy(w->surf_blames[i].date, timebuf, 19);
-                    w->surf_blames[i].date[19] = '\0';
-                }
-                break;
-            }
+        if (bit_test(w->surf_resolved, i)) continue;
+        int sid = cur->surface_id[i];
+        while (j < old_fp->surface_count && old_fp->surface_id[j] < sid) j++;
+
+        if (j < old_fp->surface_count && old_fp->surface_id[j] == sid &&
+            surface_same(cur, i, old_fp, j)) {
+            surface_blame_t* b = &w->surf_blames[i];
+            set_blame(b->sha, b->author, b->date, sha, author->name, timebuf);
+        } else {
+            bit_set(w->surf_resolved, i);
+            w->open--;
         }
     }
 
-    ag_fingerprint_set_free(old_fp);
     free(sha);
-    return 0;
+
+    /* Stop the revwalk once every element's blame is settled */
+    return w->open == 0;
 }
 
 int cmd_blame(int argc, char** argv) {
@@ -168,8 +199,8 @@ int cmd_blame(int argc, char** argv) {
         return 1;
     }
 
-    alea_system_t* head_sys = ag_load_geometry_commit(repo, head, file);
-    if (!head_sys) {
+    ag_fingerprint_set_t* head_fp = ag_fingerprint_commit(repo, head, file);
+    if (!head_fp) {
         ag_error("cannot load %s at HEAD", file);
         git_commit_free(head);
         if (files) ag_file_list_free(files);
@@ -177,28 +208,45 @@ int cmd_blame(int argc, char** argv) {
         return 1;
     }
 
-    ag_fingerprint_set_t* head_fp = ag_fingerprint(head_sys);
-    alea_destroy(head_sys);
-
     size_t nc = head_fp->cell_count;
     size_t ns = head_fp->surface_count;
     cell_blame_t* cell_blames = calloc(nc, sizeof(cell_blame_t));
     surface_blame_t* surf_blames = calloc(ns, sizeof(surface_blame_t));
 
-    for (size_t i = 0; i < nc; i++)
-        cell_blames[i].cell_id = head_fp->cells[i].cell_id;
-    for (size_t i = 0; i < ns; i++)
-        surf_blames[i].surface_id = head_fp->surfaces[i].surface_id;
+    uint64_t* cell_resolved = calloc(nc / 64 + 1, sizeof(uint64_t));
+    uint64_t* surf_resolved = calloc(ns / 64 + 1, sizeof(uint64_t));
+    size_t open = 0;
+
+    /* With --cell/--surface only the target element needs resolving, so
+       the walk can stop as soon as that one is settled. */
+    for (size_t i = 0; i < nc; i++) {
+        cell_blames[i].cell_id = head_fp->cell_id[i];
+        if (target_surface >= 0 ||
+            (target_cell >= 0 && cell_blames[i].cell_id != target_cell))
+            bit_set(cell_resolved, i);
+        else
+            open++;
+    }
+    for (size_t i = 0; i < ns; i++) {
+        surf_blames[i].surface_id = head_fp->surface_id[i];
+        if (target_cell >= 0 ||
+            (target_surface >= 0 && surf_blames[i].surface_id != target_surface))
+            bit_set(surf_resolved, i);
+        else
+            open++;
+    }
 
     blame_walk_t wd = {
         .repo = repo, .path = file,
         .current_fp = head_fp,
         .cell_blames = cell_blames, .surf_blames = surf_blames,
         .nc = nc, .ns = ns,
+        .cell_resolved = cell_resolved, .surf_resolved = surf_resolved,
+        .open = open,
         .first = true
     };
 
-    ag_walk_history(repo, file, blame_walk_cb, &wd);
+    ag_walk_history_fp(repo, file, blame_walk_cb, &wd);
 
     /* Print results */
     if (target_cell >= 0) {
@@ -235,12 +283,14 @@ int cmd_blame(int argc, char** argv) {
             printf(" %s %-20s cell %d (mat %d)\n",
                    cell_blames[i].date, cell_blames[i].author,
                    cell_blames[i].cell_id,
-                   head_fp->cells[i].material_id);
+                   head_fp->cell_material[i]);
         }
     }
 
     free(cell_blames);
     free(surf_blames);
+    free(cell_resolved);
+    free(surf_resolved);
     ag_fingerprint_set_free(head_fp);
     git_commit_free(head);
     if (files) ag_file_list_free(files);
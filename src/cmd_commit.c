@@ -6,8 +6,9 @@
 #include "geom_load.h"
 #include "geom_fingerprint.h"
 #include "geom_diff.h"
+#include "fp_cache.h"
+#include "load_pool.h"
 #include "util.h"
-#include <alea.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -97,22 +98,6 @@ static bool is_geometry_file(const char* path) {
     return false;
 }
 
-/* ------------------------------------------------------------------ */
-/*  Load geometry from the index (staged content)                     */
-/* ------------------------------------------------------------------ */
-
-static alea_system_t* load_staged_geometry(git_repository* repo,
-                                           const char* path) {
-    size_t len;
-    char* data = ag_read_staged_blob(repo, path, &len);
-    if (!data) return NULL;
-
-    geom_format_t fmt = ag_detect_format(path, data, len);
-    alea_system_t* sys = ag_load_geometry_buffer(data, len, fmt);
-    free(data);
-    return sys;
-}
-
 /* ------------------------------------------------------------------ */
 /*  Format geometry diff as commit trailer text                       */
 /* ------------------------------------------------------------------ */
@@ -126,6 +111,9 @@ static void format_diff_trailer(strbuf_t* sb,
     sb_appendf(sb, "  cells: %d added, %d removed, %d modified | surfaces: %d added, %d removed, %d modified\n",
                diff->cells_added, diff->cells_removed, diff->cells_modified,
                diff->surfs_added, diff->surfs_removed, diff->surfs_modified);
+    if (diff->cells_renumbered + diff->surfs_renumbered > 0)
+        sb_appendf(sb, "  renumbered: %d cells, %d surfaces\n",
+                   diff->cells_renumbered, diff->surfs_renumbered);
 
     int detail_count = 0;
     size_t total_details = diff->surface_count + diff->cell_count;
@@ -133,23 +121,37 @@ static void format_diff_trailer(strbuf_t* sb,
     /* Surface details */
     for (size_t i = 0; i < diff->surface_count && detail_count < MAX_DETAIL_LINES; i++) {
         const ag_surface_diff_t* d = &diff->surfaces[i];
+        ag_surface_fp_t was, now;
+        ag_diff_surface_rows(diff->old_set, diff->new_set, d, &was, &now);
         switch (d->change) {
             case DIFF_ADDED:
                 sb_appendf(sb, "  + surface %d (%s)\n",
-                           d->id, prim_type_name(d->new_fp.primitive_type));
+                           d->id, prim_type_name(now.primitive_type));
                 detail_count++;
                 break;
             case DIFF_REMOVED:
                 sb_appendf(sb, "  - surface %d (%s)\n",
-                           d->id, prim_type_name(d->old_fp.primitive_type));
+                           d->id, prim_type_name(was.primitive_type));
                 detail_count++;
                 break;
+            case DIFF_RENUMBERED: {
+                size_t n = ag_diff_surface_run(diff, i);
+                if (n > 1)
+                    sb_appendf(sb, "  = surfaces %d-%d -> %d-%d (renumbered)\n",
+                               d->old_id, d->old_id + (int)n - 1, d->id, d->id + (int)n - 1);
+                else
+                    sb_appendf(sb, "  = surface %d -> %d (renumbered)\n", d->old_id, d->id);
+                total_details -= n - 1;
+                i += n - 1;
+                detail_count++;
+                break;
+            }
             case DIFF_MODIFIED:
                 sb_appendf(sb, "  ~ surface %d:", d->id);
                 if (d->flags & SURF_CHG_TYPE)
                     sb_appendf(sb, " type %s -> %s",
-                               prim_type_name(d->old_fp.primitive_type),
-                               prim_type_name(d->new_fp.primitive_type));
+                               prim_type_name(was.primitive_type),
+                               prim_type_name(now.primitive_type));
                 if (d->flags & SURF_CHG_DATA)
                     sb_appendf(sb, " coefficients changed");
                 if (d->flags & SURF_CHG_BOUNDARY)
@@ -165,35 +167,52 @@ static void format_diff_trailer(strbuf_t* sb,
     /* Cell details */
     for (size_t i = 0; i < diff->cell_count && detail_count < MAX_DETAIL_LINES; i++) {
         const ag_cell_diff_t* d = &diff->cells[i];
+        ag_cell_fp_t was, now;
+        char region[128], lattice[160];
+        ag_diff_cell_rows(diff->old_set, diff->new_set, d, &was, &now);
         switch (d->change) {
             case DIFF_ADDED:
                 sb_appendf(sb, "  + cell %d (mat %d, universe %d)\n",
-                           d->id, d->new_fp.material_id, d->new_fp.universe_id);
+                           d->id, now.material_id, now.universe_id);
                 detail_count++;
                 break;
             case DIFF_REMOVED:
                 sb_appendf(sb, "  - cell %d (mat %d, universe %d)\n",
-                           d->id, d->old_fp.material_id, d->old_fp.universe_id);
+                           d->id, was.material_id, was.universe_id);
                 detail_count++;
                 break;
+            case DIFF_RENUMBERED: {
+                size_t n = ag_diff_cell_run(diff, i);
+                if (n > 1)
+                    sb_appendf(sb, "  = cells %d-%d -> %d-%d (renumbered)\n",
+                               d->old_id, d->old_id + (int)n - 1, d->id, d->id + (int)n - 1);
+                else
+                    sb_appendf(sb, "  = cell %d -> %d (renumbered)\n", d->old_id, d->id);
+                total_details -= n - 1;
+                i += n - 1;
+                detail_count++;
+                break;
+            }
             case DIFF_MODIFIED:
                 sb_appendf(sb, "  ~ cell %d:", d->id);
                 if (d->flags & CELL_CHG_MATERIAL)
                     sb_appendf(sb, " material %d -> %d",
-                               d->old_fp.material_id, d->new_fp.material_id);
+                               was.material_id, now.material_id);
                 if (d->flags & CELL_CHG_DENSITY)
                     sb_appendf(sb, " density %.4g -> %.4g",
-                               d->old_fp.density, d->new_fp.density);
+                               was.density, now.density);
                 if (d->flags & CELL_CHG_REGION)
-                    sb_appendf(sb, " region changed");
+                    sb_appendf(sb, " region changed%s",
+                               ag_region_change_str(d, region, sizeof(region)));
                 if (d->flags & CELL_CHG_UNIVERSE)
                     sb_appendf(sb, " universe %d -> %d",
-                               d->old_fp.universe_id, d->new_fp.universe_id);
+                               was.universe_id, now.universe_id);
                 if (d->flags & CELL_CHG_FILL)
                     sb_appendf(sb, " fill %d -> %d",
-                               d->old_fp.fill_universe, d->new_fp.fill_universe);
+                               was.fill_universe, now.fill_universe);
                 if (d->flags & CELL_CHG_LATTICE)
-                    sb_appendf(sb, " lattice changed");
+                    sb_appendf(sb, " lattice changed%s",
+                               ag_lattice_change_str(d, lattice, sizeof(lattice)));
                 sb_appendf(sb, "\n");
                 detail_count++;
                 break;
@@ -210,10 +229,9 @@ static void format_diff_trailer(strbuf_t* sb,
 
 static void format_new_file_trailer(strbuf_t* sb,
                                     const char* path,
-                                    const alea_system_t* sys) {
-    size_t nc = alea_cell_count(sys);
-    size_t ns = alea_surface_count(sys);
-    sb_appendf(sb, "Geometry-New: %s (%zu cells, %zu surfaces)\n", path, nc, ns);
+                                    const ag_fingerprint_set_t* fp) {
+    sb_appendf(sb, "Geometry-New: %s (%zu cells, %zu surfaces)\n",
+               path, fp->cell_count, fp->surface_count);
 }
 
 static void format_deleted_trailer(strbuf_t* sb, const char* path) {
@@ -231,32 +249,52 @@ static void print_diff_summary(const char* path,
     ag_color_printf(COL_GREEN, "%d added ", diff->cells_added);
     ag_color_printf(COL_RED, "%d removed ", diff->cells_removed);
     ag_color_printf(COL_YELLOW, "%d modified", diff->cells_modified);
+    if (diff->cells_renumbered)
+        ag_color_printf(COL_CYAN, " %d renumbered", diff->cells_renumbered);
     ag_color_printf(COL_DIM, " | surfaces ");
     ag_color_printf(COL_GREEN, "%d added ", diff->surfs_added);
     ag_color_printf(COL_RED, "%d removed ", diff->surfs_removed);
     ag_color_printf(COL_YELLOW, "%d modified", diff->surfs_modified);
+    if (diff->surfs_renumbered)
+        ag_color_printf(COL_CYAN, " %d renumbered", diff->surfs_renumbered);
     printf("\n");
 
-    /* Print up to 10 detail lines to console */
+    /* Print up to 10 detail lines to console; a renumbered run takes one */
     int shown = 0;
+    size_t total = diff->surface_count + diff->cell_count;
     for (size_t i = 0; i < diff->surface_count && shown < 10; i++) {
         const ag_surface_diff_t* d = &diff->surfaces[i];
+        ag_surface_fp_t was, now;
+        ag_diff_surface_rows(diff->old_set, diff->new_set, d, &was, &now);
         switch (d->change) {
             case DIFF_ADDED:
                 ag_color_printf(COL_GREEN, "    + surface %d (%s)\n",
-                                d->id, prim_type_name(d->new_fp.primitive_type));
+                                d->id, prim_type_name(now.primitive_type));
                 shown++; break;
             case DIFF_REMOVED:
                 ag_color_printf(COL_RED, "    - surface %d (%s)\n",
-                                d->id, prim_type_name(d->old_fp.primitive_type));
+                                d->id, prim_type_name(was.primitive_type));
                 shown++; break;
+            case DIFF_RENUMBERED: {
+                size_t n = ag_diff_surface_run(diff, i);
+                if (n > 1)
+                    ag_color_printf(COL_CYAN, "    = surfaces %d-%d -> %d-%d (renumbered)\n",
+                                    d->old_id, d->old_id + (int)n - 1,
+                                    d->id, d->id + (int)n - 1);
+                else
+                    ag_color_printf(COL_CYAN, "    = surface %d -> %d (renumbered)\n",
+                                    d->old_id, d->id);
+                total -= n - 1;
+                i += n - 1;
+                shown++; break;
+            }
             case DIFF_MODIFIED: {
                 printf("    ");
                 ag_color_printf(COL_YELLOW, "~ surface %d:", d->id);
                 if (d->flags & SURF_CHG_TYPE)
                     printf(" type %s -> %s",
-                           prim_type_name(d->old_fp.primitive_type),
-                           prim_type_name(d->new_fp.primitive_type));
+                           prim_type_name(was.primitive_type),
+                           prim_type_name(now.primitive_type));
                 if (d->flags & SURF_CHG_DATA) printf(" coefficients changed");
                 if (d->flags & SURF_CHG_BOUNDARY) printf(" boundary changed");
                 printf("\n");
@@ -267,41 +305,126 @@ static void print_diff_summary(const char* path,
     }
     for (size_t i = 0; i < diff->cell_count && shown < 10; i++) {
         const ag_cell_diff_t* d = &diff->cells[i];
+        ag_cell_fp_t was, now;
+        char region[128], lattice[160];
+        ag_diff_cell_rows(diff->old_set, diff->new_set, d, &was, &now);
         switch (d->change) {
             case DIFF_ADDED:
                 ag_color_printf(COL_GREEN, "    + cell %d (mat %d, universe %d)\n",
-                                d->id, d->new_fp.material_id, d->new_fp.universe_id);
+                                d->id, now.material_id, now.universe_id);
                 shown++; break;
             case DIFF_REMOVED:
                 ag_color_printf(COL_RED, "    - cell %d (mat %d, universe %d)\n",
-                                d->id, d->old_fp.material_id, d->old_fp.universe_id);
+                                d->id, was.material_id, was.universe_id);
                 shown++; break;
+            case DIFF_RENUMBERED: {
+                size_t n = ag_diff_cell_run(diff, i);
+                if (n > 1)
+                    ag_color_printf(COL_CYAN, "    = cells %d-%d -> %d-%d (renumbered)\n",
+                                    d->old_id, d->old_id + (int)n - 1,
+                                    d->id, d->id + (int)n - 1);
+                else
+                    ag_color_printf(COL_CYAN, "    = cell %d -> %d (renumbered)\n",
+                                    d->old_id, d->id);
+                total -= n - 1;
+                i += n - 1;
+                shown++; break;
+            }
             case DIFF_MODIFIED: {
                 printf("    ");
                 ag_color_printf(COL_YELLOW, "~ cell %d:", d->id);
                 if (d->flags & CELL_CHG_MATERIAL)
                     printf(" material %d -> %d",
-                           d->old_fp.material_id, d->new_fp.material_id);
+                           was.material_id, now.material_id);
                 if (d->flags & CELL_CHG_DENSITY)
                     printf(" density %.4g -> %.4g",
-                           d->old_fp.density, d->new_fp.density);
-                if (d->flags & CELL_CHG_REGION) printf(" region changed");
+                           was.density, now.density);
+                if (d->flags & CELL_CHG_REGION)
+                    printf(" region changed%s",
+                           ag_region_change_str(d, region, sizeof(region)));
                 if (d->flags & CELL_CHG_UNIVERSE)
                     printf(" universe %d -> %d",
-                           d->old_fp.universe_id, d->new_fp.universe_id);
+                           was.universe_id, now.universe_id);
                 if (d->flags & CELL_CHG_FILL)
                     printf(" fill %d -> %d",
-                           d->old_fp.fill_universe, d->new_fp.fill_universe);
-                if (d->flags & CELL_CHG_LATTICE) printf(" lattice changed");
+                           was.fill_universe, now.fill_universe);
+                if (d->flags & CELL_CHG_LATTICE)
+                    printf(" lattice changed%s",
+                           ag_lattice_change_str(d, lattice, sizeof(lattice)));
                 printf("\n");
                 shown++; break;
             }
             default: break;
         }
     }
-    size_t total = diff->surface_count + diff->cell_count;
-    if (total > 10)
-        printf("    ... and %zu more\n", total - 10);
+    if (total > (size_t)shown)
+        printf("    ... and %zu more\n", total - (size_t)shown);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Fingerprint notes for committed geometry blobs                    */
+/* ------------------------------------------------------------------ */
+
+typedef struct {
+    git_oid*               oids;
+    char**                 paths;
+    ag_fingerprint_set_t** fps;
+    size_t                 count;
+    size_t                 capacity;
+} note_queue_t;
+
+/* Queue a staged file's fingerprint set, taking it over from its load
+   job (*fp is set to NULL); the set stays valid until note_queue_free().
+   Nothing is taken if the file is not in the index. */
+static void note_queue_add(note_queue_t* q, git_repository* repo,
+                           const char* path, ag_fingerprint_set_t** fp) {
+    git_oid oid;
+    if (ag_staged_blob_oid(repo, path, &oid) < 0) return;
+
+    if (q->count >= q->capacity) {
+        size_t capacity = q->capacity ? q->capacity * 2 : 8;
+        git_oid* oids = realloc(q->oids, capacity * sizeof(git_oid));
+        if (oids) q->oids = oids;
+        char** paths = realloc(q->paths, capacity * sizeof(char*));
+        if (paths) q->paths = paths;
+        ag_fingerprint_set_t** fps = realloc(q->fps, capacity * sizeof(*fps));
+        if (fps) q->fps = fps;
+        if (!oids || !paths || !fps) return;
+        q->capacity = capacity;
+    }
+    git_oid_cpy(&q->oids[q->count], &oid);
+    q->paths[q->count] = ag_strdup(path);
+    q->fps[q->count] = *fp;
+    *fp = NULL;
+    q->count++;
+}
+
+/* Attach each blob's fingerprint set, as computed for the trailer, to
+   AG_FP_NOTES_REF */
+static void note_queue_publish(note_queue_t* q, git_repository* repo) {
+    if (q->count == 0) return;
+    ag_fp_notes_t* notes = ag_fp_notes_begin(repo);
+    if (!notes) {
+        ag_warn("could not read %s", AG_FP_NOTES_REF);
+        return;
+    }
+    for (size_t i = 0; i < q->count; i++) {
+        if (ag_fp_notes_add(notes, &q->oids[i], q->fps[i]) < 0)
+            ag_warn("could not write fingerprint note for %s", q->paths[i]);
+    }
+    if (ag_fp_notes_commit(notes) < 0)
+        ag_warn("could not update %s", AG_FP_NOTES_REF);
+    ag_fp_notes_free(notes);
+}
+
+static void note_queue_free(note_queue_t* q) {
+    for (size_t i = 0; i < q->count; i++) {
+        free(q->paths[i]);
+        ag_fingerprint_set_free(q->fps[i]);
+    }
+    free(q->paths);
+    free(q->fps);
+    free(q->oids);
 }
 
 /* ------------------------------------------------------------------ */
@@ -311,6 +434,7 @@ static void print_diff_summary(const char* path,
 int cmd_commit(int argc, char** argv) {
     const char* message = NULL;
     bool stage_all = false;
+    bool write_notes = true;
 
     /* Parse arguments */
     for (int i = 0; i < argc; i++) {
@@ -320,6 +444,9 @@ int cmd_commit(int argc, char** argv) {
         if (strcmp(argv[i], "-a") == 0) {
             stage_all = true; continue;
         }
+        if (strcmp(argv[i], "--no-notes") == 0) {
+            write_notes = false; continue;
+        }
     }
 
     if (!message) {
@@ -335,6 +462,7 @@ int cmd_commit(int argc, char** argv) {
     git_signature* sig = NULL;
     git_tree* tree = NULL;
     git_commit* head_commit = NULL;
+    note_queue_t notes = {0};
 
     /* Get index */
     if (git_repository_index(&index, repo) < 0) {
@@ -378,6 +506,38 @@ int cmd_commit(int argc, char** argv) {
         git_commit_lookup(&head_commit, repo, &head_oid);
     }
 
+    /* Fingerprint every staged geometry file (and its HEAD version) up
+       front on the worker pool: job 2*i is the old side of entry i, job
+       2*i+1 the new side. Pairs whose normalized text matches are not
+       parsed at all. */
+    ag_load_job_t* jobs = calloc(2 * nstaged, sizeof(ag_load_job_t));
+    if (!jobs) {
+        ag_error("out of memory");
+        git_status_list_free(status_list);
+        goto cleanup;
+    }
+    for (size_t i = 0; i < nstaged; i++) {
+        const git_status_entry* se = git_status_byindex(status_list, i);
+        if (!se->head_to_index) continue;
+
+        const char* path = se->head_to_index->new_file.path;
+        unsigned st = se->status;
+        if (!is_geometry_file(path) || (st & GIT_STATUS_INDEX_DELETED)) continue;
+
+        if ((st & GIT_STATUS_INDEX_MODIFIED) && has_head) {
+            jobs[2 * i].path = path;
+            jobs[2 * i].source = AG_SRC_COMMIT;
+            git_oid_cpy(&jobs[2 * i].oid, &head_oid);
+            jobs[2 * i].want_fp = true;
+        }
+        if (st & (GIT_STATUS_INDEX_NEW | GIT_STATUS_INDEX_MODIFIED)) {
+            jobs[2 * i + 1].path = path;
+            jobs[2 * i + 1].source = AG_SRC_STAGED;
+            jobs[2 * i + 1].want_fp = true;
+        }
+    }
+    ag_load_pairs_run(repo, jobs, nstaged);
+
     /* Collect staged geometry files and compute diffs */
     strbuf_t trailer;
     sb_init(&trailer);
@@ -405,61 +565,57 @@ int cmd_commit(int argc, char** argv) {
 
         if (st & GIT_STATUS_INDEX_NEW) {
             /* New geometry file */
-            alea_system_t* new_sys = load_staged_geometry(repo, path);
-            if (new_sys) {
+            ag_fingerprint_set_t* new_fp = jobs[2 * i + 1].fp;
+            if (new_fp) {
                 if (has_geom_changes) sb_appendf(&trailer, "\n");
-                format_new_file_trailer(&trailer, path, new_sys);
+                format_new_file_trailer(&trailer, path, new_fp);
                 has_geom_changes = true;
 
-                size_t nc = alea_cell_count(new_sys);
-                size_t ns = alea_surface_count(new_sys);
                 printf("  %s: ", path);
                 ag_color_printf(COL_GREEN, "new file (%zu cells, %zu surfaces)\n",
-                                nc, ns);
-                alea_destroy(new_sys);
+                                new_fp->cell_count, new_fp->surface_count);
+                note_queue_add(&notes, repo, path, &jobs[2 * i + 1].fp);
             }
             continue;
         }
 
         if (st & GIT_STATUS_INDEX_MODIFIED) {
+            /* Only comments, whitespace or non-geometry data changed.
+               No fingerprint was computed, so no note is published. */
+            if (jobs[2 * i].same_geometry) {
+                printf("  %s: ", path);
+                ag_color_printf(COL_DIM, "no structural changes\n");
+                continue;
+            }
+
             /* Modified geometry file — compute semantic diff */
-            alea_system_t* old_sys = has_head
-                ? ag_load_geometry_commit(repo, head_commit, path)
-                : NULL;
-            alea_system_t* new_sys = load_staged_geometry(repo, path);
-
-            if (old_sys && new_sys) {
-                ag_fingerprint_set_t* old_fp = ag_fingerprint(old_sys);
-                ag_fingerprint_set_t* new_fp = ag_fingerprint(new_sys);
-
-                if (old_fp && new_fp) {
-                    ag_diff_result_t* diff = ag_diff(old_fp, new_fp);
-                    if (diff && (diff->cell_count > 0 || diff->surface_count > 0)) {
-                        if (has_geom_changes) sb_appendf(&trailer, "\n");
-                        format_diff_trailer(&trailer, path, diff);
-                        has_geom_changes = true;
-                        print_diff_summary(path, diff);
-                    } else if (diff) {
-                        printf("  %s: ", path);
-                        ag_color_printf(COL_DIM, "no structural changes\n");
-                    }
-                    ag_diff_result_free(diff);
+            ag_fingerprint_set_t* old_fp = jobs[2 * i].fp;
+            ag_fingerprint_set_t* new_fp = jobs[2 * i + 1].fp;
+            if (new_fp) note_queue_add(&notes, repo, path, &jobs[2 * i + 1].fp);
+
+            if (old_fp && new_fp) {
+                ag_diff_result_t* diff = ag_diff(old_fp, new_fp);
+                if (diff && (diff->cell_count > 0 || diff->surface_count > 0)) {
+                    if (has_geom_changes) sb_appendf(&trailer, "\n");
+                    format_diff_trailer(&trailer, path, diff);
+                    has_geom_changes = true;
+                    print_diff_summary(path, diff);
+                } else if (diff) {
+                    printf("  %s: ", path);
+                    ag_color_printf(COL_DIM, "no structural changes\n");
                 }
-
-                ag_fingerprint_set_free(old_fp);
-                ag_fingerprint_set_free(new_fp);
-            } else if (new_sys) {
+                ag_diff_result_free(diff);
+            } else if (new_fp) {
                 /* Couldn't load old — treat as new */
                 if (has_geom_changes) sb_appendf(&trailer, "\n");
-                format_new_file_trailer(&trailer, path, new_sys);
+                format_new_file_trailer(&trailer, path, new_fp);
                 has_geom_changes = true;
             }
-
-            if (old_sys) alea_destroy(old_sys);
-            if (new_sys) alea_destroy(new_sys);
         }
     }
 
+    ag_load_jobs_release(jobs, 2 * nstaged);
+    free(jobs);
     git_status_list_free(status_list);
 
     /* Build full commit message */
@@ -521,11 +677,15 @@ int cmd_commit(int argc, char** argv) {
     printf(" %s\n", message);
     free(sha);
 
+    if (write_notes)
+        note_queue_publish(&notes, repo);
+
     sb_free(&full_msg);
     sb_free(&trailer);
     rc = 0;
 
 cleanup:
+    note_queue_free(&notes);
     if (tree) git_tree_free(tree);
     if (sig) git_signature_free(sig);
     if (head_commit) git_commit_free(head_commit);
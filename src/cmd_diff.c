@@ -3,21 +3,92 @@
 // SPDX-License-Identifier: MPL-2.0
 
 #include "git_helpers.h"
-#include "geom_load.h"
 #include "geom_fingerprint.h"
 #include "geom_diff.h"
+#include "load_pool.h"
 #include "util.h"
 #include <alea.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 int cmd_diff_visual(int argc, char** argv);
 
+/* Set up the load jobs of one delta (pair[0] old side, pair[1] new side).
+   Fingerprints are cached by blob OID, so a revision of a file is only
+   ever parsed once. Working-tree content has no blob in the object
+   database, so it goes through the workdir loader. */
+static void queue_delta_loads(ag_load_job_t* pair, const git_diff_delta* delta,
+                              bool workdir_mode) {
+    bool added = delta->status == GIT_DELTA_ADDED ||
+                 delta->status == GIT_DELTA_UNTRACKED;
+
+    if (!added) {
+        pair[0].path = delta->old_file.path;
+        pair[0].source = AG_SRC_BLOB;
+        git_oid_cpy(&pair[0].oid, &delta->old_file.id);
+        pair[0].want_fp = true;
+    }
+
+    pair[1].path = delta->new_file.path;
+    if (workdir_mode) {
+        pair[1].source = AG_SRC_WORKDIR;
+    } else {
+        pair[1].source = AG_SRC_BLOB;
+        git_oid_cpy(&pair[1].oid, &delta->new_file.id);
+    }
+    /* New files are summarized, so they need the parsed system */
+    pair[1].want_system = added;
+    pair[1].want_fp = !added;
+}
+
+/* Look for the first structural difference among the selected deltas,
+   in path order, and stop there: 1 if there is one, 0 if not, -1 on
+   error. An added or deleted geometry file differs at once. A modified
+   one whose blob OIDs match is skipped unloaded, and one whose
+   normalized text matches is skipped unparsed; otherwise both sides
+   are fingerprinted (usually from the cache) and compared up to their
+   first differing element. */
+static int first_difference(git_repository* repo, git_diff* tree_diff,
+                            const char* file, bool workdir_mode) {
+    size_t ndeltas = git_diff_num_deltas(tree_diff);
+    for (size_t di = 0; di < ndeltas; di++) {
+        const git_diff_delta* delta = git_diff_get_delta(tree_diff, di);
+        const char* path = delta->status == GIT_DELTA_DELETED
+                         ? delta->old_file.path : delta->new_file.path;
+        if (!file && !ag_is_geometry_file(path)) continue;
+
+        if (delta->status == GIT_DELTA_ADDED ||
+            delta->status == GIT_DELTA_UNTRACKED ||
+            delta->status == GIT_DELTA_DELETED)
+            return 1;
+        if ((delta->new_file.flags & GIT_DIFF_FLAG_VALID_ID) &&
+            git_oid_equal(&delta->old_file.id, &delta->new_file.id))
+            continue;
+
+        ag_load_job_t pair[2];
+        memset(pair, 0, sizeof(pair));
+        queue_delta_loads(pair, delta, workdir_mode);
+        ag_load_pairs_run(repo, pair, 1);
+        if (pair[0].same_geometry) continue;
+        int found = pair[0].fp && pair[1].fp ? ag_diff_any(pair[0].fp, pair[1].fp) : -1;
+        ag_load_jobs_release(pair, 2);
+        if (found < 0) {
+            ag_error("%s: cannot compare geometry", path);
+            return -1;
+        }
+        if (found) return 1;
+    }
+    return 0;
+}
+
 int cmd_diff(int argc, char** argv) {
     const char* rev1 = NULL;
     const char* rev2 = NULL;
     const char* file = NULL;
     bool visual = false;
+    bool quiet = false;      /* no output, implies exit_code */
+    bool exit_code = false;  /* exit 1 if there are structural changes */
 
     /* Parse arguments */
     int positional = 0;
@@ -36,6 +107,14 @@ int cmd_diff(int argc, char** argv) {
             visual = true;
             continue;
         }
+        if (strcmp(argv[i], "--quiet") == 0 || strcmp(argv[i], "-q") == 0) {
+            quiet = exit_code = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--exit-code") == 0) {
+            exit_code = true;
+            continue;
+        }
         if (argv[i][0] == '-') continue;
 
         if (positional == 0) rev1 = argv[i];
@@ -48,15 +127,20 @@ int cmd_diff(int argc, char** argv) {
        - one rev:        that rev vs working tree
        - two revs:       rev1 vs rev2  */
 
+    /* With --exit-code, 1 means "changed", so errors exit with 2 */
+    int err = exit_code ? 2 : 1;
+
     if (visual) {
+        if (exit_code) {
+            ag_error("--visual cannot be combined with --quiet or --exit-code");
+            return err;
+        }
         return cmd_diff_visual(argc, argv);
     }
 
     git_repository* repo = ag_repo_open();
-    if (!repo) return 1;
+    if (!repo) return err;
 
-    /* Find geometry files to diff */
-    ag_file_list_t* geom_files = NULL;
     git_commit* c1 = NULL;
     git_commit* c2 = NULL;
     bool workdir_mode = false;
@@ -64,12 +148,12 @@ int cmd_diff(int argc, char** argv) {
     if (!rev1 && !rev2) {
         /* HEAD vs workdir */
         c1 = ag_resolve_commit(repo, "HEAD");
-        if (!c1) { git_repository_free(repo); return 1; }
+        if (!c1) { git_repository_free(repo); return err; }
         workdir_mode = true;
     } else if (rev1 && !rev2) {
         /* rev1 vs workdir */
         c1 = ag_resolve_commit(repo, rev1);
-        if (!c1) { git_repository_free(repo); return 1; }
+        if (!c1) { git_repository_free(repo); return err; }
         workdir_mode = true;
     } else {
         /* rev1 vs rev2 */
@@ -79,91 +163,111 @@ int cmd_diff(int argc, char** argv) {
             if (c1) git_commit_free(c1);
             if (c2) git_commit_free(c2);
             git_repository_free(repo);
-            return 1;
+            return err;
         }
     }
 
-    /* Determine files to diff */
-    const char* paths[64];
-    int npath = 0;
+    /* Select files from a tree-level diff: only paths whose blob OIDs
+       differ between the two sides are loaded at all. */
+    git_diff* tree_diff = ag_diff_trees(repo, c1, c2, file);
+    if (!tree_diff) {
+        git_commit_free(c1);
+        if (c2) git_commit_free(c2);
+        git_repository_free(repo);
+        return err;
+    }
 
-    if (file) {
-        paths[npath++] = file;
-    } else {
-        /* Find all geometry files in old commit */
-        geom_files = ag_find_geometry_files(repo, c1);
-        if (geom_files) {
-            for (size_t i = 0; i < geom_files->count && npath < 64; i++)
-                paths[npath++] = geom_files->paths[i];
-        }
+    /* Quiet: stop at the first difference, loading files one by one */
+    if (quiet) {
+        int found = first_difference(repo, tree_diff, file, workdir_mode);
+        git_diff_free(tree_diff);
+        git_commit_free(c1);
+        if (c2) git_commit_free(c2);
+        git_repository_free(repo);
+        return found < 0 ? err : found;
     }
 
     int rc = 0;
-    for (int fi = 0; fi < npath; fi++) {
-        const char* path = paths[fi];
+    bool changed = false;
+    size_t ndeltas = git_diff_num_deltas(tree_diff);
 
-        alea_system_t* old_sys = ag_load_geometry_commit(repo, c1, path);
-        alea_system_t* new_sys = NULL;
+    /* Queue the loads for every selected delta (job 2*di is the old side,
+       2*di+1 the new side) and run them on the worker pool */
+    ag_load_job_t* jobs = calloc(ndeltas ? 2 * ndeltas : 1, sizeof(ag_load_job_t));
+    if (!jobs) {
+        git_diff_free(tree_diff);
+        git_commit_free(c1);
+        if (c2) git_commit_free(c2);
+        git_repository_free(repo);
+        return err;
+    }
+    for (size_t di = 0; di < ndeltas; di++) {
+        const git_diff_delta* delta = git_diff_get_delta(tree_diff, di);
+        if (delta->status == GIT_DELTA_DELETED) continue;
+        if (!file && !ag_is_geometry_file(delta->new_file.path)) continue;
+        queue_delta_loads(&jobs[2 * di], delta, workdir_mode);
+    }
+    ag_load_pairs_run(repo, jobs, ndeltas);
 
-        if (workdir_mode)
-            new_sys = ag_load_geometry_workdir(repo, path);
-        else
-            new_sys = ag_load_geometry_commit(repo, c2, path);
+    for (size_t di = 0; di < ndeltas; di++) {
+        const git_diff_delta* delta = git_diff_get_delta(tree_diff, di);
+        const char* path = delta->status == GIT_DELTA_DELETED
+                         ? delta->old_file.path : delta->new_file.path;
 
-        if (!old_sys && !new_sys) {
-            continue;
-        }
+        if (!file && !ag_is_geometry_file(path)) continue;
 
         /* Handle added/removed files */
-        if (!old_sys) {
+        if (delta->status == GIT_DELTA_ADDED ||
+            delta->status == GIT_DELTA_UNTRACKED) {
+            changed = true;
             ag_color_printf(COL_GREEN, "New file: %s\n", path);
-            if (new_sys) {
+            alea_system_t* new_sys = jobs[2 * di + 1].sys;
+            if (new_sys)
                 alea_print_summary(new_sys);
-                alea_destroy(new_sys);
-            }
             printf("\n");
             continue;
         }
-        if (!new_sys) {
+        if (delta->status == GIT_DELTA_DELETED) {
+            changed = true;
             ag_color_printf(COL_RED, "Deleted file: %s\n", path);
-            alea_destroy(old_sys);
             printf("\n");
             continue;
         }
 
-        ag_fingerprint_set_t* old_fp = ag_fingerprint(old_sys);
-        ag_fingerprint_set_t* new_fp = ag_fingerprint(new_sys);
+        ag_fingerprint_set_t* old_fp = jobs[2 * di].fp;
+        ag_fingerprint_set_t* new_fp = jobs[2 * di + 1].fp;
 
         if (old_fp && new_fp) {
-            ag_diff_result_t* diff = ag_diff(old_fp, new_fp);
-            if (diff && (diff->cell_count > 0 || diff->surface_count > 0)) {
-                char old_label[256], new_label[256];
-                char* sha1 = ag_short_oid(git_commit_id(c1));
-                if (workdir_mode) {
-                    snprintf(old_label, sizeof(old_label), "%s (%s)", path, sha1);
-                    snprintf(new_label, sizeof(new_label), "%s (working tree)", path);
-                } else {
-                    char* sha2 = ag_short_oid(git_commit_id(c2));
-                    snprintf(old_label, sizeof(old_label), "%s (%s)", path, sha1);
-                    snprintf(new_label, sizeof(new_label), "%s (%s)", path, sha2);
-                    free(sha2);
-                }
-                ag_diff_print(diff, old_label, new_label);
+            /* Streamed: entries are printed as the merge finds them */
+            char old_label[256], new_label[256];
+            char* sha1 = ag_short_oid(git_commit_id(c1));
+            if (workdir_mode) {
+                snprintf(old_label, sizeof(old_label), "%s (%s)", path, sha1);
+                snprintf(new_label, sizeof(new_label), "%s (working tree)", path);
+            } else {
+                char* sha2 = ag_short_oid(git_commit_id(c2));
+                snprintf(old_label, sizeof(old_label), "%s (%s)", path, sha1);
+                snprintf(new_label, sizeof(new_label), "%s (%s)", path, sha2);
+                free(sha2);
+            }
+            free(sha1);
+            int n = ag_diff_print(old_fp, new_fp, old_label, new_label);
+            if (n > 0) {
                 printf("\n");
-                free(sha1);
+                changed = true;
+            } else if (n < 0) {
+                ag_error("%s: out of memory while diffing", path);
+                rc = err;
             }
-            ag_diff_result_free(diff);
         }
-
-        ag_fingerprint_set_free(old_fp);
-        ag_fingerprint_set_free(new_fp);
-        alea_destroy(old_sys);
-        alea_destroy(new_sys);
     }
 
-    if (geom_files) ag_file_list_free(geom_files);
+    ag_load_jobs_release(jobs, 2 * ndeltas);
+    free(jobs);
+    git_diff_free(tree_diff);
     git_commit_free(c1);
     if (c2) git_commit_free(c2);
     git_repository_free(repo);
+    if (rc == 0 && exit_code && changed) rc = 1;
     return rc;
 }
@@ -151,7 +151,7 @@ int cmd_diff_visual(int argc, char** argv) {
 
     alea_system_t* old_sys = ag_load_geometry_commit(repo, c1, file);
     alea_system_t* new_sys = workdir_mode
-        ? ag_load_geometry_workdir(repo, file)
+        ? ag_load_geometry_workdir(repo, file, AG_LOAD_FULL)
         : ag_load_geometry_commit(repo, c2, file);
 
     if (!old_sys || !new_sys) {
@@ -2,6 +2,7 @@
 //
 // SPDX-License-Identifier: MPL-2.0
 
+#include "commit_graph.h"
 #include "util.h"
 #include <git2.h>
 #include <stdio.h>
@@ -99,6 +100,15 @@ int cmd_init(int argc, char** argv) {
         }
     }
 
+    /* log/blame skip untouched commits with git's changed-path filters */
+    ag_commit_graph_t* graph = ag_commit_graph_open(repo);
+    if (graph) {
+        ag_commit_graph_free(graph);
+    } else {
+        printf("Tip: run 'git commit-graph write --reachable --changed-paths' to\n"
+               "     speed up per-file history (log, blame, backfill).\n");
+    }
+
     git_repository_free(repo);
     return 0;
 }
@@ -3,12 +3,13 @@
 // SPDX-License-Identifier: MPL-2.0
 
 #include "git_helpers.h"
-#include "geom_load.h"
 #include "geom_fingerprint.h"
+#include "history_pipe.h"
 #include "util.h"
-#include <alea.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include <time.h>
 
 typedef struct {
@@ -20,48 +21,27 @@ typedef struct {
     int             count;
 } log_ctx_t;
 
-/* Find a cell fingerprint by cell_id in a set */
-static const ag_cell_fp_t* find_cell_fp(const ag_fingerprint_set_t* fp, int cell_id) {
-    for (size_t i = 0; i < fp->cell_count; i++) {
-        if (fp->cells[i].cell_id == cell_id) return &fp->cells[i];
-    }
-    return NULL;
-}
-
-/* Find a surface fingerprint by surface_id in a set */
-static const ag_surface_fp_t* find_surface_fp(const ag_fingerprint_set_t* fp, int surface_id) {
-    for (size_t i = 0; i < fp->surface_count; i++) {
-        if (fp->surfaces[i].surface_id == surface_id) return &fp->surfaces[i];
-    }
-    return NULL;
-}
-
 static int log_callback(git_commit* commit, const char* path,
-                         const git_oid* blob_oid, void* payload) {
+                         const git_oid* blob_oid,
+                         const ag_fingerprint_set_t* fp, void* payload) {
     log_ctx_t* ctx = payload;
-    (void)blob_oid;
+    (void)path; (void)blob_oid;
 
     if (ctx->max_entries > 0 && ctx->count >= ctx->max_entries)
         return 1; /* stop */
 
-    /* Load geometry at this commit */
-    alea_system_t* sys = ag_load_geometry_commit(ctx->repo, commit, path);
-    if (!sys) return 0; /* skip on error, continue walking */
-
-    ag_fingerprint_set_t* fp = ag_fingerprint(sys);
-    alea_destroy(sys);
-    if (!fp) return 0;
+    /* Geometry at this commit, fingerprinted by the history pipeline */
+    if (!fp) return 0; /* skip on error, continue walking */
 
     /* If filtering by element, check if element exists */
     bool show = true;
     if (ctx->filter_cell >= 0) {
-        show = find_cell_fp(fp, ctx->filter_cell) != NULL;
+        show = ag_fp_find_cell(fp, ctx->filter_cell) != SIZE_MAX;
     }
     if (ctx->filter_surface >= 0) {
-        show = find_surface_fp(fp, ctx->filter_surface) != NULL;
+        show = ag_fp_find_surface(fp, ctx->filter_surface) != SIZE_MAX;
     }
 
-    ag_fingerprint_set_free(fp);
     if (!show) return 0;
 
     /* Print commit info */
@@ -150,7 +130,7 @@ int cmd_log(int argc, char** argv) {
         .count = 0
     };
 
-    ag_walk_history(repo, file, log_callback, &ctx);
+    ag_walk_history_fp(repo, file, log_callback, &ctx);
 
     if (ctx.count == 0)
         printf("  (no commits found)\n");
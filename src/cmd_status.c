@@ -3,12 +3,12 @@
 // SPDX-License-Identifier: MPL-2.0
 
 #include "git_helpers.h"
-#include "geom_load.h"
 #include "geom_fingerprint.h"
 #include "geom_diff.h"
+#include "load_pool.h"
 #include "util.h"
-#include <alea.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 int cmd_status(int argc, char** argv) {
@@ -38,9 +38,28 @@ int cmd_status(int argc, char** argv) {
         return 1;
     }
 
-    bool any_changes = false;
     size_t n = git_status_list_entrycount(status);
 
+    /* Pass 1: pick geometry entries in status (path) order and queue the
+       loads; two fingerprint jobs per modified file (HEAD and workdir). */
+    typedef struct {
+        const char* path;
+        const char* label;
+        bool        structural;
+    } status_row_t;
+
+    status_row_t* rows = calloc(n ? n : 1, sizeof(status_row_t));
+    ag_load_job_t* jobs = calloc(n ? 2 * n : 1, sizeof(ag_load_job_t));
+    if (!rows || !jobs) {
+        free(rows);
+        free(jobs);
+        git_status_list_free(status);
+        git_commit_free(head);
+        git_repository_free(repo);
+        return 1;
+    }
+    size_t nrows = 0;
+
     for (size_t i = 0; i < n; i++) {
         const git_status_entry* se = git_status_byindex(status, i);
 
@@ -65,74 +84,101 @@ int cmd_status(int argc, char** argv) {
         }
 
         if (!path) continue;
-
-        /* Check if geometry file */
-        bool is_geom = false;
-        const char* exts[] = {".inp", ".i", ".mcnp", ".xml", NULL};
-        for (int e = 0; exts[e]; e++) {
-            if (ag_str_ends_with(path, exts[e])) { is_geom = true; break; }
+        if (!ag_is_geometry_file(path)) continue;
+
+        /* Can't diff new or deleted files structurally */
+        bool structural = !is_new &&
+            !(se->status & (GIT_STATUS_INDEX_DELETED | GIT_STATUS_WT_DELETED));
+
+        status_row_t* row = &rows[nrows];
+        row->path = path;
+        row->label = status_label;
+        row->structural = structural;
+
+        if (structural) {
+            ag_load_job_t* old_job = &jobs[2 * nrows];
+            ag_load_job_t* new_job = &jobs[2 * nrows + 1];
+            old_job->path = path;
+            old_job->source = AG_SRC_COMMIT;
+            git_oid_cpy(&old_job->oid, git_commit_id(head));
+            old_job->want_fp = true;
+            new_job->path = path;
+            new_job->source = AG_SRC_WORKDIR;
+            new_job->want_fp = true;
         }
-        if (!is_geom) continue;
+        nrows++;
+    }
 
-        if (!any_changes) {
-            ag_color_printf(COL_BOLD, "Geometry file changes:\n\n");
-            any_changes = true;
-        }
+    /* Pass 2: fingerprint both versions (cached by blob OID) in parallel,
+       unless their normalized text already matches. Rows without
+       structural jobs have want_fp unset and are skipped. */
+    ag_load_pairs_run(repo, jobs, nrows);
 
-        if (is_new || (se->status & (GIT_STATUS_INDEX_DELETED | GIT_STATUS_WT_DELETED))) {
-            /* Can't diff new or deleted files structurally */
+    /* Pass 3: diff and print in order */
+    bool any_changes = nrows > 0;
+    if (any_changes)
+        ag_color_printf(COL_BOLD, "Geometry file changes:\n\n");
+
+    for (size_t r = 0; r < nrows; r++) {
+        const char* path = rows[r].path;
+        const char* status_label = rows[r].label;
+
+        if (!rows[r].structural) {
             printf("  %-20s %s\n", status_label, path);
             continue;
         }
 
-        /* Load both versions and do structural diff */
-        alea_system_t* old_sys = ag_load_geometry_commit(repo, head, path);
-        alea_system_t* new_sys = ag_load_geometry_workdir(repo, path);
-
-        if (old_sys && new_sys) {
-            ag_fingerprint_set_t* old_fp = ag_fingerprint(old_sys);
-            ag_fingerprint_set_t* new_fp = ag_fingerprint(new_sys);
-
-            if (old_fp && new_fp) {
-                ag_diff_result_t* diff = ag_diff(old_fp, new_fp);
-                if (diff) {
-                    int total = diff->cells_added + diff->cells_removed + diff->cells_modified +
-                                diff->surfs_added + diff->surfs_removed + diff->surfs_modified;
-                    if (total > 0) {
-                        printf("  %-20s %s  ", status_label, path);
-                        ag_color_printf(COL_DIM, "[");
-                        if (diff->cells_added + diff->cells_removed + diff->cells_modified > 0) {
-                            printf("cells: ");
-                            if (diff->cells_added)   ag_color_printf(COL_GREEN, "%d added ", diff->cells_added);
-                            if (diff->cells_removed)  ag_color_printf(COL_RED, "%d removed ", diff->cells_removed);
-                            if (diff->cells_modified) ag_color_printf(COL_YELLOW, "%d modified ", diff->cells_modified);
-                        }
-                        if (diff->surfs_added + diff->surfs_removed + diff->surfs_modified > 0) {
-                            printf("surfs: ");
-                            if (diff->surfs_added)   ag_color_printf(COL_GREEN, "%d added ", diff->surfs_added);
-                            if (diff->surfs_removed)  ag_color_printf(COL_RED, "%d removed ", diff->surfs_removed);
-                            if (diff->surfs_modified) ag_color_printf(COL_YELLOW, "%d modified ", diff->surfs_modified);
-                        }
-                        ag_color_printf(COL_DIM, "]");
-                        printf("\n");
-                    } else {
-                        printf("  %-20s %s  ", status_label, path);
-                        ag_color_printf(COL_DIM, "[no structural changes]");
-                        printf("\n");
-                    }
-                    ag_diff_result_free(diff);
+        if (jobs[2 * r].same_geometry) {
+            printf("  %-20s %s  ", status_label, path);
+            ag_color_printf(COL_DIM, "[no structural changes]");
+            printf("\n");
+            continue;
+        }
+
+        ag_fingerprint_set_t* old_fp = jobs[2 * r].fp;
+        ag_fingerprint_set_t* new_fp = jobs[2 * r + 1].fp;
+
+        ag_diff_result_t* diff = (old_fp && new_fp) ? ag_diff(old_fp, new_fp) : NULL;
+        if (diff) {
+            int cells = diff->cells_added + diff->cells_removed + diff->cells_modified +
+                        diff->cells_renumbered;
+            int surfs = diff->surfs_added + diff->surfs_removed + diff->surfs_modified +
+                        diff->surfs_renumbered;
+            int total = cells + surfs;
+            if (total > 0) {
+                printf("  %-20s %s  ", status_label, path);
+                ag_color_printf(COL_DIM, "[");
+                if (cells > 0) {
+                    printf("cells: ");
+                    if (diff->cells_added)   ag_color_printf(COL_GREEN, "%d added ", diff->cells_added);
+                    if (diff->cells_removed)  ag_color_printf(COL_RED, "%d removed ", diff->cells_removed);
+                    if (diff->cells_modified) ag_color_printf(COL_YELLOW, "%d modified ", diff->cells_modified);
+                    if (diff->cells_renumbered) ag_color_printf(COL_CYAN, "%d renumbered ", diff->cells_renumbered);
+                }
+                if (surfs > 0) {
+                    printf("surfs: ");
+                    if (diff->surfs_added)   ag_color_printf(COL_GREEN, "%d added ", diff->surfs_added);
+                    if (diff->surfs_removed)  ag_color_printf(COL_RED, "%d removed ", diff->surfs_removed);
+                    if (diff->surfs_modified) ag_color_printf(COL_YELLOW, "%d modified ", diff->surfs_modified);
+                    if (diff->surfs_renumbered) ag_color_printf(COL_CYAN, "%d renumbered ", diff->surfs_renumbered);
                 }
+                ag_color_printf(COL_DIM, "]");
+                printf("\n");
+            } else {
+                printf("  %-20s %s  ", status_label, path);
+                ag_color_printf(COL_DIM, "[no structural changes]");
+                printf("\n");
             }
-            ag_fingerprint_set_free(old_fp);
-            ag_fingerprint_set_free(new_fp);
-        } else {
+            ag_diff_result_free(diff);
+        } else if (!old_fp || !new_fp) {
             printf("  %-20s %s\n", status_label, path);
         }
-
-        if (old_sys) alea_destroy(old_sys);
-        if (new_sys) alea_destroy(new_sys);
     }
 
+    ag_load_jobs_release(jobs, 2 * nrows);
+    free(jobs);
+    free(rows);
+
     if (!any_changes)
         printf("No geometry file changes.\n");
 
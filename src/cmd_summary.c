@@ -3,10 +3,12 @@
 // SPDX-License-Identifier: MPL-2.0
 
 #include "git_helpers.h"
-#include "geom_load.h"
+#include "load_pool.h"
+#include "workers.h"
 #include "util.h"
 #include <alea.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 int cmd_summary(int argc, char** argv) {
@@ -48,23 +50,46 @@ int cmd_summary(int argc, char** argv) {
     }
 
     size_t nfiles = file ? 1 : files->count;
+    ag_load_job_t* jobs = calloc(nfiles, sizeof(ag_load_job_t));
+    if (!jobs) {
+        free(sha);
+        if (files) ag_file_list_free(files);
+        git_commit_free(commit);
+        git_repository_free(repo);
+        return 1;
+    }
     for (size_t fi = 0; fi < nfiles; fi++) {
-        const char* path = file ? file : files->paths[fi];
+        jobs[fi].path = file ? file : files->paths[fi];
+        jobs[fi].source = AG_SRC_COMMIT;
+        git_oid_cpy(&jobs[fi].oid, git_commit_id(commit));
+        jobs[fi].want_system = true;
+    }
 
-        alea_system_t* sys = ag_load_geometry_commit(repo, commit, path);
-        if (!sys) {
-            ag_warn("failed to load '%s' at %s", path, sha);
-            continue;
-        }
+    /* Parse files in parallel batches of ag_thread_count(), print each
+       batch in path order and release it before loading the next */
+    size_t batch = (size_t)ag_thread_count();
+    for (size_t start = 0; start < nfiles; start += batch) {
+        size_t n = nfiles - start < batch ? nfiles - start : batch;
+        ag_load_jobs_run(repo, jobs + start, n);
+
+        for (size_t fi = start; fi < start + n; fi++) {
+            const char* path = jobs[fi].path;
+            alea_system_t* sys = jobs[fi].sys;
+            if (!sys) {
+                ag_warn("failed to load '%s' at %s", path, sha);
+                continue;
+            }
 
-        ag_color_printf(COL_BOLD, "%s", path);
-        printf(" @ %s\n", sha);
+            ag_color_printf(COL_BOLD, "%s", path);
+            printf(" @ %s\n", sha);
 
-        alea_print_summary(sys);
-        printf("\n");
+            alea_print_summary(sys);
+            printf("\n");
+        }
 
-        alea_destroy(sys);
+        ag_load_jobs_release(jobs + start, n);
     }
+    free(jobs);
 
     free(sha);
     if (files) ag_file_list_free(files);
@@ -4,42 +4,107 @@
 
 #include "git_helpers.h"
 #include "geom_load.h"
+#include "load_pool.h"
+#include "workers.h"
 #include "util.h"
 #include <alea.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdatomic.h>
 
-static int validate_system(alea_system_t* sys, const char* path) {
+#define MAX_DUP_LIST 8
+
+/* Results of the checks on one system, printed after all files finish */
+typedef struct {
+    size_t nc, ns, nu;
+    bool   universe_index_failed;
+    bool   spatial_index_failed;
+    int    noverlaps;
+    int    pairs[256];
+    size_t dup_cells, dup_surfaces;           /* repeated IDs */
+    int    dup_cell_list[MAX_DUP_LIST];       /* first distinct repeated IDs */
+    int    dup_surface_list[MAX_DUP_LIST];
+    size_t dup_cell_listed, dup_surface_listed;
+} validate_result_t;
+
+/* Distinct repeated IDs of an ID-sorted array, up to MAX_DUP_LIST */
+static size_t list_duplicates(const int* ids, size_t n, int* list) {
+    size_t listed = 0;
+    for (size_t i = 1; i < n && listed < MAX_DUP_LIST; i++) {
+        if (ids[i] == ids[i - 1] && (listed == 0 || list[listed - 1] != ids[i]))
+            list[listed++] = ids[i];
+    }
+    return listed;
+}
+
+static void check_duplicates(const ag_fingerprint_set_t* fp, validate_result_t* r) {
+    if (!fp) return;
+    r->dup_cells = fp->dup_cell_ids;
+    r->dup_surfaces = fp->dup_surface_ids;
+    if (r->dup_cells > 0)
+        r->dup_cell_listed = list_duplicates(fp->cell_id, fp->cell_count,
+                                             r->dup_cell_list);
+    if (r->dup_surfaces > 0)
+        r->dup_surface_listed = list_duplicates(fp->surface_id, fp->surface_count,
+                                                r->dup_surface_list);
+}
+
+static void print_duplicates(const char* kind, size_t count, const int* list, size_t listed) {
+    ag_color_printf(COL_RED, "  %zu duplicate %s ID(s):", count, kind);
+    for (size_t i = 0; i < listed; i++)
+        printf(" %d", list[i]);
+    if (count > listed) printf(" ...");
+    printf("\n");
+}
+
+static void check_system(alea_system_t* sys, validate_result_t* r) {
+    r->nc = alea_cell_count(sys);
+    r->ns = alea_surface_count(sys);
+    r->nu = alea_universe_count(sys);
+
+    /* Build indices for overlap check */
+    r->universe_index_failed = alea_build_universe_index(sys) < 0;
+    r->spatial_index_failed = alea_build_spatial_index(sys) < 0;
+
+    r->noverlaps = alea_find_overlaps(sys, r->pairs, 128);
+}
+
+static int report_system(const validate_result_t* r, const char* path) {
     int errors = 0;
 
     ag_color_printf(COL_BOLD, "Validating %s\n", path);
 
     /* Print summary */
-    size_t nc = alea_cell_count(sys);
-    size_t ns = alea_surface_count(sys);
-    size_t nu = alea_universe_count(sys);
-    printf("  cells: %zu, surfaces: %zu, universes: %zu\n", nc, ns, nu);
+    printf("  cells: %zu, surfaces: %zu, universes: %zu\n", r->nc, r->ns, r->nu);
 
-    /* Build indices for overlap check */
-    if (alea_build_universe_index(sys) < 0) {
+    if (r->universe_index_failed) {
         ag_error("  failed to build universe index");
         errors++;
     }
-    if (alea_build_spatial_index(sys) < 0) {
+    if (r->spatial_index_failed) {
         ag_error("  failed to build spatial index");
         errors++;
     }
 
+    /* Duplicate IDs, found while sorting the fingerprints */
+    if (r->dup_cells > 0) {
+        print_duplicates("cell", r->dup_cells, r->dup_cell_list, r->dup_cell_listed);
+        errors += (int)r->dup_cells;
+    }
+    if (r->dup_surfaces > 0) {
+        print_duplicates("surface", r->dup_surfaces, r->dup_surface_list,
+                         r->dup_surface_listed);
+        errors += (int)r->dup_surfaces;
+    }
+
     /* Check overlaps */
-    int pairs[256];
-    int noverlaps = alea_find_overlaps(sys, pairs, 128);
-    if (noverlaps > 0) {
-        ag_color_printf(COL_RED, "  %d overlap(s) detected:\n", noverlaps);
-        for (int i = 0; i < noverlaps && i < 128; i++) {
-            printf("    cell %d <-> cell %d\n", pairs[i * 2], pairs[i * 2 + 1]);
+    if (r->noverlaps > 0) {
+        ag_color_printf(COL_RED, "  %d overlap(s) detected:\n", r->noverlaps);
+        for (int i = 0; i < r->noverlaps && i < 128; i++) {
+            printf("    cell %d <-> cell %d\n", r->pairs[i * 2], r->pairs[i * 2 + 1]);
         }
-        errors += noverlaps;
+        errors += r->noverlaps;
     } else {
         ag_color_printf(COL_GREEN, "  no overlaps detected\n");
     }
@@ -47,6 +112,82 @@ static int validate_system(alea_system_t* sys, const char* path) {
     return errors;
 }
 
+static int validate_system(alea_system_t* sys, const char* path) {
+    validate_result_t r;
+    memset(&r, 0, sizeof(r));
+    check_system(sys, &r);
+    ag_fingerprint_set_t* fp = ag_fingerprint(sys);
+    check_duplicates(fp, &r);
+    ag_fingerprint_set_free(fp);
+    return report_system(&r, path);
+}
+
+typedef struct {
+    ag_load_job_t*     jobs;
+    validate_result_t* results;
+    size_t             njobs;
+    atomic_size_t      next;
+} check_pool_t;
+
+static void check_worker(int worker, void* arg) {
+    check_pool_t* pool = arg;
+    (void)worker;
+    for (;;) {
+        size_t i = atomic_fetch_add(&pool->next, 1);
+        if (i >= pool->njobs) break;
+        if (pool->jobs[i].sys)
+            check_system(pool->jobs[i].sys, &pool->results[i]);
+        check_duplicates(pool->jobs[i].fp, &pool->results[i]);
+    }
+}
+
+/* Load one batch of files and run the checks on all of them in
+   parallel, then report in the batch's order and release the batch */
+static int validate_batch(git_repository* repo, ag_load_job_t* jobs, size_t njobs,
+                          validate_result_t* results, int nworkers) {
+    memset(results, 0, njobs * sizeof(validate_result_t));
+    ag_load_jobs_run(repo, jobs, njobs);
+
+    check_pool_t pool = { .jobs = jobs, .results = results, .njobs = njobs };
+    atomic_init(&pool.next, 0);
+    ag_run_workers(nworkers, check_worker, &pool);
+
+    int errors = 0;
+    for (size_t i = 0; i < njobs; i++) {
+        if (!jobs[i].sys) {
+            ag_error("failed to parse %s", jobs[i].path);
+            errors++;
+            continue;
+        }
+        errors += report_system(&results[i], jobs[i].path);
+    }
+
+    ag_load_jobs_release(jobs, njobs);
+    return errors;
+}
+
+/* Validate files in batches of ag_thread_count(), so only one batch of
+   systems and spatial indices is in memory at a time */
+static int validate_jobs(git_repository* repo, ag_load_job_t* jobs, size_t njobs) {
+    if (njobs == 0) return 0;
+
+    size_t batch = (size_t)ag_thread_count();
+    if (batch > njobs) batch = njobs;
+    validate_result_t* results = malloc(batch * sizeof(validate_result_t));
+    if (!results) {
+        ag_error("out of memory");
+        return 1;
+    }
+
+    int errors = 0;
+    for (size_t start = 0; start < njobs; start += batch) {
+        size_t n = njobs - start < batch ? njobs - start : batch;
+        errors += validate_batch(repo, jobs + start, n, results, (int)n);
+    }
+    free(results);
+    return errors;
+}
+
 int cmd_validate(int argc, char** argv) {
     bool pre_commit = false;
     const char* file = NULL;
@@ -75,36 +216,29 @@ int cmd_validate(int argc, char** argv) {
         }
 
         size_t entry_count = git_index_entrycount(index);
+        ag_load_job_t* jobs = calloc(entry_count ? entry_count : 1, sizeof(ag_load_job_t));
+        if (!jobs) {
+            ag_error("out of memory");
+            git_index_free(index);
+            git_repository_free(repo);
+            return 1;
+        }
+
+        size_t njobs = 0;
         for (size_t i = 0; i < entry_count; i++) {
             const git_index_entry* entry = git_index_get_byindex(index, i);
-            if (!entry) continue;
-
-            bool is_geom = false;
-            const char* exts[] = {".inp", ".i", ".mcnp", ".xml", NULL};
-            for (int e = 0; exts[e]; e++) {
-                if (ag_str_ends_with(entry->path, exts[e])) { is_geom = true; break; }
-            }
-            if (!is_geom) continue;
+            if (!entry || !ag_is_geometry_file(entry->path)) continue;
 
-            /* Read staged content */
-            size_t len = 0;
-            char* data = ag_read_staged_blob(repo, entry->path, &len);
-            if (!data) continue;
-
-            geom_format_t fmt = ag_detect_format(entry->path, data, len);
-            alea_system_t* sys = ag_load_geometry_buffer(data, len, fmt);
-            free(data);
-
-            if (!sys) {
-                ag_error("failed to parse %s", entry->path);
-                total_errors++;
-                continue;
-            }
-
-            total_errors += validate_system(sys, entry->path);
-            alea_destroy(sys);
+            jobs[njobs].path = entry->path;
+            jobs[njobs].source = AG_SRC_STAGED;
+            jobs[njobs].want_system = true;
+            jobs[njobs].want_fp = true;
+            njobs++;
         }
 
+        total_errors += validate_jobs(repo, jobs, njobs);
+        free(jobs);
+
         git_index_free(index);
     } else if (file) {
         /* Validate a specific file from disk */
@@ -126,16 +260,24 @@ int cmd_validate(int argc, char** argv) {
 
         ag_file_list_t* files = ag_find_geometry_files(repo, head);
         if (files) {
+            ag_load_job_t* jobs = calloc(files->count ? files->count : 1,
+                                         sizeof(ag_load_job_t));
+            if (!jobs) {
+                ag_error("out of memory");
+                ag_file_list_free(files);
+                git_commit_free(head);
+                git_repository_free(repo);
+                return 1;
+            }
             for (size_t i = 0; i < files->count; i++) {
-                alea_system_t* sys = ag_load_geometry_commit(repo, head, files->paths[i]);
-                if (!sys) {
-                    ag_error("failed to parse %s", files->paths[i]);
-                    total_errors++;
-                    continue;
-                }
-                total_errors += validate_system(sys, files->paths[i]);
-                alea_destroy(sys);
+                jobs[i].path = files->paths[i];
+                jobs[i].source = AG_SRC_COMMIT;
+                git_oid_cpy(&jobs[i].oid, git_commit_id(head));
+                jobs[i].want_system = true;
+                jobs[i].want_fp = true;
             }
+            total_errors += validate_jobs(repo, jobs, files->count);
+            free(jobs);
             ag_file_list_free(files);
         }
         git_commit_free(head);
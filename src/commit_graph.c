@@ -0,0 +1,384 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+#include "commit_graph.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* File format: Documentation/gitformat-commit-graph.txt in git.git.
+   Only SHA-1 graphs are read; the Bloom filter hashing follows bloom.c. */
+
+#define GRAPH_SIGNATURE   0x43475048u  /* "CGPH" */
+#define CHUNK_OIDF        0x4f494446u
+#define CHUNK_OIDL        0x4f49444cu
+#define CHUNK_CDAT        0x43444154u
+#define CHUNK_BIDX        0x42494458u
+#define CHUNK_BDAT        0x42444154u
+
+#define GRAPH_HEADER_SIZE 8
+#define CHUNK_ENTRY_SIZE  12
+#define OID_RAWSZ         20
+#define CDAT_ENTRY_SIZE   (OID_RAWSZ + 16)
+#define PARENT_NONE       0x70000000u
+#define BDAT_HEADER_SIZE  12
+
+#define BLOOM_SEED0       0x293ae76fu
+#define BLOOM_SEED1       0x7e646e2cu
+
+typedef struct {
+    uint8_t*       data;
+    size_t         size;
+    uint32_t       count;         /* commits in this layer */
+    uint32_t       base;          /* commits in the layers below */
+    const uint8_t* fanout;
+    const uint8_t* oids;
+    const uint8_t* cdat;
+    const uint8_t* bidx;          /* NULL if the layer has no filters */
+    const uint8_t* bdat;          /* filter bytes, past the BDAT header */
+    size_t         bdat_size;
+    uint32_t       hash_version;  /* 1: git's original murmur3, 2: fixed */
+    uint32_t       num_hashes;
+} graph_layer_t;
+
+struct ag_commit_graph {
+    graph_layer_t* layers;        /* base layer first */
+    size_t         nlayers;
+};
+
+static uint32_t get_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static uint64_t get_be64(const uint8_t* p) {
+    return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+static uint8_t* read_file(const char* path, size_t* out_size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    uint8_t* data = NULL;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        long size = ftell(f);
+        if (size > 0 && fseek(f, 0, SEEK_SET) == 0) {
+            data = malloc((size_t)size);
+            if (data && fread(data, 1, (size_t)size, f) != (size_t)size) {
+                free(data);
+                data = NULL;
+            }
+            *out_size = (size_t)size;
+        }
+    }
+    fclose(f);
+    return data;
+}
+
+/* Validate one graph file and locate its chunks. Takes ownership of data. */
+static int parse_layer(graph_layer_t* layer, uint8_t* data, size_t size,
+                       uint32_t base) {
+    memset(layer, 0, sizeof(*layer));
+    layer->data = data;
+    layer->size = size;
+    layer->base = base;
+
+    if (size < GRAPH_HEADER_SIZE + CHUNK_ENTRY_SIZE) return -1;
+    if (get_be32(data) != GRAPH_SIGNATURE) return -1;
+    if (data[4] != 1 || data[5] != 1) return -1;  /* version 1, SHA-1 */
+
+    size_t nchunks = data[6];
+    size_t table_end = GRAPH_HEADER_SIZE + (nchunks + 1) * CHUNK_ENTRY_SIZE;
+    if (table_end > size) return -1;
+
+    const uint8_t* bidx = NULL;
+    const uint8_t* bdat = NULL;
+    size_t oidl_size = 0, cdat_size = 0, bidx_size = 0, bdat_size = 0;
+
+    for (size_t i = 0; i < nchunks; i++) {
+        const uint8_t* entry = data + GRAPH_HEADER_SIZE + i * CHUNK_ENTRY_SIZE;
+        uint32_t id = get_be32(entry);
+        uint64_t off = get_be64(entry + 4);
+        uint64_t end = get_be64(entry + 4 + CHUNK_ENTRY_SIZE);
+        if (off < table_end || end < off || end > size) return -1;
+        size_t len = (size_t)(end - off);
+
+        switch (id) {
+            case CHUNK_OIDF:
+                if (len != 256 * 4) return -1;
+                layer->fanout = data + off;
+                break;
+            case CHUNK_OIDL: layer->oids = data + off; oidl_size = len; break;
+            case CHUNK_CDAT: layer->cdat = data + off; cdat_size = len; break;
+            case CHUNK_BIDX: bidx = data + off; bidx_size = len; break;
+            case CHUNK_BDAT: bdat = data + off; bdat_size = len; break;
+            default: break;
+        }
+    }
+
+    if (!layer->fanout || !layer->oids || !layer->cdat) return -1;
+    layer->count = get_be32(layer->fanout + 255 * 4);
+    if (oidl_size < (size_t)layer->count * OID_RAWSZ ||
+        cdat_size < (size_t)layer->count * CDAT_ENTRY_SIZE)
+        return -1;
+
+    /* Filters are optional; a layer without usable ones just never
+       rules anything out. */
+    if (bidx && bdat && bidx_size >= (size_t)layer->count * 4 &&
+        bdat_size >= BDAT_HEADER_SIZE) {
+        uint32_t version = get_be32(bdat);
+        uint32_t num_hashes = get_be32(bdat + 4);
+        if ((version == 1 || version == 2) && num_hashes > 0 && num_hashes <= 32) {
+            layer->bidx = bidx;
+            layer->bdat = bdat + BDAT_HEADER_SIZE;
+            layer->bdat_size = bdat_size - BDAT_HEADER_SIZE;
+            layer->hash_version = version;
+            layer->num_hashes = num_hashes;
+        }
+    }
+    return 0;
+}
+
+static int add_layer(ag_commit_graph_t* graph, const char* path) {
+    size_t size = 0;
+    uint8_t* data = read_file(path, &size);
+    if (!data) return -1;
+
+    graph_layer_t* layers = realloc(graph->layers,
+                                    (graph->nlayers + 1) * sizeof(graph_layer_t));
+    if (!layers) {
+        free(data);
+        return -1;
+    }
+    graph->layers = layers;
+
+    uint32_t base = 0;
+    if (graph->nlayers > 0) {
+        const graph_layer_t* below = &layers[graph->nlayers - 1];
+        base = below->base + below->count;
+    }
+
+    graph_layer_t* layer = &layers[graph->nlayers];
+    if (parse_layer(layer, data, size, base) < 0) {
+        free(data);
+        return -1;
+    }
+    graph->nlayers++;
+    return 0;
+}
+
+/* Split graph: commit-graph-chain lists graph-<hash>.graph files, base
+   first. */
+static int load_chain(ag_commit_graph_t* graph, const char* objdir) {
+    char path[4096];
+    int n = snprintf(path, sizeof(path), "%sinfo/commit-graphs/commit-graph-chain", objdir);
+    if (n < 0 || (size_t)n >= sizeof(path)) return -1;
+
+    size_t size = 0;
+    uint8_t* chain = read_file(path, &size);
+    if (!chain) return -1;
+
+    int rc = 0;
+    size_t pos = 0;
+    while (pos < size && rc == 0) {
+        size_t end = pos;
+        while (end < size && chain[end] != '\n') end++;
+        size_t len = end - pos;
+        if (len > 0 && chain[end - 1] == '\r') len--;
+
+        if (len == 2 * OID_RAWSZ) {
+            n = snprintf(path, sizeof(path), "%sinfo/commit-graphs/graph-%.*s.graph",
+                         objdir, (int)len, (const char*)chain + pos);
+            rc = n < 0 || (size_t)n >= sizeof(path) ? -1 : add_layer(graph, path);
+        } else if (len > 0) {
+            rc = -1;
+        }
+        pos = end + 1;
+    }
+
+    free(chain);
+    return rc == 0 && graph->nlayers > 0 ? 0 : -1;
+}
+
+ag_commit_graph_t* ag_commit_graph_open(git_repository* repo) {
+    const char* gitdir = git_repository_commondir(repo);
+    if (!gitdir) return NULL;
+
+    /* git ignores the graph in shallow clones, whose parents it lies about */
+    char path[4096];
+    int n = snprintf(path, sizeof(path), "%sshallow", gitdir);
+    if (n < 0 || (size_t)n >= sizeof(path)) return NULL;
+    FILE* f = fopen(path, "rb");
+    if (f) {
+        fclose(f);
+        return NULL;
+    }
+
+    char objdir[4096];
+    n = snprintf(objdir, sizeof(objdir), "%sobjects/", gitdir);
+    if (n < 0 || (size_t)n >= sizeof(objdir)) return NULL;
+    n = snprintf(path, sizeof(path), "%sinfo/commit-graph", objdir);
+    if (n < 0 || (size_t)n >= sizeof(path)) return NULL;
+
+    ag_commit_graph_t* graph = calloc(1, sizeof(ag_commit_graph_t));
+    if (!graph) return NULL;
+
+    /* Same precedence as git: a single graph file, else the chain */
+    if (add_layer(graph, path) < 0 && load_chain(graph, objdir) < 0) {
+        ag_commit_graph_free(graph);
+        return NULL;
+    }
+
+    bool have_filters = false;
+    for (size_t i = 0; i < graph->nlayers; i++)
+        if (graph->layers[i].bidx) have_filters = true;
+    if (!have_filters) {
+        ag_commit_graph_free(graph);
+        return NULL;
+    }
+    return graph;
+}
+
+void ag_commit_graph_free(ag_commit_graph_t* graph) {
+    if (!graph) return;
+    for (size_t i = 0; i < graph->nlayers; i++)
+        free(graph->layers[i].data);
+    free(graph->layers);
+    free(graph);
+}
+
+/* Binary search within the fanout bucket of the first OID byte */
+static bool layer_find(const graph_layer_t* layer, const unsigned char* raw,
+                       uint32_t* out_local) {
+    uint32_t lo = raw[0] ? get_be32(layer->fanout + (raw[0] - 1) * 4) : 0;
+    uint32_t hi = get_be32(layer->fanout + raw[0] * 4);
+    if (hi > layer->count) return false;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = memcmp(layer->oids + (size_t)mid * OID_RAWSZ, raw, OID_RAWSZ);
+        if (cmp == 0) {
+            *out_local = mid;
+            return true;
+        }
+        if (cmp < 0) lo = mid + 1;
+        else         hi = mid;
+    }
+    return false;
+}
+
+static uint32_t rotl32(uint32_t x, int r) {
+    return (x << r) | (x >> (32 - r));
+}
+
+/* murmur3_x86_32. Hash version 1 reproduces git's original bug of
+   sign-extending bytes >= 0x80; version 2 treats them as unsigned. */
+static uint32_t murmur3(uint32_t seed, const char* data, size_t len, uint32_t version) {
+    const uint32_t c1 = 0xcc9e2d51u, c2 = 0x1b873593u;
+    uint32_t h = seed;
+
+#define BYTE(i) (version == 1 ? (uint32_t)(int32_t)(signed char)data[i] \
+                              : (uint32_t)(unsigned char)data[i])
+
+    size_t nblocks = len / 4;
+    for (size_t i = 0; i < nblocks; i++) {
+        uint32_t k = BYTE(4 * i) | (BYTE(4 * i + 1) << 8) |
+                     (BYTE(4 * i + 2) << 16) | (BYTE(4 * i + 3) << 24);
+        k *= c1;
+        k = rotl32(k, 15);
+        k *= c2;
+        h ^= k;
+        h = rotl32(h, 13) * 5 + 0xe6546b64u;
+    }
+
+    size_t t = nblocks * 4;
+    uint32_t k1 = 0;
+    switch (len & 3) {
+        case 3: k1 ^= BYTE(t + 2) << 16; /* fallthrough */
+        case 2: k1 ^= BYTE(t + 1) << 8;  /* fallthrough */
+        case 1:
+            k1 ^= BYTE(t);
+            k1 *= c1;
+            k1 = rotl32(k1, 15);
+            k1 *= c2;
+            h ^= k1;
+    }
+#undef BYTE
+
+    h ^= (uint32_t)len;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static bool bloom_maybe_contains(const graph_layer_t* layer, const uint8_t* filter,
+                                 size_t len, const char* key, size_t keylen) {
+    uint32_t h0 = murmur3(BLOOM_SEED0, key, keylen, layer->hash_version);
+    uint32_t h1 = murmur3(BLOOM_SEED1, key, keylen, layer->hash_version);
+    uint64_t nbits = (uint64_t)len * 8;
+
+    for (uint32_t i = 0; i < layer->num_hashes; i++) {
+        uint64_t bit = (uint32_t)(h0 + i * h1) % nbits;
+        if (!(filter[bit / 8] & (1u << (bit % 8))))
+            return false;
+    }
+    return true;
+}
+
+/* Filters hold every changed path and all of its leading directories, so
+   a miss on any of them rules out a change to path. */
+static bool bloom_rules_out(const graph_layer_t* layer, const uint8_t* filter,
+                            size_t len, const char* path) {
+    size_t n = strlen(path);
+    while (n > 0 && path[n - 1] == '/') n--;
+
+    while (n > 0) {
+        if (!bloom_maybe_contains(layer, filter, len, path, n))
+            return true;
+        while (n > 0 && path[n - 1] != '/') n--;
+        if (n > 0) n--;
+    }
+    return false;
+}
+
+bool ag_commit_graph_same_as_parent(const ag_commit_graph_t* graph,
+                                    const git_oid* commit, const char* path,
+                                    git_oid* parent) {
+    for (size_t li = graph->nlayers; li-- > 0;) {
+        const graph_layer_t* layer = &graph->layers[li];
+        uint32_t local;
+        if (!layer_find(layer, commit->id, &local)) continue;
+        if (!layer->bidx) return false;
+
+        /* Filters are computed against the first parent only */
+        uint32_t p1 = get_be32(layer->cdat + (size_t)local * CDAT_ENTRY_SIZE + OID_RAWSZ);
+        if (p1 == PARENT_NONE) return false;
+
+        const graph_layer_t* player = NULL;
+        for (size_t pj = 0; pj < graph->nlayers; pj++) {
+            const graph_layer_t* l = &graph->layers[pj];
+            if (p1 >= l->base && p1 - l->base < l->count) {
+                player = l;
+                break;
+            }
+        }
+        if (!player) return false;
+
+        uint32_t start = local ? get_be32(layer->bidx + (size_t)(local - 1) * 4) : 0;
+        uint32_t end = get_be32(layer->bidx + (size_t)local * 4);
+
+        /* An empty filter means "not computed": no information */
+        if (end <= start || end > layer->bdat_size) return false;
+        if (!bloom_rules_out(layer, layer->bdat + start, end - start, path))
+            return false;
+
+        git_oid_fromraw(parent, player->oids + (size_t)(p1 - player->base) * OID_RAWSZ);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,31 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+#ifndef ALEAGIT_COMMIT_GRAPH_H
+#define ALEAGIT_COMMIT_GRAPH_H
+
+#include <git2.h>
+#include <stdbool.h>
+
+/* Read-only view of git's commit-graph (objects/info/commit-graph, or a
+   split chain under objects/info/commit-graphs/) with its changed-path
+   Bloom filters, as written by
+     git commit-graph write --reachable --changed-paths */
+typedef struct ag_commit_graph ag_commit_graph_t;
+
+/* Load the commit-graph of a repository. Returns NULL if there is none,
+   it is malformed, or no layer carries changed-path Bloom filters. */
+ag_commit_graph_t* ag_commit_graph_open(git_repository* repo);
+
+void ag_commit_graph_free(ag_commit_graph_t* graph);
+
+/* True if the commit is in the graph, has a first parent, and its Bloom
+   filter rules out any change to path (or its leading directories)
+   relative to that parent. The parent is stored in *parent. A false
+   answer means "maybe changed" and tells nothing. */
+bool ag_commit_graph_same_as_parent(const ag_commit_graph_t* graph,
+                                    const git_oid* commit, const char* path,
+                                    git_oid* parent);
+
+#endif /* ALEAGIT_COMMIT_GRAPH_H */
@@ -0,0 +1,431 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+#define _POSIX_C_SOURCE 200809L
+#include "fp_cache.h"
+#include "git_helpers.h"
+#include "geom_load.h"
+#include "fp_incr.h"
+#include "util.h"
+#include <alea.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define ag_mkdir(path) _mkdir(path)
+#define ag_getpid() _getpid()
+#else
+#include <unistd.h>
+#define ag_mkdir(path) mkdir(path, 0755)
+#define ag_getpid() getpid()
+#endif
+
+static atomic_size_t cache_hits;
+static atomic_size_t cache_note_hits;
+static atomic_size_t cache_misses;
+static atomic_size_t cache_patched;
+static atomic_size_t tmp_serial;
+
+#define NOTE_HEADER "aleagit-fingerprint "
+
+static bool cache_disabled(void) {
+    return getenv("ALEAGIT_NO_CACHE") != NULL;
+}
+
+/* Build <commondir>aleagit/fp-v<N>/<xx>/<38 hex> into buf. When mkdirs is
+   set, create the intermediate directories. */
+static int cache_path(git_repository* repo, const git_oid* oid,
+                      char* buf, size_t bufsz, bool mkdirs) {
+    char hex[GIT_OID_HEXSZ + 1];
+    git_oid_tostr(hex, sizeof(hex), oid);
+
+    const char* gitdir = git_repository_commondir(repo);
+    if (!gitdir) return -1;
+
+    int n = snprintf(buf, bufsz, "%saleagit", gitdir);
+    if (n < 0 || (size_t)n >= bufsz) return -1;
+    if (mkdirs) ag_mkdir(buf);
+
+    n = snprintf(buf, bufsz, "%saleagit/fp-v%d", gitdir, AG_FP_SCHEME_VERSION);
+    if (n < 0 || (size_t)n >= bufsz) return -1;
+    if (mkdirs) ag_mkdir(buf);
+
+    n = snprintf(buf, bufsz, "%saleagit/fp-v%d/%.2s", gitdir,
+                 AG_FP_SCHEME_VERSION, hex);
+    if (n < 0 || (size_t)n >= bufsz) return -1;
+    if (mkdirs) ag_mkdir(buf);
+
+    n = snprintf(buf, bufsz, "%saleagit/fp-v%d/%.2s/%s", gitdir,
+                 AG_FP_SCHEME_VERSION, hex, hex + 2);
+    if (n < 0 || (size_t)n >= bufsz) return -1;
+    return 0;
+}
+
+ag_fingerprint_set_t* ag_fp_cache_get(git_repository* repo,
+                                      const git_oid* blob_oid) {
+    if (cache_disabled()) return NULL;
+
+    char path[4096];
+    if (cache_path(repo, blob_oid, path, sizeof(path), false) < 0) return NULL;
+
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    ag_fingerprint_set_t* fp = NULL;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        long size = ftell(f);
+        if (size > 0 && fseek(f, 0, SEEK_SET) == 0) {
+            uint8_t* data = malloc((size_t)size);
+            if (data && fread(data, 1, (size_t)size, f) == (size_t)size)
+                fp = ag_fingerprint_deserialize(data, (size_t)size);
+            free(data);
+        }
+    }
+    fclose(f);
+    return fp;
+}
+
+int ag_fp_cache_put(git_repository* repo, const git_oid* blob_oid,
+                    const ag_fingerprint_set_t* fp) {
+    if (cache_disabled()) return 0;
+
+    char path[4096];
+    if (cache_path(repo, blob_oid, path, sizeof(path), true) < 0) return -1;
+
+    size_t len = 0;
+    uint8_t* data = ag_fingerprint_serialize(fp, &len);
+    if (!data) return -1;
+
+    /* Write to a private temp name and rename, so concurrent readers
+       never see a partial entry. The serial keeps worker threads of the
+       same process apart. */
+    char tmppath[4200];
+    snprintf(tmppath, sizeof(tmppath), "%s.%d.%zu.tmp", path, (int)ag_getpid(),
+             atomic_fetch_add(&tmp_serial, 1));
+
+    FILE* f = fopen(tmppath, "wb");
+    if (!f) {
+        free(data);
+        return -1;
+    }
+    size_t written = fwrite(data, 1, len, f);
+    int closed = fclose(f);
+    free(data);
+
+    if (written != len || closed != 0 || rename(tmppath, path) != 0) {
+        remove(tmppath);
+        return -1;
+    }
+    return 0;
+}
+
+void ag_fp_cache_stats(size_t* hits, size_t* note_hits, size_t* misses,
+                       size_t* patched) {
+    if (hits) *hits = atomic_load(&cache_hits);
+    if (note_hits) *note_hits = atomic_load(&cache_note_hits);
+    if (misses) *misses = atomic_load(&cache_misses);
+    if (patched) *patched = atomic_load(&cache_patched);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Notes ref                                                         */
+/* ------------------------------------------------------------------ */
+
+ag_fingerprint_set_t* ag_fp_notes_get(git_repository* repo,
+                                      const git_oid* blob_oid) {
+    git_note* note = NULL;
+    if (git_note_read(&note, repo, AG_FP_NOTES_REF, blob_oid) < 0)
+        return NULL;
+
+    ag_fingerprint_set_t* fp = NULL;
+    const char* msg = git_note_message(note);
+    size_t hlen = strlen(NOTE_HEADER);
+    if (msg && strncmp(msg, NOTE_HEADER, hlen) == 0 &&
+        atoi(msg + hlen) == AG_FP_SCHEME_VERSION) {
+        const char* body = strchr(msg, '\n');
+        size_t len = 0;
+        uint8_t* data = body ? ag_base64_decode(body + 1, &len) : NULL;
+        if (data) fp = ag_fingerprint_deserialize(data, len);
+        free(data);
+    }
+    git_note_free(note);
+    return fp;
+}
+
+/* Scheme version in a note's header, or -1 if it is not an aleagit note */
+static int note_version(const char* msg, size_t len) {
+    size_t hlen = strlen(NOTE_HEADER);
+    if (len <= hlen || strncmp(msg, NOTE_HEADER, hlen) != 0) return -1;
+    int version = 0;
+    for (size_t i = hlen; i < len && msg[i] >= '0' && msg[i] <= '9'; i++)
+        version = version * 10 + (msg[i] - '0');
+    return version;
+}
+
+/* Header line and base64 body of a fingerprint set's note */
+static char* note_message(const ag_fingerprint_set_t* fp) {
+    size_t len = 0;
+    uint8_t* data = ag_fingerprint_serialize(fp, &len);
+    if (!data) return NULL;
+    char* b64 = ag_base64_encode(data, len);
+    free(data);
+    if (!b64) return NULL;
+
+    size_t msglen = strlen(NOTE_HEADER) + 16 + strlen(b64) + 2;
+    char* msg = malloc(msglen);
+    if (msg)
+        snprintf(msg, msglen, "%s%d\n%s\n", NOTE_HEADER, AG_FP_SCHEME_VERSION, b64);
+    free(b64);
+    return msg;
+}
+
+struct ag_fp_notes {
+    git_repository* repo;
+    git_commit*     parent;  /* notes ref's commit, NULL if there is none yet */
+    git_index*      tree;    /* notes tree being built, one entry per note */
+    size_t          added;
+};
+
+ag_fp_notes_t* ag_fp_notes_begin(git_repository* repo) {
+    ag_fp_notes_t* notes = calloc(1, sizeof(*notes));
+    if (!notes) return NULL;
+    notes->repo = repo;
+
+    git_oid head;
+    git_tree* tree = NULL;
+    int err = git_index_new(&notes->tree);
+    if (err == 0 && git_reference_name_to_id(&head, repo, AG_FP_NOTES_REF) == 0) {
+        err = git_commit_lookup(&notes->parent, repo, &head);
+        if (err == 0) err = git_commit_tree(&tree, notes->parent);
+        if (err == 0) err = git_index_read_tree(notes->tree, tree);
+        git_tree_free(tree);
+    }
+    if (err < 0) {
+        ag_fp_notes_free(notes);
+        return NULL;
+    }
+    return notes;
+}
+
+/* Entry of a blob's note, stored flat or under any depth of two-digit
+   fanout directories (git fans out large notes trees). path receives
+   the entry's path, or the flat path if there is none. */
+static const git_index_entry* find_note(git_index* tree, const char* hex,
+                                        char* path) {
+    for (size_t depth = 0; 2 * depth < GIT_OID_HEXSZ; depth++) {
+        char* p = path;
+        for (size_t k = 0; k < depth; k++) {
+            *p++ = hex[2 * k];
+            *p++ = hex[2 * k + 1];
+            *p++ = '/';
+        }
+        strcpy(p, hex + 2 * depth);
+        const git_index_entry* e = git_index_get_bypath(tree, path, 0);
+        if (e) return e;
+    }
+    strcpy(path, hex);
+    return NULL;
+}
+
+int ag_fp_notes_add(ag_fp_notes_t* notes, const git_oid* blob_oid,
+                    const ag_fingerprint_set_t* fp) {
+    char hex[GIT_OID_HEXSZ + 1];
+    char path[GIT_OID_HEXSZ + GIT_OID_HEXSZ / 2 + 1];
+    git_oid_tostr(hex, sizeof(hex), blob_oid);
+
+    /* Only a note from an older scheme is replaced: a newer build's
+       note, or one that is not ours, is left alone */
+    const git_index_entry* old = find_note(notes->tree, hex, path);
+    if (old) {
+        git_blob* blob = NULL;
+        if (git_blob_lookup(&blob, notes->repo, &old->id) < 0) return -1;
+        int version = note_version(git_blob_rawcontent(blob),
+                                   (size_t)git_blob_rawsize(blob));
+        git_blob_free(blob);
+        if (version < 0 || version >= AG_FP_SCHEME_VERSION) return 0;
+    }
+
+    char* msg = note_message(fp);
+    if (!msg) return -1;
+    git_index_entry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.mode = GIT_FILEMODE_BLOB;
+    entry.path = path;
+    int err = git_blob_create_from_buffer(&entry.id, notes->repo, msg, strlen(msg));
+    free(msg);
+    if (err < 0 || git_index_add(notes->tree, &entry) < 0) return -1;
+    notes->added++;
+    return 1;
+}
+
+int ag_fp_notes_commit(ag_fp_notes_t* notes) {
+    if (notes->added == 0) return 0;
+
+    git_signature* sig = NULL;
+    if (git_signature_default(&sig, notes->repo) < 0 &&
+        git_signature_now(&sig, "aleagit", "aleagit@localhost") < 0)
+        return -1;
+
+    git_oid tree_oid, commit_oid;
+    git_tree* tree = NULL;
+    git_reference* ref = NULL;
+    const git_commit* parents[1] = { notes->parent };
+    int err = git_index_write_tree_to(&tree_oid, notes->tree, notes->repo);
+    if (err == 0) err = git_tree_lookup(&tree, notes->repo, &tree_oid);
+    if (err == 0)
+        err = git_commit_create(&commit_oid, notes->repo, NULL, sig, sig, NULL,
+                                "Notes added by aleagit\n", tree,
+                                notes->parent ? 1 : 0, parents);
+
+    /* Fails rather than drop notes if another process moved the ref */
+    if (err == 0 && notes->parent)
+        err = git_reference_create_matching(&ref, notes->repo, AG_FP_NOTES_REF,
+                                            &commit_oid, 1,
+                                            git_commit_id(notes->parent),
+                                            "aleagit: add fingerprint notes");
+    else if (err == 0)
+        err = git_reference_create(&ref, notes->repo, AG_FP_NOTES_REF, &commit_oid,
+                                   0, "aleagit: add fingerprint notes");
+
+    git_reference_free(ref);
+    git_tree_free(tree);
+    git_signature_free(sig);
+    if (err < 0) return -1;
+    notes->added = 0;
+    return 0;
+}
+
+void ag_fp_notes_free(ag_fp_notes_t* notes) {
+    if (!notes) return;
+    git_commit_free(notes->parent);
+    git_index_free(notes->tree);
+    free(notes);
+}
+
+/* Cache lookup that updates the counters (misses only if count_miss).
+   A notes hit is copied into the local cache so the next lookup does not
+   need the notes tree. */
+static ag_fingerprint_set_t* cache_lookup(git_repository* repo,
+                                          const git_oid* blob_oid,
+                                          bool count_miss) {
+    ag_fingerprint_set_t* fp = ag_fp_cache_get(repo, blob_oid);
+    if (fp) {
+        atomic_fetch_add(&cache_hits, 1);
+        return fp;
+    }
+
+    fp = ag_fp_notes_get(repo, blob_oid);
+    if (fp) {
+        atomic_fetch_add(&cache_note_hits, 1);
+        ag_fp_cache_put(repo, blob_oid, fp);
+        return fp;
+    }
+
+    if (count_miss) atomic_fetch_add(&cache_misses, 1);
+    return NULL;
+}
+
+ag_fingerprint_set_t* ag_fingerprint_cached(git_repository* repo,
+                                            const git_oid* blob_oid) {
+    return cache_lookup(repo, blob_oid, false);
+}
+
+/* Patch base's fingerprints into those of an MCNP deck's text, or NULL */
+static ag_fingerprint_set_t* fingerprint_patched(const ag_fp_base_t* base,
+                                                 const char* data, size_t len,
+                                                 const char* path) {
+    if (ag_detect_format(path, data, len) != GEOM_FORMAT_MCNP) return NULL;
+    ag_fingerprint_set_t* fp = ag_fingerprint_incremental(base, data, len);
+    if (fp) atomic_fetch_add(&cache_patched, 1);
+    return fp;
+}
+
+ag_fingerprint_set_t* ag_fingerprint_blob_from(git_repository* repo,
+                                               const git_oid* blob_oid,
+                                               const char* path,
+                                               const ag_fp_base_t* base) {
+    ag_fingerprint_set_t* fp = cache_lookup(repo, blob_oid, true);
+    if (fp) return fp;
+
+    ag_blob_t b;
+    if (base && ag_blob_open_oid(repo, blob_oid, &b) == 0) {
+        fp = fingerprint_patched(base, b.data, b.len, path);
+        ag_blob_release(&b);
+    }
+    if (!fp) {
+        alea_system_t* sys = ag_load_geometry_blob(repo, blob_oid, path, AG_LOAD_GEOMETRY);
+        if (!sys) return NULL;
+        fp = ag_fingerprint(sys);
+        alea_destroy(sys);
+    }
+    if (fp) ag_fp_cache_put(repo, blob_oid, fp);
+    return fp;
+}
+
+ag_fingerprint_set_t* ag_fingerprint_blob(git_repository* repo,
+                                          const git_oid* blob_oid,
+                                          const char* path) {
+    return ag_fingerprint_blob_from(repo, blob_oid, path, NULL);
+}
+
+ag_fingerprint_set_t* ag_fingerprint_commit(git_repository* repo,
+                                            git_commit* commit,
+                                            const char* path) {
+    git_oid blob_oid;
+    if (ag_commit_blob_oid(repo, commit, path, &blob_oid) < 0) return NULL;
+    return ag_fingerprint_blob(repo, &blob_oid, path);
+}
+
+ag_fingerprint_set_t* ag_fingerprint_staged(git_repository* repo,
+                                            const char* path) {
+    git_oid blob_oid;
+    if (ag_staged_blob_oid(repo, path, &blob_oid) < 0) return NULL;
+    return ag_fingerprint_blob(repo, &blob_oid, path);
+}
+
+ag_fingerprint_set_t* ag_fingerprint_workdir_from(git_repository* repo,
+                                                  const char* path,
+                                                  const ag_fp_base_t* base) {
+    const char* workdir = git_repository_workdir(repo);
+    if (!workdir) {
+        ag_error("bare repository has no working directory");
+        return NULL;
+    }
+
+    char fullpath[4096];
+    snprintf(fullpath, sizeof(fullpath), "%s%s", workdir, path);
+
+    git_oid blob_oid;
+    bool have_oid = git_odb_hashfile(&blob_oid, fullpath, GIT_OBJECT_BLOB) == 0;
+    if (have_oid) {
+        ag_fingerprint_set_t* fp = cache_lookup(repo, &blob_oid, true);
+        if (fp) return fp;
+    }
+
+    ag_fingerprint_set_t* fp = NULL;
+    const char* data;
+    size_t len;
+    if (base && ag_workdir_map(repo, path, &data, &len) == 0) {
+        fp = fingerprint_patched(base, data, len, path);
+        ag_workdir_unmap(data, len);
+    }
+    if (!fp) {
+        alea_system_t* sys = ag_load_geometry_workdir(repo, path, AG_LOAD_GEOMETRY);
+        if (!sys) return NULL;
+        fp = ag_fingerprint(sys);
+        alea_destroy(sys);
+    }
+    if (fp && have_oid) ag_fp_cache_put(repo, &blob_oid, fp);
+    return fp;
+}
+
+ag_fingerprint_set_t* ag_fingerprint_workdir(git_repository* repo,
+                                             const char* path) {
+    return ag_fingerprint_workdir_from(repo, path, NULL);
+}
@@ -0,0 +1,105 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+#ifndef ALEAGIT_FP_CACHE_H
+#define ALEAGIT_FP_CACHE_H
+
+#include "geom_fingerprint.h"
+#include "fp_incr.h"
+#include <git2.h>
+#include <stddef.h>
+
+/* On-disk fingerprint cache under <gitdir>/aleagit/. Entries are keyed by
+   blob OID and AG_FP_SCHEME_VERSION, so a blob is parsed at most once per
+   scheme. Set ALEAGIT_NO_CACHE to bypass it. */
+
+/* Look up a cached fingerprint set. Returns NULL on miss. */
+ag_fingerprint_set_t* ag_fp_cache_get(git_repository* repo,
+                                      const git_oid* blob_oid);
+
+/* Store a fingerprint set. Returns 0 on success. */
+int ag_fp_cache_put(git_repository* repo, const git_oid* blob_oid,
+                    const ag_fingerprint_set_t* fp);
+
+/* Counters since process start: local cache hits, hits served from the
+   notes ref, misses that required a parse, and how many of those were
+   patched from an earlier version (ag_fingerprint_incremental()). */
+void ag_fp_cache_stats(size_t* hits, size_t* note_hits, size_t* misses,
+                       size_t* patched);
+
+/* Notes ref that carries fingerprints between clones. Each note is
+   attached to a geometry blob and holds its serialized fingerprint set.
+   Share it with:
+     git push origin refs/notes/aleagit
+     git config --add remote.origin.fetch +refs/notes/aleagit:refs/notes/aleagit */
+#define AG_FP_NOTES_REF "refs/notes/aleagit"
+
+/* Read a fingerprint set from the notes ref. Returns NULL if the blob has
+   no note or the note was written by another scheme version. */
+ag_fingerprint_set_t* ag_fp_notes_get(git_repository* repo,
+                                      const git_oid* blob_oid);
+
+/* Batch of notes for the notes ref, written as a single notes commit
+   by ag_fp_notes_commit() */
+typedef struct ag_fp_notes ag_fp_notes_t;
+
+/* Start a batch on top of the notes ref's current tree. Returns NULL on
+   error. */
+ag_fp_notes_t* ag_fp_notes_begin(git_repository* repo);
+
+/* Queue a blob's fingerprint set. A note from an older scheme version is
+   replaced; a note of the current or a newer scheme, or one aleagit did
+   not write, is left alone. Returns 1 if queued, 0 if a note was kept,
+   -1 on error. */
+int ag_fp_notes_add(ag_fp_notes_t* notes, const git_oid* blob_oid,
+                    const ag_fingerprint_set_t* fp);
+
+/* Commit the queued notes and move the notes ref, unless it moved since
+   ag_fp_notes_begin(). Nothing is written if no note was queued.
+   Returns 0 on success, -1 on error. */
+int ag_fp_notes_commit(ag_fp_notes_t* notes);
+
+void ag_fp_notes_free(ag_fp_notes_t* notes);
+
+/* Fingerprint a geometry blob. The local cache is consulted first, then
+   the notes ref; the blob is parsed only if both miss.
+   The path is used for format detection. Caller must
+   ag_fingerprint_set_free(). Returns NULL if the blob cannot be loaded. */
+ag_fingerprint_set_t* ag_fingerprint_blob(git_repository* repo,
+                                          const git_oid* blob_oid,
+                                          const char* path);
+
+/* Cached fingerprint set of a blob, from the local cache or the notes
+   ref; NULL if neither has it. Never parses. */
+ag_fingerprint_set_t* ag_fingerprint_cached(git_repository* repo,
+                                            const git_oid* blob_oid);
+
+/* Same as ag_fingerprint_blob(), but on a cache miss an MCNP blob is
+   first patched from base, an earlier version of the file, and only
+   parsed in full if that fails. base may be NULL. */
+ag_fingerprint_set_t* ag_fingerprint_blob_from(git_repository* repo,
+                                               const git_oid* blob_oid,
+                                               const char* path,
+                                               const ag_fp_base_t* base);
+
+/* Fingerprint a file as of a commit. Returns NULL if it does not exist. */
+ag_fingerprint_set_t* ag_fingerprint_commit(git_repository* repo,
+                                            git_commit* commit,
+                                            const char* path);
+
+/* Fingerprint the staged (index) version of a file. */
+ag_fingerprint_set_t* ag_fingerprint_staged(git_repository* repo,
+                                            const char* path);
+
+/* Fingerprint the working-tree version of a file. The file is hashed to
+   its blob OID first, so unmodified content hits the cache. */
+ag_fingerprint_set_t* ag_fingerprint_workdir(git_repository* repo,
+                                             const char* path);
+
+/* Same, patching from base on a cache miss (ag_fingerprint_blob_from()) */
+ag_fingerprint_set_t* ag_fingerprint_workdir_from(git_repository* repo,
+                                                  const char* path,
+                                                  const ag_fp_base_t* base);
+
+#endif /* ALEAGIT_FP_CACHE_H */
@@ -0,0 +1,353 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+#include "fp_incr.h"
+#include "mcnp_norm.h"
+#include <alea.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Title of the partial deck handed to the parser */
+#define PATCH_TITLE "aleagit incremental\n"
+
+/* Cell or surface card by number */
+typedef struct {
+    int    id;
+    size_t card;   /* into the deck's cards */
+} card_key_t;
+
+typedef struct {
+    int*   items;
+    size_t count;
+} id_list_t;
+
+typedef struct {
+    ag_mcnp_deck_t old, cur;
+    card_key_t*    old_cells;
+    card_key_t*    old_surfaces;
+    card_key_t*    cells;
+    card_key_t*    surfaces;
+    size_t         nold_cells, nold_surfaces, ncells, nsurfaces;
+    bool*          parse;           /* per card of cur: goes to the parser */
+    size_t*        work;            /* cell cards still to follow */
+    id_list_t      drop_cells;      /* numbers gone from cur, ascending */
+    id_list_t      drop_surfaces;
+    char*          deck;            /* partial deck */
+} incr_t;
+
+static int compare_key(const void* a, const void* b) {
+    int x = ((const card_key_t*)a)->id, y = ((const card_key_t*)b)->id;
+    return (x > y) - (x < y);
+}
+
+/* Cards of one kind sorted by number. Returns -1 on unnumbered or
+   duplicate cards, or out of memory. */
+static int sorted_keys(const ag_mcnp_deck_t* deck, int kind, card_key_t** out,
+                       size_t* count) {
+    size_t n = 0;
+    for (size_t i = 0; i < deck->count; i++)
+        if (deck->cards[i].kind == kind) n++;
+    card_key_t* keys = malloc((n ? n : 1) * sizeof(card_key_t));
+    if (!keys) return -1;
+
+    n = 0;
+    for (size_t i = 0; i < deck->count; i++) {
+        if (deck->cards[i].kind != kind) continue;
+        if (deck->cards[i].id < 0) {
+            free(keys);
+            return -1;
+        }
+        keys[n++] = (card_key_t){ deck->cards[i].id, i };
+    }
+    qsort(keys, n, sizeof(card_key_t), compare_key);
+    for (size_t i = 1; i < n; i++) {
+        if (keys[i].id == keys[i - 1].id) {
+            free(keys);
+            return -1;
+        }
+    }
+    *out = keys;
+    *count = n;
+    return 0;
+}
+
+/* Card index of a number, or SIZE_MAX */
+static size_t find_key(const card_key_t* keys, size_t n, int id) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (keys[mid].id < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < n && keys[lo].id == id ? keys[lo].card : SIZE_MAX;
+}
+
+/* Same TRn cards, in the same order */
+static bool same_transforms(const ag_mcnp_deck_t* a, const ag_mcnp_deck_t* b) {
+    size_t i = 0, j = 0;
+    for (;;) {
+        while (i < a->count && a->cards[i].kind != AG_CARD_TRANSFORM) i++;
+        while (j < b->count && b->cards[j].kind != AG_CARD_TRANSFORM) j++;
+        if (i == a->count || j == b->count) return i == a->count && j == b->count;
+        if (a->cards[i++].hash != b->cards[j++].hash) return false;
+    }
+}
+
+static bool has_cell_params(const ag_mcnp_deck_t* deck) {
+    for (size_t i = 0; i < deck->count; i++)
+        if (deck->cards[i].kind == AG_CARD_CELL_PARAM) return true;
+    return false;
+}
+
+/* The base set was fingerprinted from the base deck: same cell and
+   surface numbers, one element per card */
+static bool base_matches(const ag_fingerprint_set_t* fp, const incr_t* st) {
+    if (fp->cell_count != st->nold_cells || fp->surface_count != st->nold_surfaces)
+        return false;
+    for (size_t i = 0; i < st->nold_cells; i++)
+        if (fp->cell_id[i] != st->old_cells[i].id) return false;
+    for (size_t i = 0; i < st->nold_surfaces; i++)
+        if (fp->surface_id[i] != st->old_surfaces[i].id) return false;
+    return true;
+}
+
+/* Mark the cards of cur that are new or whose text changed, and list
+   the numbers that are gone. Returns the number marked, or SIZE_MAX if
+   out of memory. */
+static size_t mark_changed(incr_t* st, const card_key_t* old, size_t nold,
+                           const card_key_t* cur, size_t ncur, id_list_t* drop) {
+    size_t changed = 0;
+    for (size_t i = 0; i < ncur; i++) {
+        size_t o = find_key(old, nold, cur[i].id);
+        if (o == SIZE_MAX || st->old.cards[o].hash != st->cur.cards[cur[i].card].hash) {
+            st->parse[cur[i].card] = true;
+            changed++;
+        }
+    }
+
+    drop->items = malloc((nold ? nold : 1) * sizeof(int));
+    if (!drop->items) return SIZE_MAX;
+    for (size_t i = 0; i < nold; i++)
+        if (find_key(cur, ncur, old[i].id) == SIZE_MAX)
+            drop->items[drop->count++] = old[i].id;
+    return changed;
+}
+
+static const int* card_refs(const ag_mcnp_deck_t* deck, const ag_mcnp_card_t* c) {
+    return deck->refs + c->first_ref;
+}
+
+/* Cells whose region or LIKE source is a reparsed or removed cell must
+   be reparsed too, until nothing changes */
+static void mark_dependents(incr_t* st) {
+    bool grew = true;
+    while (grew) {
+        grew = false;
+        for (size_t i = 0; i < st->cur.count; i++) {
+            const ag_mcnp_card_t* c = &st->cur.cards[i];
+            if (c->kind != AG_CARD_CELL || c->cell_refs == 0 || st->parse[i]) continue;
+            const int* cells = card_refs(&st->cur, c) + c->surface_refs;
+            for (uint32_t k = 0; k < c->cell_refs; k++) {
+                size_t r = find_key(st->cells, st->ncells, cells[k]);
+                if (r == SIZE_MAX || st->parse[r]) {
+                    st->parse[i] = grew = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/* Nothing left in cur may refer to a dropped card: the splice would
+   quietly keep a cell whose surface or #n cell is gone, where the full
+   parse rejects the deck */
+static bool drops_unreferenced(const incr_t* st) {
+    if (st->drop_cells.count == 0 && st->drop_surfaces.count == 0) return true;
+    for (size_t i = 0; i < st->cur.count; i++) {
+        const ag_mcnp_card_t* c = &st->cur.cards[i];
+        if (c->kind != AG_CARD_CELL) continue;
+        if (!c->exact) return false;
+        const int* refs = card_refs(&st->cur, c);
+        for (uint32_t k = 0; k < c->surface_refs; k++)
+            if (find_key(st->surfaces, st->nsurfaces, refs[k]) == SIZE_MAX) return false;
+        for (uint32_t k = 0; k < c->cell_refs; k++)
+            if (find_key(st->cells, st->ncells, refs[c->surface_refs + k]) == SIZE_MAX)
+                return false;
+    }
+    return true;
+}
+
+/* Add the cells that reparsed cells refer to, then the surfaces of every
+   reparsed cell. Returns -1 if a reference cannot be followed. */
+static int mark_needed(incr_t* st) {
+    size_t nwork = 0;
+    for (size_t i = 0; i < st->cur.count; i++)
+        if (st->parse[i] && st->cur.cards[i].kind == AG_CARD_CELL) st->work[nwork++] = i;
+
+    while (nwork > 0) {
+        const ag_mcnp_card_t* c = &st->cur.cards[st->work[--nwork]];
+        if (!c->exact) return -1;
+        const int* refs = card_refs(&st->cur, c);
+        for (uint32_t k = 0; k < c->surface_refs; k++) {
+            size_t r = find_key(st->surfaces, st->nsurfaces, refs[k]);
+            if (r == SIZE_MAX) return -1;
+            st->parse[r] = true;
+        }
+        for (uint32_t k = 0; k < c->cell_refs; k++) {
+            size_t r = find_key(st->cells, st->ncells, refs[c->surface_refs + k]);
+            if (r == SIZE_MAX) return -1;
+            if (st->parse[r]) continue;
+            st->parse[r] = true;
+            st->work[nwork++] = r;
+        }
+    }
+    return 0;
+}
+
+/* The parser needs a cell block: when only surfaces changed, borrow an
+   unchanged self-contained cell (its row comes out the same) */
+static bool borrow_cell(incr_t* st) {
+    for (size_t i = 0; i < st->cur.count; i++) {
+        const ag_mcnp_card_t* c = &st->cur.cards[i];
+        if (c->kind == AG_CARD_CELL && c->exact && c->cell_refs == 0) {
+            st->parse[i] = true;
+            return mark_needed(st) == 0;
+        }
+    }
+    return false;
+}
+
+/* Append the raw text of the marked cards of one kind, each ending in a
+   newline, then a blank line */
+static size_t emit_cards(const incr_t* st, const char* data, int kind,
+                         char* out, size_t n) {
+    for (size_t i = 0; i < st->cur.count; i++) {
+        const ag_mcnp_card_t* c = &st->cur.cards[i];
+        bool take = kind == AG_CARD_TRANSFORM ? c->kind == kind
+                                              : c->kind == kind && st->parse[i];
+        if (!take) continue;
+        memcpy(out + n, data + c->offset, c->length);
+        n += c->length;
+        if (out[n - 1] != '\n') out[n++] = '\n';
+    }
+    if (kind != AG_CARD_TRANSFORM) out[n++] = '\n';
+    return n;
+}
+
+/* Parse the marked cards as a deck of their own: title, cells,
+   surfaces, TRn cards */
+static ag_fingerprint_set_t* parse_marked(incr_t* st, const char* data,
+                                          size_t* ncells, size_t* nsurfaces) {
+    size_t size = sizeof(PATCH_TITLE) + 2;
+    *ncells = *nsurfaces = 0;
+    for (size_t i = 0; i < st->cur.count; i++) {
+        const ag_mcnp_card_t* c = &st->cur.cards[i];
+        if (c->kind == AG_CARD_TRANSFORM || st->parse[i]) size += c->length + 1;
+        if (st->parse[i] && c->kind == AG_CARD_CELL) (*ncells)++;
+        if (st->parse[i] && c->kind == AG_CARD_SURFACE) (*nsurfaces)++;
+    }
+    st->deck = malloc(size);
+    if (!st->deck) return NULL;
+
+    size_t n = sizeof(PATCH_TITLE) - 1;
+    memcpy(st->deck, PATCH_TITLE, n);
+    n = emit_cards(st, data, AG_CARD_CELL, st->deck, n);
+    n = emit_cards(st, data, AG_CARD_SURFACE, st->deck, n);
+    n = emit_cards(st, data, AG_CARD_TRANSFORM, st->deck, n);
+    st->deck[n] = '\0';
+
+    alea_system_t* sys = alea_load_mcnp_string(st->deck, n);
+    if (!sys) return NULL;
+    ag_fingerprint_set_t* fp = ag_fingerprint(sys);
+    alea_destroy(sys);
+    return fp;
+}
+
+/* One element per reparsed card, numbered as the cards are */
+static bool patch_matches(const ag_fingerprint_set_t* fp, const incr_t* st,
+                          size_t ncells, size_t nsurfaces) {
+    if (fp->cell_count != ncells || fp->surface_count != nsurfaces) return false;
+    for (size_t i = 0; i < ncells; i++) {
+        size_t c = find_key(st->cells, st->ncells, fp->cell_id[i]);
+        if (c == SIZE_MAX || !st->parse[c]) return false;
+    }
+    for (size_t i = 0; i < nsurfaces; i++) {
+        size_t c = find_key(st->surfaces, st->nsurfaces, fp->surface_id[i]);
+        if (c == SIZE_MAX || !st->parse[c]) return false;
+    }
+    return true;
+}
+
+static ag_fingerprint_set_t* patch_deck(incr_t* st, const ag_fp_base_t* base,
+                                        const char* data, size_t len) {
+    if (ag_mcnp_split(base->data, base->len, &st->old) < 0 ||
+        ag_mcnp_split(data, len, &st->cur) < 0)
+        return NULL;
+    if (has_cell_params(&st->old) || has_cell_params(&st->cur) ||
+        !same_transforms(&st->old, &st->cur))
+        return NULL;
+    if (sorted_keys(&st->old, AG_CARD_CELL, &st->old_cells, &st->nold_cells) < 0 ||
+        sorted_keys(&st->old, AG_CARD_SURFACE, &st->old_surfaces, &st->nold_surfaces) < 0 ||
+        sorted_keys(&st->cur, AG_CARD_CELL, &st->cells, &st->ncells) < 0 ||
+        sorted_keys(&st->cur, AG_CARD_SURFACE, &st->surfaces, &st->nsurfaces) < 0)
+        return NULL;
+    if (!base_matches(base->fp, st)) return NULL;
+
+    st->parse = calloc(st->cur.count ? st->cur.count : 1, sizeof(bool));
+    st->work = malloc((st->cur.count ? st->cur.count : 1) * sizeof(size_t));
+    if (!st->parse || !st->work) return NULL;
+
+    size_t changed_cells = mark_changed(st, st->old_cells, st->nold_cells,
+                                        st->cells, st->ncells, &st->drop_cells);
+    size_t changed_surfaces = changed_cells == SIZE_MAX ? SIZE_MAX
+                            : mark_changed(st, st->old_surfaces, st->nold_surfaces,
+                                           st->surfaces, st->nsurfaces, &st->drop_surfaces);
+    if (changed_surfaces == SIZE_MAX || !drops_unreferenced(st)) return NULL;
+    if (changed_cells == 0 && changed_surfaces == 0)
+        return ag_fingerprint_splice(base->fp, st->drop_cells.items, st->drop_cells.count,
+                                     st->drop_surfaces.items, st->drop_surfaces.count, NULL);
+
+    mark_dependents(st);
+    if (mark_needed(st) < 0) return NULL;
+    bool any_cell = false;
+    for (size_t i = 0; i < st->ncells && !any_cell; i++)
+        any_cell = st->parse[st->cells[i].card];
+    if (!any_cell && !borrow_cell(st)) return NULL;
+
+    /* Past half the deck a full parse is as cheap and simpler */
+    size_t marked = 0;
+    for (size_t i = 0; i < st->cur.count; i++) marked += st->parse[i];
+    if (2 * marked > st->ncells + st->nsurfaces) return NULL;
+
+    size_t ncells, nsurfaces;
+    ag_fingerprint_set_t* patch = parse_marked(st, data, &ncells, &nsurfaces);
+    ag_fingerprint_set_t* fp = NULL;
+    if (patch && patch_matches(patch, st, ncells, nsurfaces))
+        fp = ag_fingerprint_splice(base->fp, st->drop_cells.items, st->drop_cells.count,
+                                   st->drop_surfaces.items, st->drop_surfaces.count, patch);
+    ag_fingerprint_set_free(patch);
+    return fp;
+}
+
+ag_fingerprint_set_t* ag_fingerprint_incremental(const ag_fp_base_t* base,
+                                                 const char* data, size_t len) {
+    incr_t st;
+    memset(&st, 0, sizeof(st));
+    ag_fingerprint_set_t* fp = patch_deck(&st, base, data, len);
+
+    ag_mcnp_deck_free(&st.old);
+    ag_mcnp_deck_free(&st.cur);
+    free(st.old_cells);
+    free(st.old_surfaces);
+    free(st.cells);
+    free(st.surfaces);
+    free(st.parse);
+    free(st.work);
+    free(st.drop_cells.items);
+    free(st.drop_surfaces.items);
+    free(st.deck);
+    return fp;
+}
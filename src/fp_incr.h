@@ -0,0 +1,36 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+#ifndef ALEAGIT_FP_INCR_H
+#define ALEAGIT_FP_INCR_H
+
+#include "geom_fingerprint.h"
+#include <stddef.h>
+
+/* Earlier version of an MCNP deck and its fingerprint set */
+typedef struct {
+    const ag_fingerprint_set_t* fp;
+    const char*                 data;
+    size_t                      len;
+} ag_fp_base_t;
+
+/* Fingerprint an MCNP deck by patching the fingerprints of an earlier
+   version. Both decks are split into cards (ag_mcnp_split()); cell and
+   surface cards are matched by number and compared by hash. Only the
+   cards that changed, the cells that refer to a changed cell, and what
+   those cards need to parse (referenced cells and surfaces, TRn cards)
+   go through the parser, and the result is spliced into base->fp
+   (ag_fingerprint_splice()).
+
+   Returns NULL, and the caller parses the deck in full, whenever the
+   patch cannot be trusted: READ cards, U/LAT/FILL data cards or '#'
+   tables (they assign by cell position), changed TRn cards, duplicate
+   or non-numeric card numbers, a removed cell or surface that a
+   remaining cell still refers to, macrobody facets in a reparsed cell, a
+   base set that does not match the base deck card for card, a parse
+   failure, or more than half of the cards changed. */
+ag_fingerprint_set_t* ag_fingerprint_incremental(const ag_fp_base_t* base,
+                                                 const char* data, size_t len);
+
+#endif /* ALEAGIT_FP_INCR_H */
@@ -3,104 +3,936 @@
 // SPDX-License-Identifier: MPL-2.0
 
 #include "geom_diff.h"
+#include "hash64.h"
 #include "util.h"
+#include <alea_types.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
-ag_diff_result_t* ag_diff(const ag_fingerprint_set_t* old_fp,
-                          const ag_fingerprint_set_t* new_fp) {
-    ag_diff_result_t* r = calloc(1, sizeof(*r));
-    if (!r) return NULL;
+/* ------------------------------------------------------------------ */
+/*  Region-tree localization                                          */
+/* ------------------------------------------------------------------ */
 
-    /* --- Surface diff (two-pointer merge on sorted arrays) --- */
-    size_t max_surfs = old_fp->surface_count + new_fp->surface_count;
-    r->surfaces = calloc(max_surfs, sizeof(ag_surface_diff_t));
-    size_t si = 0;
+typedef struct {
+    uint32_t a, b;
+} node_pair_t;
 
-    size_t oi = 0, ni = 0;
-    while (oi < old_fp->surface_count || ni < new_fp->surface_count) {
-        const ag_surface_fp_t* o = oi < old_fp->surface_count ? &old_fp->surfaces[oi] : NULL;
-        const ag_surface_fp_t* n = ni < new_fp->surface_count ? &new_fp->surfaces[ni] : NULL;
-
-        if (o && n && o->surface_id == n->surface_id) {
-            if (ag_surface_fp_compare(o, n) != 0) {
-                r->surfaces[si].change = DIFF_MODIFIED;
-                r->surfaces[si].id     = o->surface_id;
-                r->surfaces[si].flags  = ag_surface_fp_diff(o, n);
-                r->surfaces[si].old_fp = *o;
-                r->surfaces[si].new_fp = *n;
-                si++;
-                r->surfs_modified++;
+typedef struct {
+    void*  items;
+    size_t count;
+    size_t cap;
+} vec_t;
+
+static void* vec_push(vec_t* v, size_t elem) {
+    if (v->count == v->cap) {
+        size_t cap = v->cap ? v->cap * 2 : 64;
+        void* items = realloc(v->items, cap * elem);
+        if (!items) return NULL;
+        v->items = items;
+        v->cap = cap;
+    }
+    return (char*)v->items + elem * v->count++;
+}
+
+/* One side of the walk. visited holds, per node, the stamp of the last
+   cell whose references were collected from it, so a subtree shared
+   within a cell is only listed once. */
+typedef struct {
+    const ag_fingerprint_set_t* fp;
+    uint32_t* visited;
+    vec_t     refs;   /* int */
+} region_side_t;
+
+/* Scratch shared by all modified cells of one diff */
+typedef struct {
+    region_side_t old_side, new_side;
+    vec_t         pairs;  /* node_pair_t */
+    vec_t         stack;  /* uint32_t */
+    uint32_t      stamp;
+} region_walk_t;
+
+/* Append the distinct surface references under node to side->refs */
+static int collect_refs(region_walk_t* w, region_side_t* side, uint32_t node) {
+    if (node == AG_REGION_NONE) return 0;
+    if (!side->visited) {
+        side->visited = calloc(side->fp->node_count ? side->fp->node_count : 1,
+                               sizeof(uint32_t));
+        if (!side->visited) return -1;
+    }
+
+    w->stack.count = 0;
+    uint32_t* top = vec_push(&w->stack, sizeof(uint32_t));
+    if (!top) return -1;
+    *top = node;
+
+    while (w->stack.count > 0) {
+        uint32_t i = ((uint32_t*)w->stack.items)[--w->stack.count];
+        if (side->visited[i] == w->stamp) continue;
+        side->visited[i] = w->stamp;
+
+        const ag_region_node_t* n = &side->fp->nodes[i];
+        if (n->op == ALEA_OP_PRIMITIVE) {
+            int* ref = vec_push(&side->refs, sizeof(int));
+            if (!ref) return -1;
+            *ref = n->sense < 0 ? -n->surface_id : n->surface_id;
+            continue;
+        }
+        uint32_t kids[2] = { n->left, n->right };
+        for (int k = 0; k < 2; k++) {
+            if (kids[k] == AG_REGION_NONE) continue;
+            if (!(top = vec_push(&w->stack, sizeof(uint32_t)))) return -1;
+            *top = kids[k];
+        }
+    }
+    return 0;
+}
+
+static int cmp_ref(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+/* Sort and deduplicate a reference list in place */
+static size_t unique_refs(int* refs, size_t n) {
+    if (n == 0) return 0;
+    qsort(refs, n, sizeof(int), cmp_ref);
+    size_t out = 1;
+    for (size_t i = 1; i < n; i++)
+        if (refs[i] != refs[out - 1]) refs[out++] = refs[i];
+    return out;
+}
+
+/* Elements of sorted a missing from sorted b, malloc'd */
+static int* refs_minus(const int* a, size_t na, const int* b, size_t nb, size_t* out_count) {
+    int* out = malloc((na ? na : 1) * sizeof(int));
+    size_t n = 0, j = 0;
+    if (!out) { *out_count = 0; return NULL; }
+    for (size_t i = 0; i < na; i++) {
+        while (j < nb && b[j] < a[i]) j++;
+        if (j < nb && b[j] == a[i]) continue;
+        out[n++] = a[i];
+    }
+    *out_count = n;
+    return out;
+}
+
+/* Walk both region trees of a modified cell together. Subtrees with equal
+   Merkle hashes are skipped; operators that match on both sides are
+   descended into; any other pair is a diverging sub-expression, whose
+   surface references are gathered. Leaves d->region_places at 0 if the
+   walk could not complete. */
+static void localize_region(region_walk_t* w, uint32_t old_root, uint32_t new_root,
+                            ag_cell_change_detail_t* d) {
+    const ag_fingerprint_set_t* ofp = w->old_side.fp;
+    const ag_fingerprint_set_t* nfp = w->new_side.fp;
+    size_t places = 0;
+
+    w->stamp++;
+    w->old_side.refs.count = 0;
+    w->new_side.refs.count = 0;
+    w->pairs.count = 0;
+
+    node_pair_t* top = vec_push(&w->pairs, sizeof(node_pair_t));
+    if (!top) return;
+    top->a = old_root;
+    top->b = new_root;
+
+    while (w->pairs.count > 0) {
+        node_pair_t pr = ((node_pair_t*)w->pairs.items)[--w->pairs.count];
+        if (pr.a == AG_REGION_NONE && pr.b == AG_REGION_NONE) continue;
+
+        if (pr.a != AG_REGION_NONE && pr.b != AG_REGION_NONE) {
+            const ag_region_node_t* na = &ofp->nodes[pr.a];
+            const ag_region_node_t* nb = &nfp->nodes[pr.b];
+            if (na->hash == nb->hash) continue;
+            if (na->op == nb->op && na->op != ALEA_OP_PRIMITIVE) {
+                /* Push right first so the left operand is reported first */
+                node_pair_t kids[2] = { { na->right, nb->right },
+                                        { na->left,  nb->left } };
+                for (int k = 0; k < 2; k++) {
+                    if (!(top = vec_push(&w->pairs, sizeof(node_pair_t)))) return;
+                    *top = kids[k];
+                }
+                continue;
             }
-            oi++; ni++;
-        } else if (!n || (o && o->surface_id < n->surface_id)) {
-            r->surfaces[si].change = DIFF_REMOVED;
-            r->surfaces[si].id     = o->surface_id;
-            r->surfaces[si].old_fp = *o;
-            si++;
-            r->surfs_removed++;
-            oi++;
-        } else {
-            r->surfaces[si].change = DIFF_ADDED;
-            r->surfaces[si].id     = n->surface_id;
-            r->surfaces[si].new_fp = *n;
-            si++;
-            r->surfs_added++;
-            ni++;
         }
+
+        places++;
+        if (collect_refs(w, &w->old_side, pr.a) < 0) return;
+        if (collect_refs(w, &w->new_side, pr.b) < 0) return;
     }
-    r->surface_count = si;
-
-    /* --- Cell diff --- */
-    size_t max_cells = old_fp->cell_count + new_fp->cell_count;
-    r->cells = calloc(max_cells, sizeof(ag_cell_diff_t));
-    size_t ci = 0;
-
-    oi = 0; ni = 0;
-    while (oi < old_fp->cell_count || ni < new_fp->cell_count) {
-        const ag_cell_fp_t* o = oi < old_fp->cell_count ? &old_fp->cells[oi] : NULL;
-        const ag_cell_fp_t* n = ni < new_fp->cell_count ? &new_fp->cells[ni] : NULL;
-
-        if (o && n && o->cell_id == n->cell_id) {
-            if (ag_cell_fp_compare(o, n) != 0) {
-                r->cells[ci].change = DIFF_MODIFIED;
-                r->cells[ci].id     = o->cell_id;
-                r->cells[ci].flags  = ag_cell_fp_diff(o, n);
-                r->cells[ci].old_fp = *o;
-                r->cells[ci].new_fp = *n;
-                ci++;
-                r->cells_modified++;
+
+    int* orefs = w->old_side.refs.items;
+    int* nrefs = w->new_side.refs.items;
+    size_t no = unique_refs(orefs, w->old_side.refs.count);
+    size_t nn = unique_refs(nrefs, w->new_side.refs.count);
+    d->region_removed = refs_minus(orefs, no, nrefs, nn, &d->region_removed_count);
+    d->region_added   = refs_minus(nrefs, nn, orefs, no, &d->region_added_count);
+    if (d->region_removed && d->region_added)
+        d->region_places = places;
+}
+
+static void region_walk_free(region_walk_t* w) {
+    free(w->old_side.visited);
+    free(w->old_side.refs.items);
+    free(w->new_side.visited);
+    free(w->new_side.refs.items);
+    free(w->pairs.items);
+    free(w->stack.items);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Lattice localization                                              */
+/* ------------------------------------------------------------------ */
+
+/* Compare two lattices of the same shape block by block, and list the
+   positions of differing entries in the blocks whose hashes differ.
+   (i, j, k) follow the fill order, i fastest; if the ranges do not
+   match the entry count, i is the flat index. Returns -1 if out of
+   memory. */
+static int localize_lattice(const ag_fingerprint_set_t* ofp, uint32_t old_lattice,
+                            const ag_fingerprint_set_t* nfp, uint32_t new_lattice,
+                            ag_cell_change_detail_t* d) {
+    if (old_lattice == AG_LATTICE_NONE || new_lattice == AG_LATTICE_NONE)
+        return 0;
+    const ag_lattice_fp_t* lo = &ofp->lattices[old_lattice];
+    const ag_lattice_fp_t* ln = &nfp->lattices[new_lattice];
+    if (lo->fill_count != ln->fill_count || memcmp(lo->dims, ln->dims, sizeof(lo->dims)) != 0)
+        return 0;
+
+    const int* fo = ofp->lattice_fill + lo->first_fill;
+    const int* fn = nfp->lattice_fill + ln->first_fill;
+    int64_t nx = (int64_t)lo->dims[1] - lo->dims[0] + 1;
+    int64_t ny = (int64_t)lo->dims[3] - lo->dims[2] + 1;
+    int64_t nz = (int64_t)lo->dims[5] - lo->dims[4] + 1;
+    bool shaped = nx > 0 && ny > 0 && nz > 0 && nx * ny * nz == (int64_t)lo->fill_count;
+
+    vec_t out = { NULL, 0, 0 };
+    size_t nblocks = (lo->fill_count + AG_LATTICE_BLOCK - 1) / AG_LATTICE_BLOCK;
+    for (size_t b = 0; b < nblocks; b++) {
+        if (ofp->lattice_block_hash[lo->first_block + b] ==
+            nfp->lattice_block_hash[ln->first_block + b]) continue;
+
+        size_t end = (b + 1) * AG_LATTICE_BLOCK;
+        if (end > lo->fill_count) end = lo->fill_count;
+        for (size_t x = b * AG_LATTICE_BLOCK; x < end; x++) {
+            if (fo[x] == fn[x]) continue;
+            ag_lattice_change_t* c = vec_push(&out, sizeof(*c));
+            if (!c) {
+                free(out.items);
+                return -1;
             }
+            if (shaped) {
+                c->i = lo->dims[0] + (int)((int64_t)x % nx);
+                c->j = lo->dims[2] + (int)((int64_t)x / nx % ny);
+                c->k = lo->dims[4] + (int)((int64_t)x / (nx * ny));
+            } else {
+                c->i = (int)x;
+                c->j = c->k = 0;
+            }
+            c->old_universe = fo[x];
+            c->new_universe = fn[x];
+        }
+    }
+    d->lattice_changes = out.items;
+    d->lattice_change_count = out.count;
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Renumbering                                                       */
+/* ------------------------------------------------------------------ */
+
+/* Rows to merge on one side: ascending, or every row when idx is NULL */
+typedef struct {
+    uint32_t* idx;
+    size_t    count;
+} row_list_t;
+
+static uint32_t list_row(const row_list_t* l, size_t i) {
+    return l->idx ? l->idx[i] : (uint32_t)i;
+}
+
+/* Removed and added rows with identical content, paired. Both row
+   arrays ascend, so the merge walks them with forward cursors. */
+typedef struct {
+    uint32_t* old_rows;   /* paired removed rows */
+    size_t    old_count, old_at;
+    uint32_t* new_rows;   /* paired added rows... */
+    uint32_t* from;       /* ...and the removed row each one pairs with */
+    size_t    new_count, new_at;
+} renumber_t;
+
+/* Merge of one element kind: surfaces over every row, cells over the
+   rows of the changed universes */
+typedef struct {
+    ag_diff_kind_t kind;
+    row_list_t     ol, nl;
+    size_t         oi, ni;
+    renumber_t     renum;
+} merge_t;
+
+/* Content keys: every compared field but the ID, density by its bits */
+static uint64_t cell_content_key(const ag_cell_fp_t* c) {
+    uint64_t density;
+    memcpy(&density, &c->density, sizeof(density));
+    uint64_t h = ag_hash_init();
+    h = ag_hash_u64(h, (uint64_t)(int64_t)c->material_id);
+    h = ag_hash_u64(h, (uint64_t)(int64_t)c->universe_id);
+    h = ag_hash_u64(h, (uint64_t)(int64_t)c->fill_universe);
+    h = ag_hash_u64(h, (uint64_t)(int64_t)c->lat_type);
+    h = ag_hash_u64(h, density);
+    h = ag_hash_u64(h, c->tree_hash);
+    return ag_hash_u64(h, c->lattice_hash);
+}
+
+static uint64_t surface_content_key(const ag_surface_fp_t* s) {
+    uint64_t h = ag_hash_init();
+    h = ag_hash_u64(h, (uint64_t)(int64_t)s->primitive_type);
+    h = ag_hash_u64(h, (uint64_t)(int64_t)s->boundary_type);
+    return ag_hash_u64(h, s->data_hash);
+}
+
+static uint64_t row_key(const ag_fingerprint_set_t* fp, uint32_t i, ag_diff_kind_t kind) {
+    if (kind == AG_DIFF_CELL) {
+        ag_cell_fp_t c;
+        ag_cell_fp_at(fp, i, &c);
+        return cell_content_key(&c);
+    }
+    ag_surface_fp_t s;
+    ag_surface_fp_at(fp, i, &s);
+    return surface_content_key(&s);
+}
+
+static bool same_content(const ag_fingerprint_set_t* old_fp, uint32_t oi,
+                         const ag_fingerprint_set_t* new_fp, uint32_t ni,
+                         ag_diff_kind_t kind) {
+    if (kind == AG_DIFF_CELL) {
+        ag_cell_fp_t o, n;
+        ag_cell_fp_at(old_fp, oi, &o);
+        ag_cell_fp_at(new_fp, ni, &n);
+        return ag_cell_fp_compare(&o, &n) == 0;
+    }
+    ag_surface_fp_t o, n;
+    ag_surface_fp_at(old_fp, oi, &o);
+    ag_surface_fp_at(new_fp, ni, &n);
+    return ag_surface_fp_compare(&o, &n) == 0;
+}
+
+static const int* row_ids(const ag_fingerprint_set_t* fp, ag_diff_kind_t kind) {
+    return kind == AG_DIFF_CELL ? fp->cell_id : fp->surface_id;
+}
+
+/* Removed entries by content key: open addressing over the keys, each
+   slot heading a list of entries in ID order */
+typedef struct {
+    uint64_t* keys;
+    size_t*   head;     /* SIZE_MAX for an empty slot */
+    size_t*   tail;
+    size_t*   next;     /* per removed entry */
+    size_t    mask;
+} key_table_t;
+
+static int key_table_init(key_table_t* t, size_t entries, size_t items) {
+    size_t cap = 16;
+    while (cap < 2 * entries) cap *= 2;
+    t->mask = cap - 1;
+    t->keys = malloc(cap * sizeof(uint64_t));
+    t->head = malloc(cap * sizeof(size_t));
+    t->tail = malloc(cap * sizeof(size_t));
+    t->next = malloc((items ? items : 1) * sizeof(size_t));
+    if (!t->keys || !t->head || !t->tail || !t->next) return -1;
+    memset(t->head, 0xff, cap * sizeof(size_t));
+    return 0;
+}
+
+static void key_table_free(key_table_t* t) {
+    free(t->keys);
+    free(t->head);
+    free(t->tail);
+    free(t->next);
+}
+
+static size_t key_slot(const key_table_t* t, uint64_t key) {
+    size_t i = (size_t)key & t->mask;
+    while (t->head[i] != SIZE_MAX && t->keys[i] != key)
+        i = (i + 1) & t->mask;
+    return i;
+}
+
+static void key_table_add(key_table_t* t, uint64_t key, size_t item) {
+    size_t i = key_slot(t, key);
+    t->next[item] = SIZE_MAX;
+    if (t->head[i] == SIZE_MAX) {
+        t->keys[i] = key;
+        t->head[i] = item;
+    } else {
+        t->next[t->tail[i]] = item;
+    }
+    t->tail[i] = item;
+}
+
+/* Rows present on one side only, by a merge over the IDs alone that
+   pairs rows exactly as the full merge does */
+static int one_sided_rows(const merge_t* m, const int* old_ids, const int* new_ids,
+                          vec_t* removed, vec_t* added) {
+    size_t oi = 0, ni = 0;
+    while (oi < m->ol.count || ni < m->nl.count) {
+        bool has_o = oi < m->ol.count;
+        bool has_n = ni < m->nl.count;
+        uint32_t o_at = has_o ? list_row(&m->ol, oi) : 0;
+        uint32_t n_at = has_n ? list_row(&m->nl, ni) : 0;
+        if (has_o && has_n && old_ids[o_at] == new_ids[n_at]) {
             oi++; ni++;
-        } else if (!n || (o && o->cell_id < n->cell_id)) {
-            r->cells[ci].change = DIFF_REMOVED;
-            r->cells[ci].id     = o->cell_id;
-            r->cells[ci].old_fp = *o;
-            ci++;
-            r->cells_removed++;
-            oi++;
+            continue;
+        }
+        bool old_side = !has_n || (has_o && old_ids[o_at] < new_ids[n_at]);
+        uint32_t* row = vec_push(old_side ? removed : added, sizeof(uint32_t));
+        if (!row) return -1;
+        *row = old_side ? o_at : n_at;
+        if (old_side) oi++; else ni++;
+    }
+    return 0;
+}
+
+/* Pair rows removed and added by the merge whose content is identical,
+   in ID order among equal contents, so the merge can report each pair
+   as one DIFF_RENUMBERED entry at the added row's place. Returns -1 if
+   out of memory. */
+static int find_renumbered(merge_t* m, const ag_fingerprint_set_t* old_fp,
+                           const ag_fingerprint_set_t* new_fp) {
+    renumber_t* p = &m->renum;
+    vec_t removed = { NULL, 0, 0 }, added = { NULL, 0, 0 };
+    key_table_t t = { 0 };
+    bool* used = NULL;
+    int rc = -1;
+
+    if (one_sided_rows(m, row_ids(old_fp, m->kind), row_ids(new_fp, m->kind),
+                       &removed, &added) < 0) goto done;
+    if (removed.count == 0 || added.count == 0) {
+        rc = 0;
+        goto done;
+    }
+
+    const uint32_t* rm = removed.items;
+    const uint32_t* ad = added.items;
+    size_t pairs = removed.count < added.count ? removed.count : added.count;
+    used = calloc(removed.count, sizeof(bool));
+    p->old_rows = malloc(pairs * sizeof(uint32_t));
+    p->new_rows = malloc(pairs * sizeof(uint32_t));
+    p->from     = malloc(pairs * sizeof(uint32_t));
+    if (!used || !p->old_rows || !p->new_rows || !p->from ||
+        key_table_init(&t, removed.count, removed.count) < 0) goto done;
+
+    for (size_t j = 0; j < removed.count; j++)
+        key_table_add(&t, row_key(old_fp, rm[j], m->kind), j);
+
+    for (size_t a = 0; a < added.count; a++) {
+        size_t s = key_slot(&t, row_key(new_fp, ad[a], m->kind));
+        size_t j = t.head[s];
+        while (j != SIZE_MAX && (used[j] || !same_content(old_fp, rm[j], new_fp, ad[a], m->kind)))
+            j = t.next[j];
+        if (j == SIZE_MAX) continue;
+        while (t.head[s] != SIZE_MAX && used[t.head[s]]) t.head[s] = t.next[t.head[s]];
+
+        used[j] = true;
+        p->new_rows[p->new_count] = ad[a];
+        p->from[p->new_count++] = rm[j];
+    }
+    for (size_t j = 0; j < removed.count; j++)
+        if (used[j]) p->old_rows[p->old_count++] = rm[j];
+    rc = 0;
+
+done:
+    free(removed.items);
+    free(added.items);
+    free(used);
+    key_table_free(&t);
+    return rc;
+}
+
+size_t ag_diff_cell_run(const ag_diff_result_t* r, size_t i) {
+    if (i >= r->cell_count || r->cells[i].change != DIFF_RENUMBERED) return 0;
+    size_t n = 1;
+    while (i + n < r->cell_count) {
+        const ag_cell_diff_t* a = &r->cells[i + n - 1];
+        const ag_cell_diff_t* b = &r->cells[i + n];
+        if (b->change != DIFF_RENUMBERED || b->id != a->id + 1 || b->old_id != a->old_id + 1)
+            break;
+        n++;
+    }
+    return n;
+}
+
+size_t ag_diff_surface_run(const ag_diff_result_t* r, size_t i) {
+    if (i >= r->surface_count || r->surfaces[i].change != DIFF_RENUMBERED) return 0;
+    size_t n = 1;
+    while (i + n < r->surface_count) {
+        const ag_surface_diff_t* a = &r->surfaces[i + n - 1];
+        const ag_surface_diff_t* b = &r->surfaces[i + n];
+        if (b->change != DIFF_RENUMBERED || b->id != a->id + 1 || b->old_id != a->old_id + 1)
+            break;
+        n++;
+    }
+    return n;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Element merge                                                     */
+/* ------------------------------------------------------------------ */
+
+/* Fields shared by surface and cell entries */
+typedef struct {
+    diff_change_t change;
+    int           id, old_id;
+    uint32_t      flags;
+    uint32_t      old_row, new_row;
+} step_t;
+
+/* Advance a two-pointer merge over the ID-sorted rows to its next
+   entry. Runs of bit-identical rows are skipped column-wise, in bulk
+   only when both sides list every row; only rows that differ are
+   materialized for the field-by-field comparison. Removed rows paired
+   by find_renumbered() are dropped and their added rows reported as
+   renumbered. Returns 0 when the merge is done. */
+static int merge_step(merge_t* m, const ag_fingerprint_set_t* old_fp,
+                      const ag_fingerprint_set_t* new_fp, step_t* e) {
+    bool cells = m->kind == AG_DIFF_CELL;
+    bool whole = !m->ol.idx && !m->nl.idx;
+    const int* old_ids = row_ids(old_fp, m->kind);
+    const int* new_ids = row_ids(new_fp, m->kind);
+    renumber_t* p = &m->renum;
+
+    while (m->oi < m->ol.count || m->ni < m->nl.count) {
+        bool has_o = m->oi < m->ol.count;
+        bool has_n = m->ni < m->nl.count;
+        uint32_t o_at = has_o ? list_row(&m->ol, m->oi) : 0;
+        uint32_t n_at = has_n ? list_row(&m->nl, m->ni) : 0;
+        int o_id = has_o ? old_ids[o_at] : 0;
+        int n_id = has_n ? new_ids[n_at] : 0;
+
+        if (has_o && has_n && o_id == n_id) {
+            size_t run = cells ? ag_cell_fp_equal_run(old_fp, o_at, new_fp, n_at)
+                               : ag_surface_fp_equal_run(old_fp, o_at, new_fp, n_at);
+            if (run > 0) {
+                if (!whole) run = 1;
+                m->oi += run; m->ni += run;
+                continue;
+            }
+            m->oi++; m->ni++;
+
+            uint32_t flags;
+            if (cells) {
+                ag_cell_fp_t o, n;
+                ag_cell_fp_at(old_fp, o_at, &o);
+                ag_cell_fp_at(new_fp, n_at, &n);
+                if (ag_cell_fp_compare(&o, &n) == 0) continue;
+                flags = ag_cell_fp_diff(&o, &n);
+            } else {
+                ag_surface_fp_t o, n;
+                ag_surface_fp_at(old_fp, o_at, &o);
+                ag_surface_fp_at(new_fp, n_at, &n);
+                if (ag_surface_fp_compare(&o, &n) == 0) continue;
+                flags = ag_surface_fp_diff(&o, &n);
+            }
+            *e = (step_t){ DIFF_MODIFIED, o_id, 0, flags, o_at, n_at };
+            return 1;
+        }
+
+        if (!has_n || (has_o && o_id < n_id)) {
+            m->oi++;
+            while (p->old_at < p->old_count && p->old_rows[p->old_at] < o_at) p->old_at++;
+            if (p->old_at < p->old_count && p->old_rows[p->old_at] == o_at) continue;
+            *e = (step_t){ DIFF_REMOVED, o_id, 0, 0, o_at, AG_DIFF_NO_ROW };
+            return 1;
+        }
+
+        m->ni++;
+        while (p->new_at < p->new_count && p->new_rows[p->new_at] < n_at) p->new_at++;
+        if (p->new_at < p->new_count && p->new_rows[p->new_at] == n_at) {
+            uint32_t from = p->from[p->new_at];
+            *e = (step_t){ DIFF_RENUMBERED, n_id, old_ids[from], 0, from, n_at };
+            return 1;
+        }
+        *e = (step_t){ DIFF_ADDED, n_id, 0, 0, AG_DIFF_NO_ROW, n_at };
+        return 1;
+    }
+    return 0;
+}
+
+static void merge_free(merge_t* m) {
+    free(m->ol.idx);
+    free(m->nl.idx);
+    free(m->renum.old_rows);
+    free(m->renum.new_rows);
+    free(m->renum.from);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Universe pruning                                                  */
+/* ------------------------------------------------------------------ */
+
+struct ag_diff_iter {
+    const ag_fingerprint_set_t* old_fp;
+    const ag_fingerprint_set_t* new_fp;
+    merge_t       surfaces, cells;
+    int*          changed_universes;
+    size_t        changed_universe_count;
+    region_walk_t walk;
+    ag_cell_change_detail_t* detail;   /* of the last entry returned */
+};
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void list_universe(row_list_t* l, const ag_fingerprint_set_t* fp,
+                          const ag_universe_fp_t* u) {
+    memcpy(l->idx + l->count, fp->universe_cells + u->first, u->count * sizeof(uint32_t));
+    l->count += u->count;
+}
+
+/* List the cells of every universe whose own cells differ between the
+   sets, or that exists on one side only, and record those universes.
+   A side whose every universe is listed falls back to the whole-set
+   merge. Returns -1 if out of memory. */
+static int changed_universe_cells(ag_diff_iter_t* it) {
+    const ag_fingerprint_set_t* old_fp = it->old_fp;
+    const ag_fingerprint_set_t* new_fp = it->new_fp;
+    row_list_t* ol = &it->cells.ol;
+    row_list_t* nl = &it->cells.nl;
+    size_t nuo = old_fp->universe_count, nun = new_fp->universe_count;
+    ol->idx = malloc((old_fp->cell_count ? old_fp->cell_count : 1) * sizeof(uint32_t));
+    nl->idx = malloc((new_fp->cell_count ? new_fp->cell_count : 1) * sizeof(uint32_t));
+    it->changed_universes = malloc((nuo + nun ? nuo + nun : 1) * sizeof(int));
+    if (!ol->idx || !nl->idx || !it->changed_universes) return -1;
+
+    size_t i = 0, j = 0;
+    while (i < nuo || j < nun) {
+        const ag_universe_fp_t* uo = i < nuo ? &old_fp->universes[i] : NULL;
+        const ag_universe_fp_t* un = j < nun ? &new_fp->universes[j] : NULL;
+        if (uo && un && uo->universe_id == un->universe_id) {
+            if (uo->cell_hash != un->cell_hash) {
+                list_universe(ol, old_fp, uo);
+                list_universe(nl, new_fp, un);
+                it->changed_universes[it->changed_universe_count++] = uo->universe_id;
+            }
+            i++; j++;
+        } else if (!un || (uo && uo->universe_id < un->universe_id)) {
+            list_universe(ol, old_fp, uo);
+            it->changed_universes[it->changed_universe_count++] = uo->universe_id;
+            i++;
         } else {
-            r->cells[ci].change = DIFF_ADDED;
-            r->cells[ci].id     = n->cell_id;
-            r->cells[ci].new_fp = *n;
-            ci++;
-            r->cells_added++;
-            ni++;
+            list_universe(nl, new_fp, un);
+            it->changed_universes[it->changed_universe_count++] = un->universe_id;
+            j++;
         }
     }
-    r->cell_count = ci;
 
+    if (ol->count == old_fp->cell_count && nl->count == new_fp->cell_count) {
+        free(ol->idx);
+        free(nl->idx);
+        ol->idx = nl->idx = NULL;
+        return 0;
+    }
+    qsort(ol->idx, ol->count, sizeof(uint32_t), compare_u32);
+    qsort(nl->idx, nl->count, sizeof(uint32_t), compare_u32);
+    return 0;
+}
+
+/* Top-level cells (universe 0) on both sides whose own fill and lattice
+   are unchanged but whose fill hash differs: something nested below
+   them changed. */
+static int find_affected_cells(ag_diff_result_t* r, const ag_fingerprint_set_t* old_fp,
+                               const ag_fingerprint_set_t* new_fp) {
+    size_t uo = ag_fp_find_universe(old_fp, 0);
+    size_t un = ag_fp_find_universe(new_fp, 0);
+    if (uo == SIZE_MAX || un == SIZE_MAX) return 0;
+    const ag_universe_fp_t* go = &old_fp->universes[uo];
+    const ag_universe_fp_t* gn = &new_fp->universes[un];
+    if (go->hash == gn->hash) return 0;
+
+    r->affected_cells = malloc((go->count ? go->count : 1) * sizeof(int));
+    if (!r->affected_cells) return -1;
+
+    uint32_t i = 0, j = 0;
+    while (i < go->count && j < gn->count) {
+        uint32_t a = old_fp->universe_cells[go->first + i];
+        uint32_t b = new_fp->universe_cells[gn->first + j];
+        if (old_fp->cell_id[a] < new_fp->cell_id[b]) { i++; continue; }
+        if (old_fp->cell_id[a] > new_fp->cell_id[b]) { j++; continue; }
+        if (old_fp->cell_fill_hash[a] != new_fp->cell_fill_hash[b] &&
+            old_fp->cell_fill[a] == new_fp->cell_fill[b] &&
+            old_fp->cell_lattice_hash[a] == new_fp->cell_lattice_hash[b])
+            r->affected_cells[r->affected_cell_count++] = old_fp->cell_id[a];
+        i++; j++;
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Iteration                                                         */
+/* ------------------------------------------------------------------ */
+
+static void detail_free(ag_cell_change_detail_t* d) {
+    if (!d) return;
+    free(d->region_removed);
+    free(d->region_added);
+    free(d->lattice_changes);
+    free(d);
+}
+
+/* Without the renumbering pre-pass, renumbered elements come out as a
+   removal and an addition */
+static ag_diff_iter_t* iter_new(const ag_fingerprint_set_t* old_fp,
+                                const ag_fingerprint_set_t* new_fp, bool renumber) {
+    ag_diff_iter_t* it = calloc(1, sizeof(*it));
+    if (!it) return NULL;
+    it->old_fp = old_fp;
+    it->new_fp = new_fp;
+    it->surfaces.kind = AG_DIFF_SURFACE;
+    it->cells.kind = AG_DIFF_CELL;
+    it->walk.old_side.fp = old_fp;
+    it->walk.new_side.fp = new_fp;
+
+    /* Identical geometry */
+    if (old_fp->root_hash == new_fp->root_hash) return it;
+
+    if (old_fp->surface_hash != new_fp->surface_hash) {
+        it->surfaces.ol.count = old_fp->surface_count;
+        it->surfaces.nl.count = new_fp->surface_count;
+        if (renumber && find_renumbered(&it->surfaces, old_fp, new_fp) < 0) goto oom;
+    }
+
+    /* Cells, over the universes whose own cells changed */
+    if (changed_universe_cells(it) < 0 ||
+        (renumber && find_renumbered(&it->cells, old_fp, new_fp) < 0)) goto oom;
+    return it;
+
+oom:
+    ag_diff_iter_free(it);
+    return NULL;
+}
+
+ag_diff_iter_t* ag_diff_iter_new(const ag_fingerprint_set_t* old_fp,
+                                 const ag_fingerprint_set_t* new_fp) {
+    return iter_new(old_fp, new_fp, true);
+}
+
+int ag_diff_any(const ag_fingerprint_set_t* old_fp, const ag_fingerprint_set_t* new_fp) {
+    if (old_fp->root_hash == new_fp->root_hash) return 0;
+    ag_diff_iter_t* it = iter_new(old_fp, new_fp, false);
+    if (!it) return -1;
+    step_t e;
+    int found = merge_step(&it->surfaces, old_fp, new_fp, &e) ||
+                merge_step(&it->cells, old_fp, new_fp, &e);
+    ag_diff_iter_free(it);
+    return found;
+}
+
+int ag_diff_next(ag_diff_iter_t* it, ag_diff_entry_t* out) {
+    const ag_fingerprint_set_t* old_fp = it->old_fp;
+    const ag_fingerprint_set_t* new_fp = it->new_fp;
+    detail_free(it->detail);
+    it->detail = NULL;
+
+    step_t e;
+    if (merge_step(&it->surfaces, old_fp, new_fp, &e)) {
+        out->kind = AG_DIFF_SURFACE;
+        out->surface = (ag_surface_diff_t){ e.change, e.id, e.old_id, e.flags,
+                                            e.old_row, e.new_row };
+        return 1;
+    }
+    if (!merge_step(&it->cells, old_fp, new_fp, &e)) return 0;
+
+    out->kind = AG_DIFF_CELL;
+    out->cell = (ag_cell_diff_t){ e.change, e.id, e.old_id, e.flags,
+                                  e.old_row, e.new_row, NULL };
+    if (e.change != DIFF_MODIFIED || !(e.flags & (CELL_CHG_REGION | CELL_CHG_LATTICE)))
+        return 1;
+
+    /* Localize region and lattice changes */
+    ag_cell_change_detail_t* d = calloc(1, sizeof(*d));
+    if (!d) return -1;
+    it->detail = out->cell.detail = d;
+    if (e.flags & CELL_CHG_REGION)
+        localize_region(&it->walk, old_fp->cell_region_root[e.old_row],
+                        new_fp->cell_region_root[e.new_row], d);
+    if ((e.flags & CELL_CHG_LATTICE) &&
+        localize_lattice(old_fp, old_fp->cell_lattice[e.old_row],
+                         new_fp, new_fp->cell_lattice[e.new_row], d) < 0)
+        return -1;
+    return 1;
+}
+
+void ag_diff_iter_free(ag_diff_iter_t* it) {
+    if (!it) return;
+    merge_free(&it->surfaces);
+    merge_free(&it->cells);
+    free(it->changed_universes);
+    region_walk_free(&it->walk);
+    detail_free(it->detail);
+    free(it);
+}
+
+void ag_diff_cell_rows(const ag_fingerprint_set_t* old_fp, const ag_fingerprint_set_t* new_fp,
+                       const ag_cell_diff_t* d, ag_cell_fp_t* o, ag_cell_fp_t* n) {
+    if (d->old_row != AG_DIFF_NO_ROW) ag_cell_fp_at(old_fp, d->old_row, o);
+    else memset(o, 0, sizeof(*o));
+    if (d->new_row != AG_DIFF_NO_ROW) ag_cell_fp_at(new_fp, d->new_row, n);
+    else memset(n, 0, sizeof(*n));
+}
+
+void ag_diff_surface_rows(const ag_fingerprint_set_t* old_fp, const ag_fingerprint_set_t* new_fp,
+                          const ag_surface_diff_t* d, ag_surface_fp_t* o, ag_surface_fp_t* n) {
+    if (d->old_row != AG_DIFF_NO_ROW) ag_surface_fp_at(old_fp, d->old_row, o);
+    else memset(o, 0, sizeof(*o));
+    if (d->new_row != AG_DIFF_NO_ROW) ag_surface_fp_at(new_fp, d->new_row, n);
+    else memset(n, 0, sizeof(*n));
+}
+
+/* Add an entry to the summary counts of r */
+static void count_entry(ag_diff_result_t* r, const ag_diff_entry_t* e) {
+    bool cell = e->kind == AG_DIFF_CELL;
+    switch (cell ? e->cell.change : e->surface.change) {
+        case DIFF_ADDED:      cell ? r->cells_added++      : r->surfs_added++;      break;
+        case DIFF_REMOVED:    cell ? r->cells_removed++    : r->surfs_removed++;    break;
+        case DIFF_MODIFIED:   cell ? r->cells_modified++   : r->surfs_modified++;   break;
+        case DIFF_RENUMBERED: cell ? r->cells_renumbered++ : r->surfs_renumbered++; break;
+        default: break;
+    }
+}
+
+ag_diff_result_t* ag_diff(const ag_fingerprint_set_t* old_fp,
+                          const ag_fingerprint_set_t* new_fp) {
+    ag_diff_result_t* r = calloc(1, sizeof(*r));
+    ag_diff_iter_t* it = r ? ag_diff_iter_new(old_fp, new_fp) : NULL;
+    if (!it) {
+        free(r);
+        return NULL;
+    }
+    r->old_set = old_fp;
+    r->new_set = new_fp;
+
+    /* Entry arrays grow with the changes found */
+    vec_t cells = { NULL, 0, 0 }, surfaces = { NULL, 0, 0 };
+    ag_diff_entry_t e;
+    int rc;
+    while ((rc = ag_diff_next(it, &e)) > 0) {
+        count_entry(r, &e);
+        if (e.kind == AG_DIFF_SURFACE) {
+            ag_surface_diff_t* d = vec_push(&surfaces, sizeof(*d));
+            if (!d) { rc = -1; break; }
+            *d = e.surface;
+        } else {
+            ag_cell_diff_t* d = vec_push(&cells, sizeof(*d));
+            if (!d) { rc = -1; break; }
+            *d = e.cell;
+            it->detail = NULL;   /* now owned by the result */
+        }
+    }
+    r->cells = cells.items;
+    r->cell_count = cells.count;
+    r->surfaces = surfaces.items;
+    r->surface_count = surfaces.count;
+    r->changed_universes = it->changed_universes;
+    r->changed_universe_count = it->changed_universe_count;
+    it->changed_universes = NULL;
+    ag_diff_iter_free(it);
+
+    if (rc < 0 || find_affected_cells(r, old_fp, new_fp) < 0) {
+        ag_diff_result_free(r);
+        return NULL;
+    }
     return r;
 }
 
 void ag_diff_result_free(ag_diff_result_t* result) {
     if (!result) return;
+    for (size_t i = 0; i < result->cell_count; i++)
+        detail_free(result->cells[i].detail);
     free(result->cells);
     free(result->surfaces);
+    free(result->changed_universes);
+    free(result->affected_cells);
     free(result);
 }
 
+/* Append up to AG_REGION_SHOW_REFS references to buf at *pos */
+#define AG_REGION_SHOW_REFS 8
+
+static void append_refs(char* buf, size_t size, size_t* pos,
+                        const int* refs, size_t n) {
+    for (size_t i = 0; i < n && *pos < size; i++) {
+        int w = i < AG_REGION_SHOW_REFS
+              ? snprintf(buf + *pos, size - *pos, "%s%d", i ? " " : "", refs[i])
+              : snprintf(buf + *pos, size - *pos, " ...");
+        if (w < 0) return;
+        *pos += (size_t)w;
+        if (i >= AG_REGION_SHOW_REFS) break;
+    }
+}
+
+const char* ag_region_change_str(const ag_cell_diff_t* d, char* buf, size_t size) {
+    if (size == 0) return buf;
+    buf[0] = '\0';
+    const ag_cell_change_detail_t* x = d->detail;
+    if (!(d->flags & CELL_CHG_REGION) || !x || x->region_places == 0) return buf;
+
+    size_t pos = 0;
+    int w = snprintf(buf, size, " (");
+    pos = w > 0 ? (size_t)w : 0;
+    if (x->region_removed_count > 0 && x->region_added_count > 0) {
+        append_refs(buf, size, &pos, x->region_removed, x->region_removed_count);
+        if (pos < size) pos += (size_t)snprintf(buf + pos, size - pos, " -> ");
+        append_refs(buf, size, &pos, x->region_added, x->region_added_count);
+    } else if (x->region_removed_count > 0) {
+        if (pos < size) pos += (size_t)snprintf(buf + pos, size - pos, "dropped ");
+        append_refs(buf, size, &pos, x->region_removed, x->region_removed_count);
+    } else if (x->region_added_count > 0) {
+        if (pos < size) pos += (size_t)snprintf(buf + pos, size - pos, "added ");
+        append_refs(buf, size, &pos, x->region_added, x->region_added_count);
+    } else if (pos < size) {
+        pos += (size_t)snprintf(buf + pos, size - pos, "operators only");
+    }
+    if (x->region_places > 1 && pos < size)
+        pos += (size_t)snprintf(buf + pos, size - pos, ", %zu places", x->region_places);
+    if (pos < size)
+        snprintf(buf + pos, size - pos, ")");
+    return buf;
+}
+
+/* Positions shown by ag_lattice_change_str() */
+#define AG_LATTICE_SHOW 4
+
+const char* ag_lattice_change_str(const ag_cell_diff_t* d, char* buf, size_t size) {
+    if (size == 0) return buf;
+    buf[0] = '\0';
+    const ag_cell_change_detail_t* x = d->detail;
+    size_t n = x ? x->lattice_change_count : 0;
+    if (n == 0) return buf;
+
+    size_t pos = 0;
+    for (size_t i = 0; i < n && i < AG_LATTICE_SHOW && pos < size; i++) {
+        const ag_lattice_change_t* c = &x->lattice_changes[i];
+        int w = snprintf(buf + pos, size - pos, "%s[%d,%d,%d] %d -> %d",
+                         i ? ", " : " (", c->i, c->j, c->k,
+                         c->old_universe, c->new_universe);
+        if (w < 0) return buf;
+        pos += (size_t)w;
+    }
+    if (n > 1 && pos < size)
+        pos += (size_t)snprintf(buf + pos, size - pos, "%s, %zu positions",
+                                n > AG_LATTICE_SHOW ? ", ..." : "", n);
+    if (pos < size)
+        snprintf(buf + pos, size - pos, ")");
+    return buf;
+}
+
 static const char* prim_type_name(int ptype) {
     /* CSG_PRIMITIVE_PLANE = 1 (enum starts at 1) */
     switch (ptype) {
@@ -130,113 +962,195 @@ static const char* prim_type_name(int ptype) {
     }
 }
 
-void ag_diff_print(const ag_diff_result_t* result,
-                   const char* old_label, const char* new_label) {
-    if (!result) return;
+#define AG_SHOW_IDS 16
 
-    bool has_changes = result->surface_count > 0 || result->cell_count > 0;
-    if (!has_changes) {
-        printf("No structural changes.\n");
-        return;
+static void print_ids(const int* ids, size_t n) {
+    for (size_t i = 0; i < n && i < AG_SHOW_IDS; i++)
+        printf(" %d", ids[i]);
+    if (n > AG_SHOW_IDS) printf(" ... (%zu)", n);
+    printf("\n");
+}
+
+static void print_surface(const ag_fingerprint_set_t* old_fp, const ag_fingerprint_set_t* new_fp,
+                          const ag_surface_diff_t* d) {
+    ag_surface_fp_t o, n;
+    ag_diff_surface_rows(old_fp, new_fp, d, &o, &n);
+    switch (d->change) {
+        case DIFF_ADDED:
+            ag_color_printf(COL_GREEN, "  + surface %d: %s\n",
+                            d->id, prim_type_name(n.primitive_type));
+            break;
+        case DIFF_REMOVED:
+            ag_color_printf(COL_RED, "  - surface %d: %s\n",
+                            d->id, prim_type_name(o.primitive_type));
+            break;
+        case DIFF_MODIFIED:
+            printf("  ");
+            ag_color_printf(COL_YELLOW, "~ surface %d:", d->id);
+            if (d->flags & SURF_CHG_TYPE)
+                printf(" type %s -> %s",
+                       prim_type_name(o.primitive_type),
+                       prim_type_name(n.primitive_type));
+            if (d->flags & SURF_CHG_DATA)
+                printf(" geometry changed");
+            if (d->flags & SURF_CHG_BOUNDARY)
+                printf(" boundary changed");
+            printf("\n");
+            break;
+        default: break;
     }
+}
 
-    ag_color_printf(COL_BOLD, "--- %s\n", old_label ? old_label : "a");
-    ag_color_printf(COL_BOLD, "+++ %s\n", new_label ? new_label : "b");
-    printf("\n");
+static void print_cell(const ag_fingerprint_set_t* old_fp, const ag_fingerprint_set_t* new_fp,
+                       const ag_cell_diff_t* d) {
+    ag_cell_fp_t o, n;
+    ag_diff_cell_rows(old_fp, new_fp, d, &o, &n);
+    switch (d->change) {
+        case DIFF_ADDED:
+            ag_color_printf(COL_GREEN,
+                "  + cell %d: mat %d, density %.4g, universe %d\n",
+                d->id, n.material_id, n.density, n.universe_id);
+            break;
+        case DIFF_REMOVED:
+            ag_color_printf(COL_RED,
+                "  - cell %d: mat %d, density %.4g, universe %d\n",
+                d->id, o.material_id, o.density, o.universe_id);
+            break;
+        case DIFF_MODIFIED: {
+            char region[128], lattice[160];
+            printf("  ");
+            ag_color_printf(COL_YELLOW, "~ cell %d:", d->id);
+            if (d->flags & CELL_CHG_MATERIAL)
+                printf(" material %d -> %d", o.material_id, n.material_id);
+            if (d->flags & CELL_CHG_DENSITY)
+                printf(" density %.4g -> %.4g", o.density, n.density);
+            if (d->flags & CELL_CHG_REGION)
+                printf(" region changed%s",
+                       ag_region_change_str(d, region, sizeof(region)));
+            if (d->flags & CELL_CHG_UNIVERSE)
+                printf(" universe %d -> %d", o.universe_id, n.universe_id);
+            if (d->flags & CELL_CHG_FILL)
+                printf(" fill %d -> %d", o.fill_universe, n.fill_universe);
+            if (d->flags & CELL_CHG_LATTICE)
+                printf(" lattice changed%s",
+                       ag_lattice_change_str(d, lattice, sizeof(lattice)));
+            printf("\n");
+            break;
+        }
+        default: break;
+    }
+}
 
-    /* Surfaces */
-    if (result->surface_count > 0) {
-        ag_color_printf(COL_BOLD, "Surfaces:\n");
-        for (size_t i = 0; i < result->surface_count; i++) {
-            const ag_surface_diff_t* d = &result->surfaces[i];
-            switch (d->change) {
-                case DIFF_ADDED:
-                    ag_color_printf(COL_GREEN, "  + surface %d: %s\n",
-                                    d->id, prim_type_name(d->new_fp.primitive_type));
-                    break;
-                case DIFF_REMOVED:
-                    ag_color_printf(COL_RED, "  - surface %d: %s\n",
-                                    d->id, prim_type_name(d->old_fp.primitive_type));
-                    break;
-                case DIFF_MODIFIED: {
-                    printf("  ");
-                    ag_color_printf(COL_YELLOW, "~ surface %d:", d->id);
-                    if (d->flags & SURF_CHG_TYPE)
-                        printf(" type %s -> %s",
-                               prim_type_name(d->old_fp.primitive_type),
-                               prim_type_name(d->new_fp.primitive_type));
-                    if (d->flags & SURF_CHG_DATA)
-                        printf(" geometry changed");
-                    if (d->flags & SURF_CHG_BOUNDARY)
-                        printf(" boundary changed");
-                    printf("\n");
-                    break;
-                }
-                default: break;
+/* Renumbered entries whose old and new IDs both step by one, held back
+   until the run ends so it prints as one line */
+typedef struct {
+    const char* kind;
+    int         old_id, id;
+    int         n;
+} renumber_run_t;
+
+static void flush_run(renumber_run_t* run) {
+    if (run->n == 0) return;
+    if (run->n > 1)
+        ag_color_printf(COL_CYAN, "  = %ss %d-%d -> %d-%d (renumbered)\n", run->kind,
+                        run->old_id, run->old_id + run->n - 1,
+                        run->id, run->id + run->n - 1);
+    else
+        ag_color_printf(COL_CYAN, "  = %s %d -> %d (renumbered)\n", run->kind,
+                        run->old_id, run->id);
+    run->n = 0;
+}
+
+int ag_diff_print(const ag_fingerprint_set_t* old_fp, const ag_fingerprint_set_t* new_fp,
+                  const char* old_label, const char* new_label) {
+    ag_diff_iter_t* it = ag_diff_iter_new(old_fp, new_fp);
+    if (!it) return -1;
+
+    ag_diff_result_t counts = { 0 };
+    renumber_run_t run = { NULL, 0, 0, 0 };
+    int section = -1;   /* kind of the entries being printed */
+    ag_diff_entry_t e;
+    int rc;
+    while ((rc = ag_diff_next(it, &e)) > 0) {
+        bool cell = e.kind == AG_DIFF_CELL;
+        if ((int)e.kind != section) {
+            if (section < 0) {
+                ag_color_printf(COL_BOLD, "--- %s\n", old_label ? old_label : "a");
+                ag_color_printf(COL_BOLD, "+++ %s\n", new_label ? new_label : "b");
+            } else {
+                flush_run(&run);
             }
+            printf("\n");
+            ag_color_printf(COL_BOLD, cell ? "Cells:\n" : "Surfaces:\n");
+            section = (int)e.kind;
         }
-        printf("\n");
-    }
+        count_entry(&counts, &e);
 
-    /* Cells */
-    if (result->cell_count > 0) {
-        ag_color_printf(COL_BOLD, "Cells:\n");
-        for (size_t i = 0; i < result->cell_count; i++) {
-            const ag_cell_diff_t* d = &result->cells[i];
-            switch (d->change) {
-                case DIFF_ADDED:
-                    ag_color_printf(COL_GREEN,
-                        "  + cell %d: mat %d, density %.4g, universe %d\n",
-                        d->id, d->new_fp.material_id, d->new_fp.density,
-                        d->new_fp.universe_id);
-                    break;
-                case DIFF_REMOVED:
-                    ag_color_printf(COL_RED,
-                        "  - cell %d: mat %d, density %.4g, universe %d\n",
-                        d->id, d->old_fp.material_id, d->old_fp.density,
-                        d->old_fp.universe_id);
-                    break;
-                case DIFF_MODIFIED: {
-                    printf("  ");
-                    ag_color_printf(COL_YELLOW, "~ cell %d:", d->id);
-                    if (d->flags & CELL_CHG_MATERIAL)
-                        printf(" material %d -> %d",
-                               d->old_fp.material_id, d->new_fp.material_id);
-                    if (d->flags & CELL_CHG_DENSITY)
-                        printf(" density %.4g -> %.4g",
-                               d->old_fp.density, d->new_fp.density);
-                    if (d->flags & CELL_CHG_REGION)
-                        printf(" region changed");
-                    if (d->flags & CELL_CHG_UNIVERSE)
-                        printf(" universe %d -> %d",
-                               d->old_fp.universe_id, d->new_fp.universe_id);
-                    if (d->flags & CELL_CHG_FILL)
-                        printf(" fill %d -> %d",
-                               d->old_fp.fill_universe, d->new_fp.fill_universe);
-                    if (d->flags & CELL_CHG_LATTICE)
-                        printf(" lattice changed");
-                    printf("\n");
-                    break;
-                }
-                default: break;
+        diff_change_t change = cell ? e.cell.change : e.surface.change;
+        if (change == DIFF_RENUMBERED) {
+            int id = cell ? e.cell.id : e.surface.id;
+            int old_id = cell ? e.cell.old_id : e.surface.old_id;
+            if (run.n > 0 && id == run.id + run.n && old_id == run.old_id + run.n) {
+                run.n++;
+                continue;
             }
+            flush_run(&run);
+            run = (renumber_run_t){ cell ? "cell" : "surface", old_id, id, 1 };
+            continue;
         }
+        flush_run(&run);
+        if (cell) print_cell(old_fp, new_fp, &e.cell);
+        else      print_surface(old_fp, new_fp, &e.surface);
+    }
+    flush_run(&run);
+    if (rc < 0 || section < 0) {
+        ag_diff_iter_free(it);
+        return rc;
+    }
+    printf("\n");
+
+    /* Nested changes, seen from the top level */
+    if (find_affected_cells(&counts, old_fp, new_fp) < 0) {
+        ag_diff_iter_free(it);
+        return -1;
+    }
+    if (counts.affected_cell_count > 0) {
+        ag_color_printf(COL_BOLD, "Universes:\n");
+        printf("  changed:");
+        print_ids(it->changed_universes, it->changed_universe_count);
+        printf("  top-level cells affected through their fill:");
+        print_ids(counts.affected_cells, counts.affected_cell_count);
         printf("\n");
     }
+    free(counts.affected_cells);
+    ag_diff_iter_free(it);
 
     /* Summary line */
+    int cells = counts.cells_added + counts.cells_removed +
+                counts.cells_modified + counts.cells_renumbered;
+    int surfs = counts.surfs_added + counts.surfs_removed +
+                counts.surfs_modified + counts.surfs_renumbered;
     ag_color_printf(COL_BOLD, "Summary: ");
-    printf("%d cells changed (", result->cells_added + result->cells_removed + result->cells_modified);
-    ag_color_printf(COL_GREEN, "%d added", result->cells_added);
+    printf("%d cells changed (", cells);
+    ag_color_printf(COL_GREEN, "%d added", counts.cells_added);
     printf(", ");
-    ag_color_printf(COL_RED, "%d removed", result->cells_removed);
+    ag_color_printf(COL_RED, "%d removed", counts.cells_removed);
     printf(", ");
-    ag_color_printf(COL_YELLOW, "%d modified", result->cells_modified);
-    printf("), %d surfaces changed (", result->surfs_added + result->surfs_removed + result->surfs_modified);
-    ag_color_printf(COL_GREEN, "%d added", result->surfs_added);
+    ag_color_printf(COL_YELLOW, "%d modified", counts.cells_modified);
+    if (counts.cells_renumbered) {
+        printf(", ");
+        ag_color_printf(COL_CYAN, "%d renumbered", counts.cells_renumbered);
+    }
+    printf("), %d surfaces changed (", surfs);
+    ag_color_printf(COL_GREEN, "%d added", counts.surfs_added);
     printf(", ");
-    ag_color_printf(COL_RED, "%d removed", result->surfs_removed);
+    ag_color_printf(COL_RED, "%d removed", counts.surfs_removed);
     printf(", ");
-    ag_color_printf(COL_YELLOW, "%d modified", result->surfs_modified);
+    ag_color_printf(COL_YELLOW, "%d modified", counts.surfs_modified);
+    if (counts.surfs_renumbered) {
+        printf(", ");
+        ag_color_printf(COL_CYAN, "%d renumbered", counts.surfs_renumbered);
+    }
     printf(")\n");
+    return cells + surfs;
 }
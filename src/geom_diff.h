@@ -9,45 +9,150 @@
 #include "geom_fingerprint.h"
 #include <stddef.h>
 
-/* A single diff entry for a cell */
+/* A lattice position whose fill universe changed */
+typedef struct {
+    int i, j, k;
+    int old_universe;
+    int new_universe;
+} ag_lattice_change_t;
+
+/* No row on this side of a diff entry */
+#define AG_DIFF_NO_ROW UINT32_MAX
+
+/* Where a modified cell changed. Surface references are MCNP-style
+   (negative for negative sense). */
+typedef struct {
+    /* CELL_CHG_REGION: where the two region trees diverge */
+    size_t        region_places;        /* diverging sub-expressions, 0 if unknown */
+    int*          region_removed;       /* references only on the old side */
+    size_t        region_removed_count;
+    int*          region_added;         /* references only on the new side */
+    size_t        region_added_count;
+
+    /* CELL_CHG_LATTICE: positions whose fill changed, found through the
+       differing blocks. Empty if the lattice shape changed. */
+    ag_lattice_change_t* lattice_changes;
+    size_t               lattice_change_count;
+} ag_cell_change_detail_t;
+
+/* A single diff entry for a cell. Rows are referenced by index into the
+   diffed sets; see ag_diff_cell_rows(). */
 typedef struct {
     diff_change_t change;
     int           id;         /* cell_id */
+    int           old_id;     /* RENUMBERED: cell_id on the old side */
     uint32_t      flags;      /* CELL_CHG_* bitfield (for MODIFIED) */
-    ag_cell_fp_t  old_fp;     /* valid if REMOVED or MODIFIED */
-    ag_cell_fp_t  new_fp;     /* valid if ADDED or MODIFIED */
+    uint32_t      old_row;    /* old set row unless ADDED, else AG_DIFF_NO_ROW */
+    uint32_t      new_row;    /* new set row unless REMOVED, else AG_DIFF_NO_ROW */
+    ag_cell_change_detail_t* detail;  /* MODIFIED region or lattice, else NULL */
 } ag_cell_diff_t;
 
 /* A single diff entry for a surface */
 typedef struct {
-    diff_change_t   change;
-    int             id;       /* surface_id */
-    uint32_t        flags;    /* SURF_CHG_* bitfield */
-    ag_surface_fp_t old_fp;
-    ag_surface_fp_t new_fp;
+    diff_change_t change;
+    int           id;         /* surface_id */
+    int           old_id;     /* RENUMBERED: surface_id on the old side */
+    uint32_t      flags;      /* SURF_CHG_* bitfield */
+    uint32_t      old_row;
+    uint32_t      new_row;
 } ag_surface_diff_t;
 
-/* Complete structural diff result */
+/* Complete structural diff result. The entries refer to old_set and
+   new_set, which must outlive the result. */
 typedef struct {
+    const ag_fingerprint_set_t* old_set;
+    const ag_fingerprint_set_t* new_set;
+
     ag_cell_diff_t*    cells;
     size_t             cell_count;
     ag_surface_diff_t* surfaces;
     size_t             surface_count;
 
+    /* Universes whose own cells changed (or that exist on one side
+       only), and top-level cells (universe 0) not changed themselves
+       whose fill chain reaches a changed universe */
+    int*               changed_universes;
+    size_t             changed_universe_count;
+    int*               affected_cells;
+    size_t             affected_cell_count;
+
     /* Summary counts */
-    int cells_added, cells_removed, cells_modified;
-    int surfs_added, surfs_removed, surfs_modified;
+    int cells_added, cells_removed, cells_modified, cells_renumbered;
+    int surfs_added, surfs_removed, surfs_modified, surfs_renumbered;
 } ag_diff_result_t;
 
-/* Compute structural diff between two fingerprint sets.
-   Caller must ag_diff_result_free(). */
+/* Compute structural diff between two fingerprint sets. Identical root
+   hashes end the diff at once, and only the cells of universes whose
+   hash differs are compared. Removed and added elements with identical
+   content are then paired by a hash join into DIFF_RENUMBERED entries.
+   Built on ag_diff_next(). Caller must ag_diff_result_free(). */
 ag_diff_result_t* ag_diff(const ag_fingerprint_set_t* old_fp,
                           const ag_fingerprint_set_t* new_fp);
 
 void ag_diff_result_free(ag_diff_result_t* result);
 
-/* Print the diff to stdout in text format */
-void ag_diff_print(const ag_diff_result_t* result,
-                   const char* old_label, const char* new_label);
+/* Whether the sets differ structurally: 1 if they do, 0 if not, -1 if
+   out of memory. Equal root hashes answer at once; otherwise the merge
+   stops at the first differing element, without the renumbering
+   pre-pass or change localization. */
+int ag_diff_any(const ag_fingerprint_set_t* old_fp, const ag_fingerprint_set_t* new_fp);
+
+/* Streaming diff: the entries of ag_diff(), surfaces first, then cells,
+   each in ID order, produced one at a time without building the result.
+   Only the renumbering pre-pass holds per-element state. */
+typedef struct ag_diff_iter ag_diff_iter_t;
+
+typedef enum {
+    AG_DIFF_SURFACE,
+    AG_DIFF_CELL
+} ag_diff_kind_t;
+
+typedef struct {
+    ag_diff_kind_t kind;
+    union {
+        ag_surface_diff_t surface;
+        ag_cell_diff_t    cell;
+    };
+} ag_diff_entry_t;
+
+/* Start a diff of two sets, which must outlive the iterator. Returns
+   NULL if out of memory. */
+ag_diff_iter_t* ag_diff_iter_new(const ag_fingerprint_set_t* old_fp,
+                                 const ag_fingerprint_set_t* new_fp);
+
+/* Next entry into *out: 1 if one was produced, 0 at the end, -1 if out
+   of memory. A cell's detail belongs to the iterator and stays valid
+   until the next call. */
+int ag_diff_next(ag_diff_iter_t* it, ag_diff_entry_t* out);
+
+void ag_diff_iter_free(ag_diff_iter_t* it);
+
+/* Rows of an entry; the side without a row is zeroed */
+void ag_diff_cell_rows(const ag_fingerprint_set_t* old_fp, const ag_fingerprint_set_t* new_fp,
+                       const ag_cell_diff_t* d, ag_cell_fp_t* o, ag_cell_fp_t* n);
+void ag_diff_surface_rows(const ag_fingerprint_set_t* old_fp, const ag_fingerprint_set_t* new_fp,
+                          const ag_surface_diff_t* d, ag_surface_fp_t* o, ag_surface_fp_t* n);
+
+/* Length of the run of renumbered cells / surfaces starting at entry i
+   whose old and new IDs both step by one (e.g. 1200-1299 -> 5200-5299),
+   or 0 if entry i is not renumbered */
+size_t ag_diff_cell_run(const ag_diff_result_t* r, size_t i);
+size_t ag_diff_surface_run(const ag_diff_result_t* r, size_t i);
+
+/* Describe a region change for printing after "region changed": e.g.
+   " (-3 -> 4)", " (added 7)" or " (operators only)". Writes into buf and
+   returns it; the string is empty if the change could not be localized. */
+const char* ag_region_change_str(const ag_cell_diff_t* d, char* buf, size_t size);
+
+/* Describe a lattice change for printing after "lattice changed": e.g.
+   " ([1,2,0] 5 -> 7)" or " ([1,2,0] 5 -> 7, [3,2,0] 5 -> 7, 2 positions)".
+   Empty if no positions were found. */
+const char* ag_lattice_change_str(const ag_cell_diff_t* d, char* buf, size_t size);
+
+/* Stream the diff of two sets to stdout in text format. Prints nothing
+   if they do not differ. Returns the number of changed elements, or -1
+   if out of memory. */
+int ag_diff_print(const ag_fingerprint_set_t* old_fp, const ag_fingerprint_set_t* new_fp,
+                  const char* old_label, const char* new_label);
 
 #endif /* ALEAGIT_GEOM_DIFF_H */
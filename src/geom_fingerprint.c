@@ -4,160 +4,1346 @@
 
 #include "geom_fingerprint.h"
 #include "aleagit.h"
+#include "hash64.h"
+#include "workers.h"
 #include <alea.h>
 #include <alea_types.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
-/* FNV-1a 64-bit */
-#define FNV_OFFSET 14695981039346656037ULL
-#define FNV_PRIME  1099511628211ULL
+#if defined(__SSE2__) || defined(_M_X64)
+#define FP_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define FP_NEON 1
+#include <arm_neon.h>
+#endif
 
-static uint64_t fnv_init(void) { return FNV_OFFSET; }
+static uint64_t hash_int(uint64_t h, int64_t v) {
+    return ag_hash_u64(h, (uint64_t)v);
+}
+
+static uint64_t hash_double(uint64_t h, double v) {
+    /* Discretize to ~1e-6 precision to tolerate floating-point noise */
+    int64_t iv = (int64_t)round(v * 1e6);
+    return hash_int(h, iv);
+}
+
+/* Per-call memo of region-tree nodes: open addressing keyed by node id,
+   mapping to the node's index in the set's node array. Shared sub-regions
+   (#N complements, reused subtrees) are hashed and stored once per
+   ag_fingerprint() call. */
+enum { MEMO_EMPTY = 0, MEMO_OPEN, MEMO_DONE };
+
+typedef struct {
+    uint32_t* keys;
+    uint32_t* vals;
+    uint8_t*  state;
+    size_t    cap;    /* power of two */
+    size_t    count;
+} node_memo_t;
+
+/* Explicit DFS stack, so deep trees cannot overflow the C stack */
+typedef struct {
+    uint32_t* items;
+    size_t    count;
+    size_t    cap;
+} node_stack_t;
+
+static int memo_init(node_memo_t* m, size_t cap) {
+    m->keys  = malloc(cap * sizeof(uint32_t));
+    m->vals  = malloc(cap * sizeof(uint32_t));
+    m->state = calloc(cap, sizeof(uint8_t));
+    m->cap   = cap;
+    m->count = 0;
+    return (m->keys && m->vals && m->state) ? 0 : -1;
+}
 
-static uint64_t fnv_feed(uint64_t h, const void* data, size_t len) {
-    const uint8_t* p = data;
-    for (size_t i = 0; i < len; i++) {
-        h ^= p[i];
-        h *= FNV_PRIME;
+static void memo_free(node_memo_t* m) {
+    free(m->keys);
+    free(m->vals);
+    free(m->state);
+}
+
+static size_t memo_slot(const node_memo_t* m, uint32_t node) {
+    size_t i = (size_t)(((uint64_t)node * 0x9E3779B97F4A7C15ULL) >> 32) & (m->cap - 1);
+    while (m->state[i] != MEMO_EMPTY && m->keys[i] != node)
+        i = (i + 1) & (m->cap - 1);
+    return i;
+}
+
+/* Find or insert node; returns its slot, or SIZE_MAX if out of memory */
+static size_t memo_insert(node_memo_t* m, uint32_t node) {
+    if ((m->count + 1) * 2 > m->cap) {
+        node_memo_t grown;
+        if (memo_init(&grown, m->cap * 2) < 0) {
+            memo_free(&grown);
+            return SIZE_MAX;
+        }
+        for (size_t i = 0; i < m->cap; i++) {
+            if (m->state[i] == MEMO_EMPTY) continue;
+            size_t j = memo_slot(&grown, m->keys[i]);
+            grown.keys[j]  = m->keys[i];
+            grown.vals[j]  = m->vals[i];
+            grown.state[j] = m->state[i];
+        }
+        grown.count = m->count;
+        memo_free(m);
+        *m = grown;
     }
-    return h;
+
+    size_t i = memo_slot(m, node);
+    if (m->state[i] == MEMO_EMPTY) {
+        m->keys[i] = node;
+        m->vals[i] = AG_REGION_NONE;
+        m->state[i] = MEMO_OPEN;
+        m->count++;
+    }
+    return i;
 }
 
-static uint64_t fnv_int(uint64_t h, int64_t v) {
-    return fnv_feed(h, &v, sizeof(v));
+static int stack_push(node_stack_t* st, uint32_t node) {
+    if (st->count == st->cap) {
+        size_t cap = st->cap ? st->cap * 2 : 64;
+        uint32_t* items = realloc(st->items, cap * sizeof(uint32_t));
+        if (!items) return -1;
+        st->items = items;
+        st->cap = cap;
+    }
+    st->items[st->count++] = node;
+    return 0;
 }
 
-static uint64_t fnv_double(uint64_t h, double v) {
-    /* Discretize to ~1e-6 precision to tolerate floating-point noise */
-    int64_t iv = (int64_t)round(v * 1e6);
-    return fnv_int(h, iv);
+/* Node array of the set being built */
+typedef struct {
+    ag_region_node_t* items;
+    size_t            count;
+    size_t            cap;
+} node_pool_t;
+
+static uint32_t pool_add(node_pool_t* pool, const ag_region_node_t* n) {
+    if (pool->count >= AG_REGION_NONE) return AG_REGION_NONE;
+    if (pool->count == pool->cap) {
+        size_t cap = pool->cap ? pool->cap * 2 : 1024;
+        ag_region_node_t* items = realloc(pool->items, cap * sizeof(*items));
+        if (!items) return AG_REGION_NONE;
+        pool->items = items;
+        pool->cap = cap;
+    }
+    pool->items[pool->count] = *n;
+    return (uint32_t)pool->count++;
 }
 
-/* Recursively hash a CSG tree */
-static uint64_t hash_tree(const alea_system_t* sys, uint32_t node) {
-    if (node == UINT32_MAX) return fnv_init();
+/* Index of a child for its parent: the empty tree and nodes still open
+   (only possible on a malformed, cyclic tree) map to AG_REGION_NONE. */
+static uint32_t child_index(const node_memo_t* m, uint32_t node) {
+    if (node == UINT32_MAX) return AG_REGION_NONE;
+    size_t i = memo_slot(m, node);
+    return m->state[i] == MEMO_DONE ? m->vals[i] : AG_REGION_NONE;
+}
 
-    alea_operation_t op = alea_node_operation(sys, node);
-    uint64_t h = fnv_init();
+static uint64_t node_hash(const node_pool_t* pool, uint32_t index) {
+    return index == AG_REGION_NONE ? ag_hash_init() : pool->items[index].hash;
+}
 
-    if (op == ALEA_OP_PRIMITIVE) {
-        int sid = alea_node_surface_id(sys, node);
-        int sense = alea_node_sense(sys, node);
-        h = fnv_int(h, sid);
-        h = fnv_int(h, sense);
-    } else {
-        h = fnv_int(h, (int64_t)op);
-        uint32_t left  = alea_node_left(sys, node);
-        uint32_t right = alea_node_right(sys, node);
-        uint64_t lh = hash_tree(sys, left);
-        uint64_t rh = hash_tree(sys, right);
-        h = fnv_feed(h, &lh, sizeof(lh));
-        h = fnv_feed(h, &rh, sizeof(rh));
+/* Hash a CSG tree bottom-up, appending each node not seen yet to the
+   pool. A primitive hashes (surface id, sense); an operator hashes (op,
+   left hash, right hash), AG_REGION_NONE children hashing as ag_hash_init().
+   Returns the root's pool index, AG_REGION_NONE for an empty tree, and
+   sets *failed if memory runs out. */
+static uint32_t hash_tree(const alea_system_t* sys, uint32_t root,
+                          node_memo_t* memo, node_stack_t* st,
+                          node_pool_t* pool, bool* failed) {
+    if (root == UINT32_MAX) return AG_REGION_NONE;
+
+    st->count = 0;
+    if (stack_push(st, root) < 0) goto oom;
+
+    while (st->count > 0) {
+        uint32_t node = st->items[st->count - 1];
+        size_t slot = memo_slot(memo, node);
+        uint8_t state = memo->state[slot];
+
+        if (state == MEMO_DONE) {
+            st->count--;
+            continue;
+        }
+
+        alea_operation_t op = alea_node_operation(sys, node);
+        uint32_t left = UINT32_MAX, right = UINT32_MAX;
+        if (op != ALEA_OP_PRIMITIVE) {
+            left  = alea_node_left(sys, node);
+            right = alea_node_right(sys, node);
+        }
+
+        if (state == MEMO_EMPTY && op != ALEA_OP_PRIMITIVE) {
+            /* First visit: open the node and descend into unseen children */
+            if (memo_insert(memo, node) == SIZE_MAX) goto oom;
+            uint32_t kids[2] = { left, right };
+            for (int k = 0; k < 2; k++) {
+                if (kids[k] == UINT32_MAX) continue;
+                if (memo->state[memo_slot(memo, kids[k])] != MEMO_EMPTY) continue;
+                if (stack_push(st, kids[k]) < 0) goto oom;
+            }
+            continue;
+        }
+
+        /* Leaf, or operator whose children are all settled */
+        ag_region_node_t n = { .op = (int32_t)op,
+                               .left = AG_REGION_NONE, .right = AG_REGION_NONE };
+        uint64_t h = ag_hash_init();
+        if (op == ALEA_OP_PRIMITIVE) {
+            n.surface_id = alea_node_surface_id(sys, node);
+            n.sense      = alea_node_sense(sys, node);
+            h = hash_int(h, n.surface_id);
+            h = hash_int(h, n.sense);
+        } else {
+            n.left  = child_index(memo, left);
+            n.right = child_index(memo, right);
+            uint64_t lh = node_hash(pool, n.left);
+            uint64_t rh = node_hash(pool, n.right);
+            h = hash_int(h, (int64_t)op);
+            h = ag_hash_u64(h, lh);
+            h = ag_hash_u64(h, rh);
+        }
+        n.hash = h;
+
+        slot = memo_insert(memo, node);
+        if (slot == SIZE_MAX) goto oom;
+        uint32_t index = pool_add(pool, &n);
+        if (index == AG_REGION_NONE) goto oom;
+        memo->vals[slot] = index;
+        memo->state[slot] = MEMO_DONE;
+        st->count--;
     }
-    return h;
+
+    return child_index(memo, root);
+
+oom:
+    *failed = true;
+    return AG_REGION_NONE;
+}
+
+/* Lattices of the set being built: records, fill entries and block
+   hashes, each appended in cell order */
+typedef struct {
+    ag_lattice_fp_t* items;
+    size_t           count, cap;
+    int*             fill;
+    size_t           fill_count, fill_cap;
+    uint64_t*        blocks;
+    size_t           block_count, block_cap;
+} lattice_pool_t;
+
+/* Make room for need elements of size elem in *items */
+static int reserve(void** items, size_t* cap, size_t need, size_t elem) {
+    if (need <= *cap) return 0;
+    size_t c = *cap ? *cap : 64;
+    while (c < need) c *= 2;
+    void* p = realloc(*items, c * elem);
+    if (!p) return -1;
+    *items = p;
+    *cap = c;
+    return 0;
 }
 
-/* Hash lattice fill array */
-static uint64_t hash_lattice(const alea_cell_info_t* info) {
-    uint64_t h = fnv_init();
-    h = fnv_int(h, info->lat_type);
+/* Hash n fill entries in blocks of AG_LATTICE_BLOCK into out */
+static void hash_blocks(const int* fill, size_t n, uint64_t* out) {
+    for (size_t b = 0; b * AG_LATTICE_BLOCK < n; b++) {
+        size_t off = b * AG_LATTICE_BLOCK;
+        size_t len = n - off < AG_LATTICE_BLOCK ? n - off : AG_LATTICE_BLOCK;
+        out[b] = ag_hash_bytes(ag_hash_init(), fill + off, len * sizeof(int));
+    }
+}
+
+static size_t block_count(size_t n) {
+    return (n + AG_LATTICE_BLOCK - 1) / AG_LATTICE_BLOCK;
+}
+
+/* Cell lattice hash: type, shape, pitch and origin, then the block
+   hashes of the fill array. A lattice cell's fill and block hashes are
+   appended to the pool, its pool index stored in *index. */
+static uint64_t hash_lattice(const alea_cell_info_t* info, lattice_pool_t* pool,
+                             uint32_t* index, bool* failed) {
+    *index = AG_LATTICE_NONE;
+    uint64_t h = ag_hash_init();
+    h = hash_int(h, info->lat_type);
     if (info->lat_type == 0) return h;
 
     for (int i = 0; i < 6; i++)
-        h = fnv_int(h, info->lat_fill_dims[i]);
+        h = hash_int(h, info->lat_fill_dims[i]);
     for (int i = 0; i < 3; i++) {
-        h = fnv_double(h, info->lat_pitch[i]);
-        h = fnv_double(h, info->lat_lower_left[i]);
+        h = hash_double(h, info->lat_pitch[i]);
+        h = hash_double(h, info->lat_lower_left[i]);
     }
-    if (info->lat_fill && info->lat_fill_count > 0) {
-        for (size_t i = 0; i < info->lat_fill_count; i++)
-            h = fnv_int(h, info->lat_fill[i]);
+
+    size_t n = info->lat_fill ? info->lat_fill_count : 0;
+    size_t nb = block_count(n);
+    if (n >= UINT32_MAX || pool->count >= AG_LATTICE_NONE ||
+        reserve((void**)&pool->items, &pool->cap, pool->count + 1, sizeof(ag_lattice_fp_t)) < 0 ||
+        reserve((void**)&pool->fill, &pool->fill_cap, pool->fill_count + n, sizeof(int)) < 0 ||
+        reserve((void**)&pool->blocks, &pool->block_cap, pool->block_count + nb, sizeof(uint64_t)) < 0) {
+        *failed = true;
+        return h;
     }
+
+    ag_lattice_fp_t* lat = &pool->items[pool->count];
+    memcpy(lat->dims, info->lat_fill_dims, sizeof(lat->dims));
+    lat->fill_count = (uint32_t)n;
+    lat->first_fill = (uint32_t)pool->fill_count;
+    lat->first_block = (uint32_t)pool->block_count;
+    if (n > 0) memcpy(pool->fill + pool->fill_count, info->lat_fill, n * sizeof(int));
+    hash_blocks(pool->fill + pool->fill_count, n, pool->blocks + pool->block_count);
+
+    h = hash_int(h, (int64_t)n);
+    for (size_t b = 0; b < nb; b++)
+        h = ag_hash_u64(h, pool->blocks[pool->block_count + b]);
+
+    pool->fill_count += n;
+    pool->block_count += nb;
+    *index = (uint32_t)pool->count++;
     return h;
 }
 
-static int cmp_cell_fp(const void* a, const void* b) {
-    return ((const ag_cell_fp_t*)a)->cell_id - ((const ag_cell_fp_t*)b)->cell_id;
+/* Columns of a set live in one block, each padded to COLUMN_ALIGN */
+#define COLUMN_ALIGN 64
+
+static size_t column_size(size_t n, size_t elem) {
+    size_t bytes = (n ? n : 1) * elem;
+    return (bytes + COLUMN_ALIGN - 1) & ~(size_t)(COLUMN_ALIGN - 1);
 }
 
-static int cmp_surface_fp(const void* a, const void* b) {
-    return ((const ag_surface_fp_t*)a)->surface_id - ((const ag_surface_fp_t*)b)->surface_id;
+/* Allocate zeroed columns for nc cells and ns surfaces. The previous
+   block, if any, is left to the caller. */
+static int alloc_columns(ag_fingerprint_set_t* fp, size_t nc, size_t ns) {
+    size_t c4 = column_size(nc, 4), c8 = column_size(nc, 8);
+    size_t s4 = column_size(ns, 4), s8 = column_size(ns, 8);
+    uint8_t* raw = calloc(1, 4 * c8 + 7 * c4 + s8 + 3 * s4 + COLUMN_ALIGN);
+    if (!raw) return -1;
+
+    uint8_t* p = raw + (COLUMN_ALIGN - (uintptr_t)raw % COLUMN_ALIGN) % COLUMN_ALIGN;
+    fp->columns           = raw;
+    fp->cell_count        = nc;
+    fp->cell_density      = (double*)p;   p += c8;
+    fp->cell_tree_hash    = (uint64_t*)p; p += c8;
+    fp->cell_lattice_hash = (uint64_t*)p; p += c8;
+    fp->cell_fill_hash    = (uint64_t*)p; p += c8;
+    fp->cell_id           = (int*)p;      p += c4;
+    fp->cell_material     = (int*)p;      p += c4;
+    fp->cell_universe     = (int*)p;      p += c4;
+    fp->cell_fill         = (int*)p;      p += c4;
+    fp->cell_lat_type     = (int*)p;      p += c4;
+    fp->cell_region_root  = (uint32_t*)p; p += c4;
+    fp->cell_lattice      = (uint32_t*)p; p += c4;
+    fp->surface_count     = ns;
+    fp->surface_data_hash = (uint64_t*)p; p += s8;
+    fp->surface_id        = (int*)p;      p += s4;
+    fp->surface_type      = (int*)p;      p += s4;
+    fp->surface_boundary  = (int*)p;
+    return 0;
 }
 
-ag_fingerprint_set_t* ag_fingerprint(const alea_system_t* sys) {
-    ag_fingerprint_set_t* fp = calloc(1, sizeof(*fp));
-    if (!fp) return NULL;
+/* Stable LSD radix sort of n signed 32-bit IDs. The passes run over a
+   (key << 32 | index) array, skipping bytes all keys share. Returns the
+   sorted order as a malloc'd index array, or NULL if out of memory.
+   *dups receives the number of IDs equal to the previous one. */
+static uint32_t* sort_order(const int* ids, size_t n, size_t* dups) {
+    *dups = 0;
+    uint32_t* order = malloc((n ? n : 1) * sizeof(uint32_t));
+    uint64_t* items = malloc((n ? n : 1) * sizeof(uint64_t));
+    uint64_t* tmp = malloc((n ? n : 1) * sizeof(uint64_t));
+    if (!order || !items || !tmp || n > UINT32_MAX) {
+        free(order);
+        free(items);
+        free(tmp);
+        return NULL;
+    }
 
-    /* Cells */
-    size_t nc = alea_cell_count(sys);
-    fp->cells = calloc(nc, sizeof(ag_cell_fp_t));
-    fp->cell_count = nc;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t key = (uint32_t)ids[i] ^ 0x80000000U;  /* order negatives first */
+        items[i] = (uint64_t)key << 32 | (uint32_t)i;
+    }
+
+    for (int shift = 32; shift < 64; shift += 8) {
+        size_t count[256] = { 0 };
+        for (size_t i = 0; i < n; i++)
+            count[(items[i] >> shift) & 0xff]++;
+        if (n == 0 || count[(items[0] >> shift) & 0xff] == n) continue;
+
+        size_t sum = 0;
+        for (int b = 0; b < 256; b++) {
+            size_t c = count[b];
+            count[b] = sum;
+            sum += c;
+        }
+        for (size_t i = 0; i < n; i++)
+            tmp[count[(items[i] >> shift) & 0xff]++] = items[i];
+        uint64_t* t = items;
+        items = tmp;
+        tmp = t;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        order[i] = (uint32_t)items[i];
+        if (i > 0 && (items[i] >> 32) == (items[i - 1] >> 32)) (*dups)++;
+    }
+
+    free(items);
+    free(tmp);
+    return order;
+}
+
+static void gather(void* dst, const void* src, const uint32_t* order,
+                   size_t n, size_t elem) {
+    if (elem == 8) {
+        uint64_t* d = dst;
+        const uint64_t* s = src;
+        for (size_t i = 0; i < n; i++) d[i] = s[order[i]];
+    } else {
+        uint32_t* d = dst;
+        const uint32_t* s = src;
+        for (size_t i = 0; i < n; i++) d[i] = s[order[i]];
+    }
+}
 
-    for (size_t i = 0; i < nc; i++) {
+/* Sort the set's columns by ID: one radix sort per table, then each
+   column is gathered once into a fresh block. */
+static int sort_set(ag_fingerprint_set_t* fp) {
+    uint32_t* corder = sort_order(fp->cell_id, fp->cell_count, &fp->dup_cell_ids);
+    uint32_t* sorder = sort_order(fp->surface_id, fp->surface_count, &fp->dup_surface_ids);
+    ag_fingerprint_set_t out = { 0 };
+    if (!corder || !sorder || alloc_columns(&out, fp->cell_count, fp->surface_count) < 0) {
+        free(corder);
+        free(sorder);
+        return -1;
+    }
+
+    size_t nc = fp->cell_count, ns = fp->surface_count;
+    gather(out.cell_density,      fp->cell_density,      corder, nc, 8);
+    gather(out.cell_tree_hash,    fp->cell_tree_hash,    corder, nc, 8);
+    gather(out.cell_lattice_hash, fp->cell_lattice_hash, corder, nc, 8);
+    gather(out.cell_fill_hash,    fp->cell_fill_hash,    corder, nc, 8);
+    gather(out.cell_id,           fp->cell_id,           corder, nc, 4);
+    gather(out.cell_material,     fp->cell_material,     corder, nc, 4);
+    gather(out.cell_universe,     fp->cell_universe,     corder, nc, 4);
+    gather(out.cell_fill,         fp->cell_fill,         corder, nc, 4);
+    gather(out.cell_lat_type,     fp->cell_lat_type,     corder, nc, 4);
+    gather(out.cell_region_root,  fp->cell_region_root,  corder, nc, 4);
+    gather(out.cell_lattice,      fp->cell_lattice,      corder, nc, 4);
+    gather(out.surface_data_hash, fp->surface_data_hash, sorder, ns, 8);
+    gather(out.surface_id,        fp->surface_id,        sorder, ns, 4);
+    gather(out.surface_type,      fp->surface_type,      sorder, ns, 4);
+    gather(out.surface_boundary,  fp->surface_boundary,  sorder, ns, 4);
+    free(corder);
+    free(sorder);
+
+    out.nodes = fp->nodes;
+    out.node_count = fp->node_count;
+    out.lattices = fp->lattices;
+    out.lattice_count = fp->lattice_count;
+    out.lattice_fill = fp->lattice_fill;
+    out.lattice_fill_count = fp->lattice_fill_count;
+    out.lattice_block_hash = fp->lattice_block_hash;
+    out.lattice_block_count = fp->lattice_block_count;
+    out.dup_cell_ids = fp->dup_cell_ids;
+    out.dup_surface_ids = fp->dup_surface_ids;
+    free(fp->columns);
+    free(fp->universes);        /* indexed by the old order */
+    free(fp->universe_cells);
+    *fp = out;
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Universe hierarchy                                                */
+/* ------------------------------------------------------------------ */
+
+/* Hash of one cell row, density by its bits: equal hashes imply rows
+   that ag_cell_fp_compare() finds equal. */
+static uint64_t cell_row_hash(const ag_fingerprint_set_t* fp, size_t i) {
+    uint64_t density;
+    memcpy(&density, &fp->cell_density[i], sizeof(density));
+    uint64_t h = ag_hash_init();
+    h = hash_int(h, fp->cell_id[i]);
+    h = hash_int(h, fp->cell_material[i]);
+    h = hash_int(h, fp->cell_universe[i]);
+    h = hash_int(h, fp->cell_fill[i]);
+    h = hash_int(h, fp->cell_lat_type[i]);
+    h = ag_hash_u64(h, density);
+    h = ag_hash_u64(h, fp->cell_tree_hash[i]);
+    return ag_hash_u64(h, fp->cell_lattice_hash[i]);
+}
+
+/* Sum of the universe's cell row hashes (with deep, each folded with the
+   cell's fill hash), so the result does not depend on cell order */
+static uint64_t universe_hash(const ag_fingerprint_set_t* fp,
+                              const ag_universe_fp_t* u, bool deep) {
+    uint64_t sum = 0;
+    for (uint32_t k = 0; k < u->count; k++) {
+        uint32_t i = fp->universe_cells[u->first + k];
+        uint64_t row = cell_row_hash(fp, i);
+        sum += deep ? ag_hash_u64(row, fp->cell_fill_hash[i]) : row;
+    }
+    uint64_t h = hash_int(ag_hash_init(), u->universe_id);
+    h = hash_int(h, u->count);
+    return ag_hash_u64(h, sum);
+}
+
+/* Group the cells by universe and hash every group, the surfaces, and
+   the whole set. Rebuilt whenever the cell order or fill hashes change. */
+static int build_universes(ag_fingerprint_set_t* fp) {
+    free(fp->universes);
+    free(fp->universe_cells);
+    fp->universes = NULL;
+    fp->universe_count = 0;
+
+    size_t n = fp->cell_count, dups;
+    fp->universe_cells = sort_order(fp->cell_universe, n, &dups);
+    if (!fp->universe_cells) return -1;
+    fp->universes = calloc(n - dups ? n - dups : 1, sizeof(ag_universe_fp_t));
+    if (!fp->universes) return -1;
+
+    size_t nu = 0;
+    for (size_t k = 0; k < n; k++) {
+        int id = fp->cell_universe[fp->universe_cells[k]];
+        if (nu == 0 || fp->universes[nu - 1].universe_id != id) {
+            fp->universes[nu].universe_id = id;
+            fp->universes[nu].first = (uint32_t)k;
+            nu++;
+        }
+        fp->universes[nu - 1].count++;
+    }
+    fp->universe_count = nu;
+
+    uint64_t root = hash_int(ag_hash_init(), (int64_t)nu);
+    for (size_t k = 0; k < nu; k++) {
+        ag_universe_fp_t* u = &fp->universes[k];
+        u->cell_hash = universe_hash(fp, u, false);
+        u->hash = universe_hash(fp, u, true);
+        root = ag_hash_u64(root, u->hash);
+    }
+
+    uint64_t sh = hash_int(ag_hash_init(), (int64_t)fp->surface_count);
+    for (size_t i = 0; i < fp->surface_count; i++) {
+        sh = hash_int(sh, fp->surface_id[i]);
+        sh = hash_int(sh, fp->surface_type[i]);
+        sh = hash_int(sh, fp->surface_boundary[i]);
+        sh = ag_hash_u64(sh, fp->surface_data_hash[i]);
+    }
+    fp->surface_hash = sh;
+    fp->root_hash = ag_hash_u64(root, sh);
+    return 0;
+}
+
+static int compare_int(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+/* Universes each cell is filled with, directly or through its lattice:
+   sorted and distinct, cell i's at ids[start[i] .. start[i + 1]) */
+typedef struct {
+    size_t* start;
+    int*    ids;
+} fill_lists_t;
+
+static int collect_fills(const ag_fingerprint_set_t* fp, fill_lists_t* fl) {
+    size_t n = fp->cell_count, len = 0, cap = 0;
+    fl->ids = NULL;
+    fl->start = malloc((n + 1) * sizeof(size_t));
+    if (!fl->start) return -1;
+
+    for (size_t i = 0; i < n; i++) {
+        fl->start[i] = len;
+        const int* lat_fill = NULL;
+        size_t lat = 0;
+        if (fp->cell_lattice[i] != AG_LATTICE_NONE) {
+            const ag_lattice_fp_t* l = &fp->lattices[fp->cell_lattice[i]];
+            lat_fill = fp->lattice_fill + l->first_fill;
+            lat = l->fill_count;
+        }
+        if (reserve((void**)&fl->ids, &cap, len + lat + 1, sizeof(int)) < 0) return -1;
+
+        int* list = fl->ids + len;
+        size_t m = 0;
+        if (fp->cell_fill[i] != -1) list[m++] = fp->cell_fill[i];
+        for (size_t k = 0; k < lat; k++) list[m++] = lat_fill[k];
+        qsort(list, m, sizeof(int), compare_int);
+        size_t d = 0;
+        for (size_t k = 0; k < m; k++)
+            if (d == 0 || list[d - 1] != list[k]) list[d++] = list[k];
+        len += d;
+    }
+    fl->start[n] = len;
+    return 0;
+}
+
+enum { UNIV_NEW = 0, UNIV_OPEN, UNIV_DONE };
+
+/* Fill hash of cell i from the universes it holds. A universe still
+   open (a fill cycle) or not defined by any cell counts by its ID only. */
+static uint64_t fill_hash(const ag_fingerprint_set_t* fp, const fill_lists_t* fl,
+                          const uint8_t* state, size_t i) {
+    if (fl->start[i] == fl->start[i + 1]) return 0;
+    uint64_t h = ag_hash_init();
+    for (size_t k = fl->start[i]; k < fl->start[i + 1]; k++) {
+        int id = fl->ids[k];
+        size_t u = ag_fp_find_universe(fp, id);
+        h = hash_int(h, id);
+        h = ag_hash_u64(h, u != SIZE_MAX && state[u] == UNIV_DONE ? fp->universes[u].hash : 0);
+    }
+    return h;
+}
+
+/* Set every cell's fill hash. Universes are finished depth first, the
+   ones they hold before themselves, with an explicit stack of (universe,
+   position in its flattened fill lists). Needs build_universes() first;
+   universe hashes are left up to date. */
+static int hash_fills(ag_fingerprint_set_t* fp) {
+    size_t nu = fp->universe_count;
+    fill_lists_t fl;
+    uint8_t* state = calloc(nu ? nu : 1, 1);
+    size_t* stack = malloc((nu ? nu : 1) * 3 * sizeof(size_t));
+    int rc = collect_fills(fp, &fl);
+    if (rc < 0 || !state || !stack) rc = -1;
+
+    for (size_t root = 0; rc == 0 && root < nu; root++) {
+        if (state[root] != UNIV_NEW) continue;
+        state[root] = UNIV_OPEN;
+        stack[0] = root; stack[1] = 0; stack[2] = 0;
+        size_t depth = 1;
+        while (depth > 0) {
+            size_t* top = &stack[3 * (depth - 1)];
+            const ag_universe_fp_t* u = &fp->universes[top[0]];
+
+            /* Next fill of the current cell (top[1]) at list position top[2] */
+            size_t child = SIZE_MAX;
+            while (top[1] < u->count && child == SIZE_MAX) {
+                uint32_t i = fp->universe_cells[u->first + top[1]];
+                size_t k = fl.start[i] + top[2];
+                if (k >= fl.start[i + 1]) {
+                    top[1]++;
+                    top[2] = 0;
+                    continue;
+                }
+                top[2]++;
+                size_t c = ag_fp_find_universe(fp, fl.ids[k]);
+                if (c != SIZE_MAX && state[c] == UNIV_NEW) child = c;
+            }
+            if (child != SIZE_MAX) {
+                state[child] = UNIV_OPEN;
+                size_t* f = &stack[3 * depth++];
+                f[0] = child; f[1] = 0; f[2] = 0;
+                continue;
+            }
+
+            ag_universe_fp_t* w = &fp->universes[top[0]];
+            for (uint32_t k = 0; k < w->count; k++) {
+                uint32_t i = fp->universe_cells[w->first + k];
+                fp->cell_fill_hash[i] = fill_hash(fp, &fl, state, i);
+            }
+            w->hash = universe_hash(fp, w, true);
+            state[top[0]] = UNIV_DONE;
+            depth--;
+        }
+    }
+
+    free(fl.start);
+    free(fl.ids);
+    free(state);
+    free(stack);
+    return rc;
+}
+
+/* Fingerprinting is split into chunks of FP_CHUNK cells or surfaces,
+   claimed by ag_thread_count() workers. Each cell chunk gets its own node
+   array (shared subtrees are deduplicated within a chunk only); the arrays
+   are concatenated in chunk order afterwards, so the result does not
+   depend on the thread count. */
+#define FP_CHUNK 512
+
+typedef struct {
+    const alea_system_t*  sys;
+    ag_fingerprint_set_t* fp;
+    node_pool_t*          pools;        /* one per cell chunk */
+    lattice_pool_t*       lattices;     /* same */
+    size_t                cell_chunks;
+    size_t                surf_chunks;
+    atomic_size_t         next;         /* next chunk to claim */
+    atomic_bool           failed;
+} fp_job_t;
+
+static void memo_clear(node_memo_t* m) {
+    memset(m->state, MEMO_EMPTY, m->cap);
+    m->count = 0;
+}
+
+static void fingerprint_cells(fp_job_t* job, size_t chunk,
+                              node_memo_t* memo, node_stack_t* stack) {
+    ag_fingerprint_set_t* fp = job->fp;
+    node_pool_t* pool = &job->pools[chunk];
+    lattice_pool_t* lattices = &job->lattices[chunk];
+    size_t begin = chunk * FP_CHUNK;
+    size_t end = begin + FP_CHUNK;
+    if (end > fp->cell_count) end = fp->cell_count;
+    bool failed = false;
+
+    memo_clear(memo);
+    for (size_t i = begin; i < end && !failed; i++) {
         alea_cell_info_t info;
         memset(&info, 0, sizeof(info));
-        if (alea_cell_get_info(sys, i, &info) < 0) continue;
+        fp->cell_region_root[i] = AG_REGION_NONE;
+        fp->cell_lattice[i] = AG_LATTICE_NONE;
+        if (alea_cell_get_info(job->sys, i, &info) < 0) continue;
 
-        fp->cells[i].cell_id       = info.cell_id;
-        fp->cells[i].material_id   = info.material_id;
-        fp->cells[i].density        = info.density;
-        fp->cells[i].universe_id   = info.universe_id;
-        fp->cells[i].fill_universe = info.fill_universe;
-        fp->cells[i].lat_type      = info.lat_type;
-        fp->cells[i].tree_hash     = hash_tree(sys, info.root);
-        fp->cells[i].lattice_hash  = hash_lattice(&info);
+        uint32_t root = hash_tree(job->sys, info.root, memo, stack, pool, &failed);
+
+        fp->cell_id[i]           = info.cell_id;
+        fp->cell_material[i]     = info.material_id;
+        fp->cell_density[i]      = info.density;
+        fp->cell_universe[i]     = info.universe_id;
+        fp->cell_fill[i]         = info.fill_universe;
+        fp->cell_lat_type[i]     = info.lat_type;
+        fp->cell_tree_hash[i]    = node_hash(pool, root);
+        fp->cell_lattice_hash[i] = hash_lattice(&info, lattices, &fp->cell_lattice[i], &failed);
+        fp->cell_region_root[i]  = root;
     }
+    if (failed) atomic_store(&job->failed, true);
+}
 
-    qsort(fp->cells, fp->cell_count, sizeof(ag_cell_fp_t), cmp_cell_fp);
+/* Coefficients of each primitive type: its alea_primitive_data_t
+   member and how many doubles that member holds */
+#define PRIMITIVES(X)                                                         \
+    X(ALEA_PRIMITIVE_PLANE,       plane,        4)  /* a, b, c, d */          \
+    X(ALEA_PRIMITIVE_SPHERE,      sphere,       4)  /* center, radius */      \
+    X(ALEA_PRIMITIVE_CYLINDER_X,  cylinder_x,   3)  /* y, z, radius */        \
+    X(ALEA_PRIMITIVE_CYLINDER_Y,  cylinder_y,   3)  /* x, z, radius */        \
+    X(ALEA_PRIMITIVE_CYLINDER_Z,  cylinder_z,   3)  /* x, y, radius */        \
+    X(ALEA_PRIMITIVE_CONE_X,      cone_x,       5)  /* apex, t^2, sheet */    \
+    X(ALEA_PRIMITIVE_CONE_Y,      cone_y,       5)                            \
+    X(ALEA_PRIMITIVE_CONE_Z,      cone_z,       5)                            \
+    X(ALEA_PRIMITIVE_BOX,         box,          6)  /* min and max corners */ \
+    X(ALEA_PRIMITIVE_QUADRIC,     quadric,     10)  /* A..K */                \
+    X(ALEA_PRIMITIVE_TORUS_X,     torus_x,      6)  /* center, A, B, C */     \
+    X(ALEA_PRIMITIVE_TORUS_Y,     torus_y,      6)                            \
+    X(ALEA_PRIMITIVE_TORUS_Z,     torus_z,      6)                            \
+    X(ALEA_PRIMITIVE_RCC,         rcc,          7)  /* base, axis, radius */  \
+    X(ALEA_PRIMITIVE_BOX_GENERAL, box_general, 12)  /* corner, 3 edges */     \
+    X(ALEA_PRIMITIVE_SPH,         sph,          4)  /* center, radius */      \
+    X(ALEA_PRIMITIVE_TRC,         trc,          8)  /* base, axis, 2 radii */ \
+    X(ALEA_PRIMITIVE_ELL,         ell,          7)  /* two points, length */  \
+    X(ALEA_PRIMITIVE_REC,         rec,         12)  /* base, axis, 2 axes */  \
+    X(ALEA_PRIMITIVE_WED,         wed,         12)  /* vertex, 3 edges */     \
+    X(ALEA_PRIMITIVE_RHP,         rhp,         15)  /* base, axis, 3 faces */ \
+    X(ALEA_PRIMITIVE_ARB,         arb,         30)  /* 8 corners, 6 faces */
 
-    /* Surfaces */
-    size_t ns = alea_surface_count(sys);
-    fp->surfaces = calloc(ns, sizeof(ag_surface_fp_t));
-    fp->surface_count = ns;
+#define PRIMITIVE_ENTRY(type, member, n) [type] = n,
+static const uint8_t PRIMITIVE_PARAMS[] = { PRIMITIVES(PRIMITIVE_ENTRY) };
+
+/* A libalea layout change must change the hashes on purpose (and bump
+   AG_FP_SCHEME_VERSION), so each count is checked against its member */
+#define PRIMITIVE_CHECK(type, member, n)                                      \
+    _Static_assert(sizeof(((alea_primitive_data_t*)0)->member) ==            \
+                   (n) * sizeof(double),                                      \
+                   "alea_primitive_data_t." #member " is not " #n " doubles");
+PRIMITIVES(PRIMITIVE_CHECK)
+
+/* Number of doubles to hash for a primitive type; a type not in the
+   table hashes the whole union */
+static size_t primitive_params(alea_primitive_type_t type) {
+    size_t t = (size_t)type;
+    if (t < sizeof(PRIMITIVE_PARAMS) && PRIMITIVE_PARAMS[t] > 0)
+        return PRIMITIVE_PARAMS[t];
+    return sizeof(alea_primitive_data_t) / sizeof(double);
+}
 
-    for (size_t i = 0; i < ns; i++) {
+static void fingerprint_surfaces(fp_job_t* job, size_t chunk) {
+    ag_fingerprint_set_t* fp = job->fp;
+    size_t begin = chunk * FP_CHUNK;
+    size_t end = begin + FP_CHUNK;
+    if (end > fp->surface_count) end = fp->surface_count;
+
+    for (size_t i = begin; i < end; i++) {
         int surface_id = 0;
         alea_primitive_type_t ptype = 0;
         alea_boundary_type_t btype = 0;
         alea_node_id_t pos_node = 0, neg_node = 0;
 
-        alea_surface_get(sys, i, &surface_id, &ptype, &pos_node, &neg_node, &btype);
+        alea_surface_get(job->sys, i, &surface_id, &ptype, &pos_node, &neg_node, &btype);
 
-        fp->surfaces[i].surface_id    = surface_id;
-        fp->surfaces[i].primitive_type = (int)ptype;
-        fp->surfaces[i].boundary_type  = (int)btype;
+        fp->surface_id[i]       = surface_id;
+        fp->surface_type[i]     = (int)ptype;
+        fp->surface_boundary[i] = (int)btype;
 
-        /* Hash the primitive data by treating it as an array of doubles */
+        /* Hash only the coefficients the primitive type defines */
         alea_primitive_data_t pdata;
         memset(&pdata, 0, sizeof(pdata));
-        uint64_t h = fnv_init();
-        h = fnv_int(h, (int64_t)ptype);
+        uint64_t h = ag_hash_init();
+        h = hash_int(h, (int64_t)ptype);
         if (pos_node != ALEA_NODE_ID_INVALID &&
-            alea_node_primitive_data(sys, pos_node, &pdata) == 0) {
-            /* Hash as doubles to avoid padding issues in union.
-               All primitive data structs are composed of doubles. */
-            size_t ndoubles = sizeof(pdata) / sizeof(double);
+            alea_node_primitive_data(job->sys, pos_node, &pdata) == 0) {
+            size_t ndoubles = primitive_params(ptype);
             const double* dp = (const double*)&pdata;
             for (size_t d = 0; d < ndoubles; d++)
-                h = fnv_double(h, dp[d]);
+                h = hash_double(h, dp[d]);
         }
-        fp->surfaces[i].data_hash = h;
+        fp->surface_data_hash[i] = h;
+    }
+}
+
+static void fingerprint_worker(int worker, void* arg) {
+    fp_job_t* job = arg;
+    size_t nchunks = job->cell_chunks + job->surf_chunks;
+    node_memo_t memo;
+    node_stack_t stack = { NULL, 0, 0 };
+
+    if (memo_init(&memo, 1024) < 0) {
+        /* Leave the chunks to the other workers; worker 0 must not quit */
+        memo_free(&memo);
+        if (worker == 0) atomic_store(&job->failed, true);
+        return;
     }
 
-    qsort(fp->surfaces, fp->surface_count, sizeof(ag_surface_fp_t), cmp_surface_fp);
+    for (;;) {
+        size_t k = atomic_fetch_add(&job->next, 1);
+        if (k >= nchunks) break;
+        if (k < job->cell_chunks)
+            fingerprint_cells(job, k, &memo, &stack);
+        else
+            fingerprint_surfaces(job, k - job->cell_chunks);
+    }
+
+    memo_free(&memo);
+    free(stack.items);
+}
+
+/* Concatenate the per-chunk node arrays into fp->nodes, rebasing child
+   and root indices. */
+static int merge_pools(fp_job_t* job) {
+    ag_fingerprint_set_t* fp = job->fp;
+    size_t total = 0;
+    for (size_t k = 0; k < job->cell_chunks; k++)
+        total += job->pools[k].count;
+    if (total >= AG_REGION_NONE) return -1;
+
+    fp->nodes = malloc((total ? total : 1) * sizeof(ag_region_node_t));
+    if (!fp->nodes) return -1;
+
+    uint32_t base = 0;
+    for (size_t k = 0; k < job->cell_chunks; k++) {
+        const node_pool_t* pool = &job->pools[k];
+        for (size_t i = 0; i < pool->count; i++) {
+            ag_region_node_t n = pool->items[i];
+            if (n.op != ALEA_OP_PRIMITIVE) {
+                if (n.left != AG_REGION_NONE) n.left += base;
+                if (n.right != AG_REGION_NONE) n.right += base;
+            }
+            fp->nodes[base + i] = n;
+        }
+
+        size_t end = (k + 1) * FP_CHUNK;
+        if (end > fp->cell_count) end = fp->cell_count;
+        for (size_t i = k * FP_CHUNK; i < end; i++) {
+            if (fp->cell_region_root[i] != AG_REGION_NONE)
+                fp->cell_region_root[i] += base;
+        }
+        base += (uint32_t)pool->count;
+    }
+    fp->node_count = total;
+    return 0;
+}
+
+/* Same for the per-chunk lattice pools */
+static int merge_lattices(fp_job_t* job) {
+    ag_fingerprint_set_t* fp = job->fp;
+    size_t nl = 0, nf = 0, nb = 0;
+    for (size_t k = 0; k < job->cell_chunks; k++) {
+        nl += job->lattices[k].count;
+        nf += job->lattices[k].fill_count;
+        nb += job->lattices[k].block_count;
+    }
+    if (nl >= AG_LATTICE_NONE || nf >= UINT32_MAX || nb >= UINT32_MAX) return -1;
 
+    fp->lattices = malloc((nl ? nl : 1) * sizeof(ag_lattice_fp_t));
+    fp->lattice_fill = malloc((nf ? nf : 1) * sizeof(int));
+    fp->lattice_block_hash = malloc((nb ? nb : 1) * sizeof(uint64_t));
+    if (!fp->lattices || !fp->lattice_fill || !fp->lattice_block_hash) return -1;
+
+    for (size_t k = 0; k < job->cell_chunks; k++) {
+        const lattice_pool_t* pool = &job->lattices[k];
+        uint32_t base = (uint32_t)fp->lattice_count;
+        for (size_t i = 0; i < pool->count; i++) {
+            ag_lattice_fp_t l = pool->items[i];
+            l.first_fill += (uint32_t)fp->lattice_fill_count;
+            l.first_block += (uint32_t)fp->lattice_block_count;
+            fp->lattices[base + i] = l;
+        }
+        if (pool->fill_count > 0)
+            memcpy(fp->lattice_fill + fp->lattice_fill_count, pool->fill,
+                   pool->fill_count * sizeof(int));
+        if (pool->block_count > 0)
+            memcpy(fp->lattice_block_hash + fp->lattice_block_count, pool->blocks,
+                   pool->block_count * sizeof(uint64_t));
+
+        size_t end = (k + 1) * FP_CHUNK;
+        if (end > fp->cell_count) end = fp->cell_count;
+        for (size_t i = k * FP_CHUNK; i < end; i++) {
+            if (fp->cell_lattice[i] != AG_LATTICE_NONE)
+                fp->cell_lattice[i] += base;
+        }
+        fp->lattice_count += pool->count;
+        fp->lattice_fill_count += pool->fill_count;
+        fp->lattice_block_count += pool->block_count;
+    }
+    return 0;
+}
+
+ag_fingerprint_set_t* ag_fingerprint(const alea_system_t* sys) {
+    ag_fingerprint_set_t* fp = calloc(1, sizeof(*fp));
+    if (!fp) return NULL;
+
+    size_t nc = alea_cell_count(sys);
+    size_t ns = alea_surface_count(sys);
+    if (alloc_columns(fp, nc, ns) < 0) {
+        free(fp);
+        return NULL;
+    }
+
+    fp_job_t job = {
+        .sys = sys,
+        .fp = fp,
+        .cell_chunks = (nc + FP_CHUNK - 1) / FP_CHUNK,
+        .surf_chunks = (ns + FP_CHUNK - 1) / FP_CHUNK
+    };
+    atomic_init(&job.next, 0);
+    atomic_init(&job.failed, false);
+    job.pools = calloc(job.cell_chunks ? job.cell_chunks : 1, sizeof(node_pool_t));
+    job.lattices = calloc(job.cell_chunks ? job.cell_chunks : 1, sizeof(lattice_pool_t));
+    if (!job.pools || !job.lattices) {
+        free(job.pools);
+        free(job.lattices);
+        ag_fingerprint_set_free(fp);
+        return NULL;
+    }
+
+    /* Inside another worker pool, stay on this thread */
+    size_t nchunks = job.cell_chunks + job.surf_chunks;
+    int nworkers = ag_in_worker() ? 1 : ag_thread_count();
+    if ((size_t)nworkers > nchunks) nworkers = nchunks ? (int)nchunks : 1;
+    ag_run_workers(nworkers, fingerprint_worker, &job);
+
+    bool failed = atomic_load(&job.failed) || merge_pools(&job) < 0 ||
+                  merge_lattices(&job) < 0 || build_universes(fp) < 0 ||
+                  hash_fills(fp) < 0;
+    for (size_t k = 0; k < job.cell_chunks; k++) {
+        free(job.pools[k].items);
+        free(job.lattices[k].items);
+        free(job.lattices[k].fill);
+        free(job.lattices[k].blocks);
+    }
+    free(job.pools);
+    free(job.lattices);
+    if (failed) {
+        ag_fingerprint_set_free(fp);
+        return NULL;
+    }
+
+    if (sort_set(fp) < 0 || build_universes(fp) < 0) {
+        ag_fingerprint_set_free(fp);
+        return NULL;
+    }
     return fp;
 }
 
 void ag_fingerprint_set_free(ag_fingerprint_set_t* fp) {
     if (!fp) return;
-    free(fp->cells);
-    free(fp->surfaces);
+    free(fp->columns);
+    free(fp->nodes);
+    free(fp->lattices);
+    free(fp->lattice_fill);
+    free(fp->lattice_block_hash);
+    free(fp->universes);
+    free(fp->universe_cells);
     free(fp);
 }
 
+/* ------------------------------------------------------------------ */
+/*  Serialization                                                     */
+/* ------------------------------------------------------------------ */
+
+#define FP_MAGIC "AGFP"
+#define FP_HEADER_SIZE (4 + 4 + 5 * 8)
+#define FP_CELL_SIZE   (5 * 4 + 4 * 8 + 2 * 4)
+#define FP_SURF_SIZE   (3 * 4 + 8)
+#define FP_NODE_SIZE   (8 + 3 * 4)
+#define FP_LAT_SIZE    (6 * 4 + 4)
+
+static uint8_t* put_u32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+    return p + 4;
+}
+
+static uint8_t* put_u64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+    return p + 8;
+}
+
+static uint8_t* put_f64(uint8_t* p, double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return put_u64(p, bits);
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) v |= (uint32_t)p[i] << (8 * i);
+    return v;
+}
+
+static uint64_t get_u64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+static double get_f64(const uint8_t* p) {
+    uint64_t bits = get_u64(p);
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+uint8_t* ag_fingerprint_serialize(const ag_fingerprint_set_t* fp, size_t* out_len) {
+    size_t len = FP_HEADER_SIZE + fp->cell_count * FP_CELL_SIZE
+               + fp->surface_count * FP_SURF_SIZE
+               + fp->node_count * FP_NODE_SIZE
+               + fp->lattice_count * FP_LAT_SIZE + fp->lattice_fill_count * 4;
+    uint8_t* buf = malloc(len);
+    if (!buf) return NULL;
+
+    uint8_t* p = buf;
+    memcpy(p, FP_MAGIC, 4);
+    p += 4;
+    p = put_u32(p, AG_FP_SCHEME_VERSION);
+    p = put_u64(p, fp->cell_count);
+    p = put_u64(p, fp->surface_count);
+    p = put_u64(p, fp->node_count);
+    p = put_u64(p, fp->lattice_count);
+    p = put_u64(p, fp->lattice_fill_count);
+
+    for (size_t i = 0; i < fp->cell_count; i++) {
+        p = put_u32(p, (uint32_t)fp->cell_id[i]);
+        p = put_u32(p, (uint32_t)fp->cell_material[i]);
+        p = put_u32(p, (uint32_t)fp->cell_universe[i]);
+        p = put_u32(p, (uint32_t)fp->cell_fill[i]);
+        p = put_u32(p, (uint32_t)fp->cell_lat_type[i]);
+        p = put_f64(p, fp->cell_density[i]);
+        p = put_u64(p, fp->cell_tree_hash[i]);
+        p = put_u64(p, fp->cell_lattice_hash[i]);
+        p = put_u64(p, fp->cell_fill_hash[i]);
+        p = put_u32(p, fp->cell_region_root[i]);
+        p = put_u32(p, fp->cell_lattice[i]);
+    }
+    for (size_t i = 0; i < fp->surface_count; i++) {
+        p = put_u32(p, (uint32_t)fp->surface_id[i]);
+        p = put_u32(p, (uint32_t)fp->surface_type[i]);
+        p = put_u32(p, (uint32_t)fp->surface_boundary[i]);
+        p = put_u64(p, fp->surface_data_hash[i]);
+    }
+    /* Primitives store (surface id, sense), operators (left, right) */
+    for (size_t i = 0; i < fp->node_count; i++) {
+        const ag_region_node_t* n = &fp->nodes[i];
+        bool leaf = n->op == ALEA_OP_PRIMITIVE;
+        p = put_u64(p, n->hash);
+        p = put_u32(p, (uint32_t)n->op);
+        p = put_u32(p, leaf ? (uint32_t)n->surface_id : n->left);
+        p = put_u32(p, leaf ? (uint32_t)n->sense : n->right);
+    }
+    /* Lattices in pool order, then their fill entries; block hashes are
+       recomputed on load */
+    for (size_t i = 0; i < fp->lattice_count; i++) {
+        for (int d = 0; d < 6; d++)
+            p = put_u32(p, (uint32_t)fp->lattices[i].dims[d]);
+        p = put_u32(p, fp->lattices[i].fill_count);
+    }
+    for (size_t i = 0; i < fp->lattice_fill_count; i++)
+        p = put_u32(p, (uint32_t)fp->lattice_fill[i]);
+
+    *out_len = len;
+    return buf;
+}
+
+ag_fingerprint_set_t* ag_fingerprint_deserialize(const uint8_t* data, size_t len) {
+    if (!data || len < FP_HEADER_SIZE) return NULL;
+    if (memcmp(data, FP_MAGIC, 4) != 0) return NULL;
+    if (get_u32(data + 4) != AG_FP_SCHEME_VERSION) return NULL;
+
+    uint64_t nc = get_u64(data + 8);
+    uint64_t ns = get_u64(data + 16);
+    uint64_t nn = get_u64(data + 24);
+    uint64_t nl = get_u64(data + 32);
+    uint64_t nf = get_u64(data + 40);
+    if (nc > (len - FP_HEADER_SIZE) / FP_CELL_SIZE) return NULL;
+    if (ns > (len - FP_HEADER_SIZE) / FP_SURF_SIZE) return NULL;
+    if (nn > (len - FP_HEADER_SIZE) / FP_NODE_SIZE) return NULL;
+    if (nl > (len - FP_HEADER_SIZE) / FP_LAT_SIZE) return NULL;
+    if (nf > (len - FP_HEADER_SIZE) / 4) return NULL;
+    if (len != FP_HEADER_SIZE + nc * FP_CELL_SIZE + ns * FP_SURF_SIZE
+               + nn * FP_NODE_SIZE + nl * FP_LAT_SIZE + nf * 4) return NULL;
+
+    ag_fingerprint_set_t* fp = calloc(1, sizeof(*fp));
+    if (!fp) return NULL;
+    fp->nodes = calloc(nn ? nn : 1, sizeof(ag_region_node_t));
+    if (!fp->nodes || alloc_columns(fp, nc, ns) < 0) {
+        ag_fingerprint_set_free(fp);
+        return NULL;
+    }
+    fp->node_count = nn;
+
+    const uint8_t* p = data + FP_HEADER_SIZE;
+    for (size_t i = 0; i < nc; i++, p += FP_CELL_SIZE) {
+        fp->cell_id[i]           = (int)get_u32(p);
+        fp->cell_material[i]     = (int)get_u32(p + 4);
+        fp->cell_universe[i]     = (int)get_u32(p + 8);
+        fp->cell_fill[i]         = (int)get_u32(p + 12);
+        fp->cell_lat_type[i]     = (int)get_u32(p + 16);
+        fp->cell_density[i]      = get_f64(p + 20);
+        fp->cell_tree_hash[i]    = get_u64(p + 28);
+        fp->cell_lattice_hash[i] = get_u64(p + 36);
+        fp->cell_fill_hash[i]    = get_u64(p + 44);
+        fp->cell_region_root[i]  = get_u32(p + 52);
+        fp->cell_lattice[i]      = get_u32(p + 56);
+        if (fp->cell_region_root[i] != AG_REGION_NONE && fp->cell_region_root[i] >= nn)
+            goto malformed;
+        if (fp->cell_lattice[i] != AG_LATTICE_NONE && fp->cell_lattice[i] >= nl)
+            goto malformed;
+    }
+    for (size_t i = 0; i < ns; i++, p += FP_SURF_SIZE) {
+        fp->surface_id[i]        = (int)get_u32(p);
+        fp->surface_type[i]      = (int)get_u32(p + 4);
+        fp->surface_boundary[i]  = (int)get_u32(p + 8);
+        fp->surface_data_hash[i] = get_u64(p + 12);
+    }
+    for (size_t i = 1; i < nc; i++)
+        if (fp->cell_id[i] == fp->cell_id[i - 1]) fp->dup_cell_ids++;
+    for (size_t i = 1; i < ns; i++)
+        if (fp->surface_id[i] == fp->surface_id[i - 1]) fp->dup_surface_ids++;
+
+    /* Children must precede their parent, which also rules out cycles */
+    for (size_t i = 0; i < nn; i++, p += FP_NODE_SIZE) {
+        ag_region_node_t* n = &fp->nodes[i];
+        n->hash = get_u64(p);
+        n->op   = (int32_t)get_u32(p + 8);
+        n->left = n->right = AG_REGION_NONE;
+        if (n->op == ALEA_OP_PRIMITIVE) {
+            n->surface_id = (int32_t)get_u32(p + 12);
+            n->sense      = (int32_t)get_u32(p + 16);
+        } else {
+            n->left  = get_u32(p + 12);
+            n->right = get_u32(p + 16);
+            if ((n->left != AG_REGION_NONE && n->left >= i) ||
+                (n->right != AG_REGION_NONE && n->right >= i)) goto malformed;
+        }
+    }
+
+    /* Fill counts must add up to the fill entries that follow */
+    fp->lattices = calloc(nl ? nl : 1, sizeof(ag_lattice_fp_t));
+    fp->lattice_fill = malloc((nf ? nf : 1) * sizeof(int));
+    if (!fp->lattices || !fp->lattice_fill) goto malformed;
+    uint64_t fill = 0, blocks = 0;
+    for (size_t i = 0; i < nl; i++, p += FP_LAT_SIZE) {
+        ag_lattice_fp_t* l = &fp->lattices[i];
+        for (int d = 0; d < 6; d++)
+            l->dims[d] = (int)get_u32(p + 4 * d);
+        l->fill_count = get_u32(p + 24);
+        if (l->fill_count > nf - fill) goto malformed;
+        l->first_fill = (uint32_t)fill;
+        l->first_block = (uint32_t)blocks;
+        fill += l->fill_count;
+        blocks += block_count(l->fill_count);
+    }
+    if (fill != nf) goto malformed;
+    for (size_t i = 0; i < nf; i++, p += 4)
+        fp->lattice_fill[i] = (int)get_u32(p);
+    fp->lattice_count = nl;
+    fp->lattice_fill_count = nf;
+
+    fp->lattice_block_hash = malloc((blocks ? blocks : 1) * sizeof(uint64_t));
+    if (!fp->lattice_block_hash) goto malformed;
+    for (size_t i = 0; i < nl; i++) {
+        const ag_lattice_fp_t* l = &fp->lattices[i];
+        hash_blocks(fp->lattice_fill + l->first_fill, l->fill_count,
+                    fp->lattice_block_hash + l->first_block);
+    }
+    fp->lattice_block_count = blocks;
+    if (build_universes(fp) < 0) goto malformed;
+    return fp;
+
+malformed:
+    ag_fingerprint_set_free(fp);
+    return NULL;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Row access and bulk comparison                                    */
+/* ------------------------------------------------------------------ */
+
+void ag_cell_fp_at(const ag_fingerprint_set_t* fp, size_t i, ag_cell_fp_t* out) {
+    out->cell_id       = fp->cell_id[i];
+    out->material_id   = fp->cell_material[i];
+    out->universe_id   = fp->cell_universe[i];
+    out->fill_universe = fp->cell_fill[i];
+    out->lat_type      = fp->cell_lat_type[i];
+    out->density       = fp->cell_density[i];
+    out->tree_hash     = fp->cell_tree_hash[i];
+    out->lattice_hash  = fp->cell_lattice_hash[i];
+    out->region_root   = fp->cell_region_root[i];
+    out->lattice       = fp->cell_lattice[i];
+}
+
+void ag_surface_fp_at(const ag_fingerprint_set_t* fp, size_t i, ag_surface_fp_t* out) {
+    out->surface_id     = fp->surface_id[i];
+    out->primitive_type = fp->surface_type[i];
+    out->boundary_type  = fp->surface_boundary[i];
+    out->data_hash      = fp->surface_data_hash[i];
+}
+
+/* First index of id in a sorted column, or SIZE_MAX */
+static size_t find_id(const int* ids, size_t n, int id) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ids[mid] < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < n && ids[lo] == id ? lo : SIZE_MAX;
+}
+
+size_t ag_fp_find_cell(const ag_fingerprint_set_t* fp, int cell_id) {
+    return find_id(fp->cell_id, fp->cell_count, cell_id);
+}
+
+size_t ag_fp_find_surface(const ag_fingerprint_set_t* fp, int surface_id) {
+    return find_id(fp->surface_id, fp->surface_count, surface_id);
+}
+
+size_t ag_fp_find_universe(const ag_fingerprint_set_t* fp, int universe_id) {
+    size_t lo = 0, hi = fp->universe_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (fp->universes[mid].universe_id < universe_id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < fp->universe_count && fp->universes[lo].universe_id == universe_id
+         ? lo : SIZE_MAX;
+}
+
+static bool cell_row_equal(const ag_fingerprint_set_t* a, size_t i,
+                           const ag_fingerprint_set_t* b, size_t j) {
+    return a->cell_id[i] == b->cell_id[j] &&
+           a->cell_material[i] == b->cell_material[j] &&
+           a->cell_universe[i] == b->cell_universe[j] &&
+           a->cell_fill[i] == b->cell_fill[j] &&
+           a->cell_lat_type[i] == b->cell_lat_type[j] &&
+           memcmp(&a->cell_density[i], &b->cell_density[j], sizeof(double)) == 0 &&
+           a->cell_tree_hash[i] == b->cell_tree_hash[j] &&
+           a->cell_lattice_hash[i] == b->cell_lattice_hash[j];
+}
+
+static bool surface_row_equal(const ag_fingerprint_set_t* a, size_t i,
+                              const ag_fingerprint_set_t* b, size_t j) {
+    return a->surface_id[i] == b->surface_id[j] &&
+           a->surface_type[i] == b->surface_type[j] &&
+           a->surface_boundary[i] == b->surface_boundary[j] &&
+           a->surface_data_hash[i] == b->surface_data_hash[j];
+}
+
+/* Vector kernels compare 4 rows per step: AND the equality masks of
+   every column, and stop at the first block that is not all ones. The
+   scalar tail then finds the exact end of the run. */
+#if defined(FP_SSE2)
+static __m128i eq32x4(const void* a, const void* b) {
+    return _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)a),
+                           _mm_loadu_si128((const __m128i*)b));
+}
+
+/* Two 64-bit lanes: both 32-bit halves must match */
+static __m128i eq64x2(const void* a, const void* b) {
+    __m128i m = eq32x4(a, b);
+    return _mm_and_si128(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+static bool all_ones(__m128i m) {
+    return _mm_movemask_epi8(m) == 0xFFFF;
+}
+#elif defined(FP_NEON)
+static uint32x4_t eq32x4(const void* a, const void* b) {
+    return vceqq_u32(vld1q_u32(a), vld1q_u32(b));
+}
+
+static uint32x4_t eq64x2(const void* a, const void* b) {
+    return vreinterpretq_u32_u64(vceqq_u64(vld1q_u64(a), vld1q_u64(b)));
+}
+
+static bool all_ones(uint32x4_t m) {
+    return vminvq_u32(m) == 0xFFFFFFFFU;
+}
+#endif
+
+size_t ag_cell_fp_equal_run(const ag_fingerprint_set_t* a, size_t ai,
+                            const ag_fingerprint_set_t* b, size_t bi) {
+    if (ai >= a->cell_count || bi >= b->cell_count) return 0;
+    size_t n = a->cell_count - ai;
+    if (b->cell_count - bi < n) n = b->cell_count - bi;
+    size_t k = 0;
+
+#if defined(FP_SSE2) || defined(FP_NEON)
+    for (; k + 4 <= n; k += 4) {
+        size_t i = ai + k, j = bi + k;
+        if (!all_ones(eq32x4(a->cell_id + i, b->cell_id + j))) break;
+        bool eq = all_ones(eq32x4(a->cell_material + i, b->cell_material + j)) &&
+                  all_ones(eq32x4(a->cell_universe + i, b->cell_universe + j)) &&
+                  all_ones(eq32x4(a->cell_fill + i, b->cell_fill + j)) &&
+                  all_ones(eq32x4(a->cell_lat_type + i, b->cell_lat_type + j));
+        for (size_t h = 0; eq && h < 4; h += 2) {
+            eq = all_ones(eq64x2(a->cell_tree_hash + i + h, b->cell_tree_hash + j + h)) &&
+                 all_ones(eq64x2(a->cell_lattice_hash + i + h, b->cell_lattice_hash + j + h)) &&
+                 all_ones(eq64x2(a->cell_density + i + h, b->cell_density + j + h));
+        }
+        if (!eq) break;
+    }
+#endif
+
+    while (k < n && cell_row_equal(a, ai + k, b, bi + k)) k++;
+    return k;
+}
+
+size_t ag_surface_fp_equal_run(const ag_fingerprint_set_t* a, size_t ai,
+                               const ag_fingerprint_set_t* b, size_t bi) {
+    if (ai >= a->surface_count || bi >= b->surface_count) return 0;
+    size_t n = a->surface_count - ai;
+    if (b->surface_count - bi < n) n = b->surface_count - bi;
+    size_t k = 0;
+
+#if defined(FP_SSE2) || defined(FP_NEON)
+    for (; k + 4 <= n; k += 4) {
+        size_t i = ai + k, j = bi + k;
+        if (!all_ones(eq32x4(a->surface_id + i, b->surface_id + j)) ||
+            !all_ones(eq32x4(a->surface_type + i, b->surface_type + j)) ||
+            !all_ones(eq32x4(a->surface_boundary + i, b->surface_boundary + j)) ||
+            !all_ones(eq64x2(a->surface_data_hash + i, b->surface_data_hash + j)) ||
+            !all_ones(eq64x2(a->surface_data_hash + i + 2, b->surface_data_hash + j + 2)))
+            break;
+    }
+#endif
+
+    while (k < n && surface_row_equal(a, ai + k, b, bi + k)) k++;
+    return k;
+}
+
 int ag_cell_fp_compare(const ag_cell_fp_t* a, const ag_cell_fp_t* b) {
     if (a->material_id != b->material_id) return 1;
     if (a->universe_id != b->universe_id) return 1;
@@ -197,3 +1383,214 @@ uint32_t ag_surface_fp_diff(const ag_surface_fp_t* a, const ag_surface_fp_t* b)
     if (a->boundary_type != b->boundary_type) flags |= SURF_CHG_BOUNDARY;
     return flags;
 }
+
+/* ------------------------------------------------------------------ */
+/*  Splicing                                                          */
+/* ------------------------------------------------------------------ */
+
+static bool in_sorted(const int* ids, size_t n, int id) {
+    return find_id(ids, n, id) != SIZE_MAX;
+}
+
+/* Row of the spliced set: from base (patch = false) or patch */
+typedef struct {
+    bool     patch;
+    uint32_t row;
+} splice_row_t;
+
+/* Merge base rows not dropped and not in patch with every patch row, in
+   ID order. Returns the row count, or SIZE_MAX if out of memory. */
+static size_t splice_rows(const int* base_ids, size_t nb, const int* drop, size_t ndrop,
+                          const int* patch_ids, size_t np, splice_row_t** out) {
+    splice_row_t* rows = malloc((nb + np ? nb + np : 1) * sizeof(splice_row_t));
+    if (!rows) return SIZE_MAX;
+
+    size_t n = 0, i = 0, j = 0;
+    while (i < nb || j < np) {
+        if (j == np || (i < nb && base_ids[i] < patch_ids[j])) {
+            if (!in_sorted(drop, ndrop, base_ids[i]))
+                rows[n++] = (splice_row_t){ false, (uint32_t)i };
+            i++;
+        } else {
+            if (i < nb && base_ids[i] == patch_ids[j]) i++;
+            rows[n++] = (splice_row_t){ true, (uint32_t)j++ };
+        }
+    }
+    *out = rows;
+    return n;
+}
+
+/* Copy the region nodes reachable from the kept base cells, then every
+   patch node, into out->nodes. Children precede parents in both inputs,
+   so one backward marking pass and one forward copy keep that order.
+   base_map receives each base node's new index. */
+static int splice_nodes(const ag_fingerprint_set_t* base, const ag_fingerprint_set_t* patch,
+                        const splice_row_t* rows, size_t nc, ag_fingerprint_set_t* out,
+                        uint32_t** base_map) {
+    size_t nb = base->node_count, np = patch ? patch->node_count : 0;
+    uint32_t* map = malloc((nb ? nb : 1) * sizeof(uint32_t));
+    if (!map) return -1;
+    for (size_t k = 0; k < nb; k++) map[k] = AG_REGION_NONE;
+
+    for (size_t r = 0; r < nc; r++) {
+        if (rows[r].patch) continue;
+        uint32_t root = base->cell_region_root[rows[r].row];
+        if (root != AG_REGION_NONE) map[root] = 0;
+    }
+    size_t kept = 0;
+    for (size_t k = nb; k-- > 0; ) {
+        if (map[k] == AG_REGION_NONE) continue;
+        kept++;
+        const ag_region_node_t* n = &base->nodes[k];
+        if (n->op == ALEA_OP_PRIMITIVE) continue;
+        if (n->left != AG_REGION_NONE) map[n->left] = 0;
+        if (n->right != AG_REGION_NONE) map[n->right] = 0;
+    }
+    if (kept + np >= AG_REGION_NONE) {
+        free(map);
+        return -1;
+    }
+
+    out->nodes = malloc((kept + np ? kept + np : 1) * sizeof(ag_region_node_t));
+    if (!out->nodes) {
+        free(map);
+        return -1;
+    }
+    size_t count = 0;
+    for (size_t k = 0; k < nb; k++) {
+        if (map[k] == AG_REGION_NONE) continue;
+        ag_region_node_t n = base->nodes[k];
+        if (n.op != ALEA_OP_PRIMITIVE) {
+            if (n.left != AG_REGION_NONE) n.left = map[n.left];
+            if (n.right != AG_REGION_NONE) n.right = map[n.right];
+        }
+        map[k] = (uint32_t)count;
+        out->nodes[count++] = n;
+    }
+    for (size_t k = 0; k < np; k++) {
+        ag_region_node_t n = patch->nodes[k];
+        if (n.op != ALEA_OP_PRIMITIVE) {
+            if (n.left != AG_REGION_NONE) n.left += (uint32_t)kept;
+            if (n.right != AG_REGION_NONE) n.right += (uint32_t)kept;
+        }
+        out->nodes[count++] = n;
+    }
+    out->node_count = count;
+    *base_map = map;
+    return 0;
+}
+
+/* Append one lattice of src to out, which has room for it */
+static uint32_t splice_lattice(ag_fingerprint_set_t* out, const ag_fingerprint_set_t* src,
+                               uint32_t index) {
+    const ag_lattice_fp_t* l = &src->lattices[index];
+    size_t nb = block_count(l->fill_count);
+    ag_lattice_fp_t* d = &out->lattices[out->lattice_count];
+    *d = *l;
+    d->first_fill = (uint32_t)out->lattice_fill_count;
+    d->first_block = (uint32_t)out->lattice_block_count;
+    if (l->fill_count > 0)
+        memcpy(out->lattice_fill + out->lattice_fill_count,
+               src->lattice_fill + l->first_fill, l->fill_count * sizeof(int));
+    if (nb > 0)
+        memcpy(out->lattice_block_hash + out->lattice_block_count,
+               src->lattice_block_hash + l->first_block, nb * sizeof(uint64_t));
+    out->lattice_fill_count += l->fill_count;
+    out->lattice_block_count += nb;
+    return (uint32_t)out->lattice_count++;
+}
+
+static int splice_lattices(const ag_fingerprint_set_t* base, const ag_fingerprint_set_t* patch,
+                           const splice_row_t* rows, size_t nc, ag_fingerprint_set_t* out) {
+    size_t nl = 0, nf = 0, nb = 0;
+    for (size_t r = 0; r < nc; r++) {
+        const ag_fingerprint_set_t* src = rows[r].patch ? patch : base;
+        uint32_t lat = src->cell_lattice[rows[r].row];
+        if (lat == AG_LATTICE_NONE) continue;
+        nl++;
+        nf += src->lattices[lat].fill_count;
+        nb += block_count(src->lattices[lat].fill_count);
+    }
+    if (nl >= AG_LATTICE_NONE || nf >= UINT32_MAX || nb >= UINT32_MAX) return -1;
+
+    out->lattices = malloc((nl ? nl : 1) * sizeof(ag_lattice_fp_t));
+    out->lattice_fill = malloc((nf ? nf : 1) * sizeof(int));
+    out->lattice_block_hash = malloc((nb ? nb : 1) * sizeof(uint64_t));
+    if (!out->lattices || !out->lattice_fill || !out->lattice_block_hash) return -1;
+
+    for (size_t r = 0; r < nc; r++) {
+        const ag_fingerprint_set_t* src = rows[r].patch ? patch : base;
+        uint32_t lat = src->cell_lattice[rows[r].row];
+        out->cell_lattice[r] = lat == AG_LATTICE_NONE
+                             ? AG_LATTICE_NONE : splice_lattice(out, src, lat);
+    }
+    return 0;
+}
+
+static int splice_cells(const ag_fingerprint_set_t* base, const ag_fingerprint_set_t* patch,
+                        const splice_row_t* rows, size_t nc, ag_fingerprint_set_t* out) {
+    uint32_t* map = NULL;
+    if (splice_nodes(base, patch, rows, nc, out, &map) < 0) return -1;
+    uint32_t patch_base = (uint32_t)(out->node_count - (patch ? patch->node_count : 0));
+
+    for (size_t r = 0; r < nc; r++) {
+        const ag_fingerprint_set_t* src = rows[r].patch ? patch : base;
+        size_t i = rows[r].row;
+        uint32_t root = src->cell_region_root[i];
+        if (root != AG_REGION_NONE) root = rows[r].patch ? root + patch_base : map[root];
+
+        out->cell_id[r]           = src->cell_id[i];
+        out->cell_material[r]     = src->cell_material[i];
+        out->cell_universe[r]     = src->cell_universe[i];
+        out->cell_fill[r]         = src->cell_fill[i];
+        out->cell_lat_type[r]     = src->cell_lat_type[i];
+        out->cell_density[r]      = src->cell_density[i];
+        out->cell_tree_hash[r]    = src->cell_tree_hash[i];
+        out->cell_lattice_hash[r] = src->cell_lattice_hash[i];
+        out->cell_region_root[r]  = root;
+    }
+    free(map);
+    return splice_lattices(base, patch, rows, nc, out);
+}
+
+ag_fingerprint_set_t* ag_fingerprint_splice(const ag_fingerprint_set_t* base,
+                                            const int* drop_cells, size_t ndrop_cells,
+                                            const int* drop_surfaces, size_t ndrop_surfaces,
+                                            const ag_fingerprint_set_t* patch) {
+    static const ag_fingerprint_set_t empty = { 0 };
+    if (!patch) patch = &empty;
+    if (base->dup_cell_ids || base->dup_surface_ids ||
+        patch->dup_cell_ids || patch->dup_surface_ids)
+        return NULL;
+
+    splice_row_t* crows = NULL;
+    splice_row_t* srows = NULL;
+    size_t nc = splice_rows(base->cell_id, base->cell_count, drop_cells, ndrop_cells,
+                            patch->cell_id, patch->cell_count, &crows);
+    size_t ns = nc == SIZE_MAX ? SIZE_MAX
+              : splice_rows(base->surface_id, base->surface_count, drop_surfaces,
+                            ndrop_surfaces, patch->surface_id, patch->surface_count, &srows);
+    ag_fingerprint_set_t* fp = calloc(1, sizeof(*fp));
+    bool failed = ns == SIZE_MAX || !fp || alloc_columns(fp, nc, ns) < 0 ||
+                  splice_cells(base, patch, crows, nc, fp) < 0;
+
+    for (size_t r = 0; !failed && r < ns; r++) {
+        const ag_fingerprint_set_t* src = srows[r].patch ? patch : base;
+        size_t i = srows[r].row;
+        fp->surface_id[r]        = src->surface_id[i];
+        fp->surface_type[r]      = src->surface_type[i];
+        fp->surface_boundary[r]  = src->surface_boundary[i];
+        fp->surface_data_hash[r] = src->surface_data_hash[i];
+    }
+    free(crows);
+    free(srows);
+
+    /* Fill hashes reach across universes, so the hierarchy is rebuilt
+       in the same steps as ag_fingerprint() */
+    if (failed || build_universes(fp) < 0 || hash_fills(fp) < 0 ||
+        build_universes(fp) < 0) {
+        ag_fingerprint_set_free(fp);
+        return NULL;
+    }
+    return fp;
+}
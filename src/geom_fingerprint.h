@@ -10,7 +10,42 @@
 
 typedef struct alea_system alea_system_t;
 
-/* Cell fingerprint */
+/* Fingerprint scheme version. Bump whenever hashing or the serialized
+   layout changes, so fingerprints persisted by older builds are ignored. */
+#define AG_FP_SCHEME_VERSION 6
+
+/* No region node (empty tree, or absent child) */
+#define AG_REGION_NONE UINT32_MAX
+
+/* Region-tree node of a fingerprint set. hash is the node's Merkle hash,
+   so equal hashes mean equal subtrees. Children always precede their
+   parent in the node array. */
+typedef struct {
+    uint64_t hash;
+    int32_t  op;          /* alea_operation_t */
+    int32_t  surface_id;  /* ALEA_OP_PRIMITIVE only */
+    int32_t  sense;       /* ALEA_OP_PRIMITIVE only */
+    uint32_t left;        /* operators only, AG_REGION_NONE if absent */
+    uint32_t right;
+} ag_region_node_t;
+
+/* No lattice (the cell is not a lattice) */
+#define AG_LATTICE_NONE UINT32_MAX
+
+/* Lattice fill arrays are hashed in blocks of this many entries */
+#define AG_LATTICE_BLOCK 64
+
+/* Lattice of a fingerprint set: the fill array of one lattice cell, in
+   MCNP order (i fastest, then j, then k), with one hash per block of
+   AG_LATTICE_BLOCK entries. */
+typedef struct {
+    int      dims[6];      /* lat_fill_dims: i, j and k index ranges */
+    uint32_t fill_count;
+    uint32_t first_fill;   /* into the set's lattice_fill */
+    uint32_t first_block;  /* into the set's lattice_block_hash */
+} ag_lattice_fp_t;
+
+/* Cell fingerprint (one row of a set's cell columns) */
 typedef struct {
     int     cell_id;
     int     material_id;
@@ -20,9 +55,11 @@ typedef struct {
     double  density;
     uint64_t tree_hash;
     uint64_t lattice_hash;
+    uint32_t region_root;  /* index into the set's nodes, AG_REGION_NONE if empty */
+    uint32_t lattice;      /* index into the set's lattices, AG_LATTICE_NONE if none */
 } ag_cell_fp_t;
 
-/* Surface fingerprint */
+/* Surface fingerprint (one row of a set's surface columns) */
 typedef struct {
     int     surface_id;
     int     primitive_type;
@@ -30,12 +67,60 @@ typedef struct {
     uint64_t data_hash;
 } ag_surface_fp_t;
 
-/* Fingerprint set for an entire geometry */
+/* Universe of a fingerprint set: the cells whose universe_id it is.
+   cell_hash covers those cells only; hash also covers, through each
+   cell's fill hash, every universe nested below them. Both hashes are
+   independent of cell order. */
 typedef struct {
-    ag_cell_fp_t*    cells;
-    size_t           cell_count;
-    ag_surface_fp_t* surfaces;
-    size_t           surface_count;
+    int      universe_id;
+    uint32_t first;       /* into the set's universe_cells */
+    uint32_t count;
+    uint64_t cell_hash;
+    uint64_t hash;
+} ag_universe_fp_t;
+
+/* Fingerprint set for an entire geometry, stored column-wise: one
+   64-byte aligned array per field, so bulk comparisons only touch the
+   fields they need. Cells and surfaces are sorted by ID; duplicate IDs
+   sit next to each other, in model order. */
+typedef struct {
+    size_t    cell_count;
+    int*      cell_id;
+    int*      cell_material;
+    int*      cell_universe;
+    int*      cell_fill;
+    int*      cell_lat_type;
+    double*   cell_density;
+    uint64_t* cell_tree_hash;
+    uint64_t* cell_lattice_hash;
+    uint32_t* cell_region_root;
+    uint64_t* cell_fill_hash;           /* hashes of the filling universes, 0 if none */
+    uint32_t* cell_lattice;
+
+    size_t    surface_count;
+    int*      surface_id;
+    int*      surface_type;
+    int*      surface_boundary;
+    uint64_t* surface_data_hash;
+
+    ag_region_node_t* nodes;            /* region-tree nodes shared by all cells */
+    size_t            node_count;
+    ag_lattice_fp_t*  lattices;         /* lattice cells' fill arrays */
+    size_t            lattice_count;
+    int*              lattice_fill;
+    size_t            lattice_fill_count;
+    uint64_t*         lattice_block_hash;
+    size_t            lattice_block_count;
+    size_t            dup_cell_ids;     /* cells whose ID repeats the previous one */
+    size_t            dup_surface_ids;  /* same for surfaces */
+
+    ag_universe_fp_t* universes;        /* sorted by universe_id */
+    size_t            universe_count;
+    uint32_t*         universe_cells;   /* cell indices grouped by universe, ascending */
+    uint64_t          surface_hash;     /* all surfaces */
+    uint64_t          root_hash;        /* all universes and surfaces */
+
+    void*     columns;                  /* allocation backing all columns */
 } ag_fingerprint_set_t;
 
 /* Build fingerprints for all cells and surfaces. Caller must free with ag_fingerprint_set_free(). */
@@ -43,6 +128,47 @@ ag_fingerprint_set_t* ag_fingerprint(const alea_system_t* sys);
 
 void ag_fingerprint_set_free(ag_fingerprint_set_t* fp);
 
+/* Fingerprint set of base with some elements replaced: base's cells and
+   surfaces whose IDs are in the sorted drop_cells / drop_surfaces lists
+   or appear in patch are left out, and every cell and surface of patch
+   (which may be NULL) is added. Universe, fill and set hashes are
+   recomputed, so the rows and hashes equal those of ag_fingerprint() on
+   the combined geometry. Returns NULL if either set has duplicate IDs,
+   or out of memory. */
+ag_fingerprint_set_t* ag_fingerprint_splice(const ag_fingerprint_set_t* base,
+                                            const int* drop_cells, size_t ndrop_cells,
+                                            const int* drop_surfaces, size_t ndrop_surfaces,
+                                            const ag_fingerprint_set_t* patch);
+
+/* Serialize a fingerprint set to a portable little-endian byte buffer.
+   Returns malloc'd data and sets *out_len. */
+uint8_t* ag_fingerprint_serialize(const ag_fingerprint_set_t* fp, size_t* out_len);
+
+/* Rebuild a fingerprint set from ag_fingerprint_serialize() output.
+   Returns NULL if the data is malformed or from another scheme version. */
+ag_fingerprint_set_t* ag_fingerprint_deserialize(const uint8_t* data, size_t len);
+
+/* Row i of the cell / surface columns */
+void ag_cell_fp_at(const ag_fingerprint_set_t* fp, size_t i, ag_cell_fp_t* out);
+void ag_surface_fp_at(const ag_fingerprint_set_t* fp, size_t i, ag_surface_fp_t* out);
+
+/* Index of the first cell / surface with the given ID, or SIZE_MAX */
+size_t ag_fp_find_cell(const ag_fingerprint_set_t* fp, int cell_id);
+size_t ag_fp_find_surface(const ag_fingerprint_set_t* fp, int surface_id);
+
+/* Index into fp->universes of the given universe, or SIZE_MAX */
+size_t ag_fp_find_universe(const ag_fingerprint_set_t* fp, int universe_id);
+
+/* Length of the run of cells starting at a's index ai and b's index bi
+   whose ID and every field are bit-identical on both sides. Scans the
+   columns with SSE2 or NEON where available. */
+size_t ag_cell_fp_equal_run(const ag_fingerprint_set_t* a, size_t ai,
+                            const ag_fingerprint_set_t* b, size_t bi);
+
+/* Same for surfaces */
+size_t ag_surface_fp_equal_run(const ag_fingerprint_set_t* a, size_t ai,
+                               const ag_fingerprint_set_t* b, size_t bi);
+
 /* Compare two cell fingerprints. Returns 0 if equal. */
 int ag_cell_fp_compare(const ag_cell_fp_t* a, const ag_cell_fp_t* b);
 
@@ -5,11 +5,13 @@
 #define _GNU_SOURCE
 #include "geom_load.h"
 #include "git_helpers.h"
+#include "mcnp_norm.h"
 #include "util.h"
 #include <alea.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdatomic.h>
 
 #ifdef _WIN32
 #include <io.h>
@@ -17,6 +19,9 @@
 #include <process.h>
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 
 geom_format_t ag_detect_format(const char* path, const char* data, size_t len) {
@@ -46,77 +51,238 @@ geom_format_t ag_detect_format(const char* path, const char* data, size_t len) {
     return GEOM_FORMAT_MCNP;
 }
 
-alea_system_t* ag_load_geometry_buffer(const char* data, size_t len,
-                                       geom_format_t format) {
-    if (format == GEOM_FORMAT_MCNP) {
-        return alea_load_mcnp_string(data, len);
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+/* Load OpenMC XML through an anonymous in-memory file, reachable by path
+   as /proc/self/fd/N. Sets *unavailable if memfd is not supported. */
+static alea_system_t* load_openmc_memfd(const char* data, size_t len,
+                                        bool* unavailable) {
+    int fd = memfd_create("aleagit-openmc.xml", MFD_CLOEXEC);
+    if (fd < 0) {
+        *unavailable = true;
+        return NULL;
     }
 
-    if (format == GEOM_FORMAT_OPENMC) {
-        /* OpenMC parser needs a file; write to temp */
-        char tmppath[4096];
-#ifdef _WIN32
-        const char* tmpdir = getenv("TEMP");
-        if (!tmpdir) tmpdir = getenv("TMP");
-        if (!tmpdir) tmpdir = ".";
-        snprintf(tmppath, sizeof(tmppath), "%s\\aleagit_%d.xml",
-                 tmpdir, _getpid());
-#else
-        const char* tmpdir = getenv("TMPDIR");
-        if (!tmpdir) tmpdir = "/tmp";
-        snprintf(tmppath, sizeof(tmppath), "%s/aleagit_XXXXXX.xml", tmpdir);
-        int fd = mkstemps(tmppath, 4);
-        if (fd < 0) {
-            ag_error("cannot create temp file for OpenMC load");
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = write(fd, data + off, len - off);
+        if (n <= 0) {
+            close(fd);
+            ag_error("failed to write in-memory file for OpenMC load");
             return NULL;
         }
-        close(fd);
+        off += (size_t)n;
+    }
+
+    char fdpath[64];
+    snprintf(fdpath, sizeof(fdpath), "/proc/self/fd/%d", fd);
+    alea_system_t* sys = alea_load_openmc(fdpath);
+    close(fd);
+    return sys;
+}
 #endif
-        FILE* tmpf = fopen(tmppath, "wb");
-        if (!tmpf) {
-            ag_error("cannot create temp file for OpenMC load");
-            return NULL;
-        }
-        size_t written = fwrite(data, 1, len, tmpf);
-        fclose(tmpf);
-        if (written != len) {
-            remove(tmppath);
-            ag_error("failed to write temp file");
-            return NULL;
-        }
-        alea_system_t* sys = alea_load_openmc(tmppath);
+
+/* Fallback: write to a temp file under TMPDIR (TEMP on Windows) */
+static alea_system_t* load_openmc_tempfile(const char* data, size_t len) {
+    char tmppath[4096];
+#ifdef _WIN32
+    const char* tmpdir = getenv("TEMP");
+    if (!tmpdir) tmpdir = getenv("TMP");
+    if (!tmpdir) tmpdir = ".";
+    /* pid alone is not unique once loads run on several threads */
+    static atomic_uint tmp_serial;
+    snprintf(tmppath, sizeof(tmppath), "%s\\aleagit_%d_%u.xml",
+             tmpdir, _getpid(), atomic_fetch_add(&tmp_serial, 1));
+#else
+    const char* tmpdir = getenv("TMPDIR");
+    if (!tmpdir) tmpdir = "/tmp";
+    snprintf(tmppath, sizeof(tmppath), "%s/aleagit_XXXXXX.xml", tmpdir);
+    int fd = mkstemps(tmppath, 4);
+    if (fd < 0) {
+        ag_error("cannot create temp file for OpenMC load");
+        return NULL;
+    }
+    close(fd);
+#endif
+    FILE* tmpf = fopen(tmppath, "wb");
+    if (!tmpf) {
+        ag_error("cannot create temp file for OpenMC load");
+        return NULL;
+    }
+    size_t written = fwrite(data, 1, len, tmpf);
+    fclose(tmpf);
+    if (written != len) {
         remove(tmppath);
-        return sys;
+        ag_error("failed to write temp file");
+        return NULL;
+    }
+    alea_system_t* sys = alea_load_openmc(tmppath);
+    remove(tmppath);
+    return sys;
+}
+
+/* alea_load_mcnp_string() takes a length but is not documented to stop
+   there, so it only ever sees a deck with data[len] == '\0'. A buffer
+   known to be terminated is parsed in place, anything else is copied. */
+static alea_system_t* parse_mcnp(const char* data, size_t len, bool terminated) {
+    if (terminated) return alea_load_mcnp_string(data, len);
+
+    char* deck = malloc(len + 1);
+    if (!deck) {
+        ag_error("out of memory");
+        return NULL;
+    }
+    memcpy(deck, data, len);
+    deck[len] = '\0';
+    alea_system_t* sys = alea_load_mcnp_string(deck, len);
+    free(deck);
+    return sys;
+}
+
+/* Parse the geometry-only form of an MCNP deck. Returns NULL if the
+   deck does not reduce or the reduced deck does not parse. */
+static alea_system_t* load_mcnp_geometry(const char* data, size_t len) {
+    if (getenv("ALEAGIT_FULL_PARSE")) return NULL;
+
+    size_t head;
+    size_t n = ag_mcnp_geometry_deck(data, len, NULL, &head);
+    if (n == 0 || n == len) return NULL;
+
+    char* deck = malloc(n + 1);
+    if (!deck) return NULL;
+    ag_mcnp_geometry_deck(data, len, deck, &head);
+    deck[n] = '\0';
+    alea_system_t* sys = parse_mcnp(deck, n, true);
+    free(deck);
+    return sys;
+}
+
+/* ag_load_geometry_buffer(), parsing MCNP in place when data[len] is
+   known to be '\0' */
+static alea_system_t* load_buffer(const char* data, size_t len,
+                                  geom_format_t format, ag_load_mode_t mode,
+                                  bool terminated) {
+    if (format == GEOM_FORMAT_MCNP) {
+        if (mode == AG_LOAD_GEOMETRY) {
+            alea_system_t* sys = load_mcnp_geometry(data, len);
+            if (sys) return sys;
+        }
+        return parse_mcnp(data, len, terminated);
+    }
+
+    if (format == GEOM_FORMAT_OPENMC) {
+        /* OpenMC parser needs a path; keep the bytes in memory where the
+           platform allows it */
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+        bool unavailable = false;
+        alea_system_t* sys = load_openmc_memfd(data, len, &unavailable);
+        if (!unavailable) return sys;
+#endif
+        return load_openmc_tempfile(data, len);
     }
 
     ag_error("unknown geometry format");
     return NULL;
 }
 
-alea_system_t* ag_load_geometry_file(const char* path) {
+alea_system_t* ag_load_geometry_buffer(const char* data, size_t len,
+                                       geom_format_t format,
+                                       ag_load_mode_t mode) {
+    return load_buffer(data, len, format, mode, false);
+}
+
+#ifndef _WIN32
+/* Map a regular, non-empty file read-only for one sequential pass.
+   Returns NULL if it cannot be mapped. */
+static void* map_file(const char* path, size_t* out_len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        *out_len = (size_t)st.st_size;
+        map = mmap(NULL, *out_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+    posix_madvise(map, *out_len, POSIX_MADV_SEQUENTIAL);
+    return map;
+}
+#endif
+
+static alea_system_t* load_file(const char* path, ag_load_mode_t mode) {
     geom_format_t fmt = ag_detect_format(path, NULL, 0);
     if (fmt == GEOM_FORMAT_OPENMC)
         return alea_load_openmc(path);
+
+#ifndef _WIN32
+    /* Map MCNP decks read-only and parse them in place: no stdio copy,
+       and the pages are shared with the page cache. The system zero-fills
+       the rest of the last page, so the deck is NUL-terminated unless it
+       ends exactly on a page boundary; then it is copied. */
+    size_t len;
+    void* map = map_file(path, &len);
+    if (map) {
+        long page = sysconf(_SC_PAGESIZE);
+        bool terminated = page > 0 && len % (size_t)page != 0;
+        alea_system_t* sys = load_buffer(map, len, ag_detect_format(path, map, len),
+                                         mode, terminated);
+        munmap(map, len);
+        return sys;
+    }
+#else
+    (void)mode;
+#endif
     return alea_load_mcnp(path);
 }
 
+alea_system_t* ag_load_geometry_file(const char* path) {
+    return load_file(path, AG_LOAD_FULL);
+}
+
+/* Parse a borrowed blob and release it. libgit2 does not promise a
+   terminator after the content, so an MCNP blob is parsed from a copy. */
+static alea_system_t* load_blob(ag_blob_t* b, const char* path,
+                                ag_load_mode_t mode) {
+    geom_format_t fmt = ag_detect_format(path, b->data, b->len);
+    alea_system_t* sys = ag_load_geometry_buffer(b->data, b->len, fmt, mode);
+    ag_blob_release(b);
+    return sys;
+}
+
 alea_system_t* ag_load_geometry_commit(git_repository* repo,
                                        git_commit* commit,
                                        const char* path) {
-    size_t len = 0;
-    char* data = ag_read_blob(repo, commit, path, &len);
-    if (!data) {
+    ag_blob_t b;
+    if (ag_blob_open_commit(repo, commit, path, &b) < 0) {
         ag_error("cannot read '%s' from commit", path);
         return NULL;
     }
+    return load_blob(&b, path, AG_LOAD_FULL);
+}
 
-    geom_format_t fmt = ag_detect_format(path, data, len);
-    alea_system_t* sys = ag_load_geometry_buffer(data, len, fmt);
-    free(data);
-    return sys;
+alea_system_t* ag_load_geometry_blob(git_repository* repo,
+                                     const git_oid* blob_oid,
+                                     const char* path,
+                                     ag_load_mode_t mode) {
+    ag_blob_t b;
+    if (ag_blob_open_oid(repo, blob_oid, &b) < 0) {
+        ag_error("cannot read blob for '%s'", path);
+        return NULL;
+    }
+    return load_blob(&b, path, mode);
+}
+
+alea_system_t* ag_load_geometry_staged(git_repository* repo, const char* path) {
+    ag_blob_t b;
+    if (ag_blob_open_staged(repo, path, &b) < 0) {
+        ag_error("'%s' is not staged", path);
+        return NULL;
+    }
+    return load_blob(&b, path, AG_LOAD_FULL);
 }
 
-alea_system_t* ag_load_geometry_workdir(git_repository* repo, const char* path) {
+alea_system_t* ag_load_geometry_workdir(git_repository* repo, const char* path,
+                                        ag_load_mode_t mode) {
     const char* workdir = git_repository_workdir(repo);
     if (!workdir) {
         ag_error("bare repository has no working directory");
@@ -125,5 +291,78 @@ alea_system_t* ag_load_geometry_workdir(git_repository* repo, const char* path)
 
     char fullpath[4096];
     snprintf(fullpath, sizeof(fullpath), "%s%s", workdir, path);
-    return ag_load_geometry_file(fullpath);
+    return load_file(fullpath, mode);
+}
+
+int ag_workdir_map(git_repository* repo, const char* path,
+                   const char** data, size_t* len) {
+#ifndef _WIN32
+    const char* workdir = git_repository_workdir(repo);
+    if (!workdir) return -1;
+
+    char fullpath[4096];
+    snprintf(fullpath, sizeof(fullpath), "%s%s", workdir, path);
+    void* map = map_file(fullpath, len);
+    if (!map) return -1;
+    *data = map;
+    return 0;
+#else
+    (void)repo; (void)path; (void)data; (void)len;
+    return -1;
+#endif
+}
+
+void ag_workdir_unmap(const char* data, size_t len) {
+#ifndef _WIN32
+    munmap((void*)data, len);
+#else
+    (void)data; (void)len;
+#endif
+}
+
+/* ------------------------------------------------------------------ */
+/*  Normalized text hashes                                            */
+/* ------------------------------------------------------------------ */
+
+static int buffer_text_hash(const char* data, size_t len, const char* path,
+                            uint64_t* out) {
+    if (ag_detect_format(path, data, len) != GEOM_FORMAT_MCNP) return -1;
+    return ag_mcnp_geometry_hash(data, len, out);
+}
+
+static int blob_text_hash(ag_blob_t* b, const char* path, uint64_t* out) {
+    int rc = buffer_text_hash(b->data, b->len, path, out);
+    ag_blob_release(b);
+    return rc;
+}
+
+int ag_geometry_text_hash_blob(git_repository* repo, const git_oid* blob_oid,
+                               const char* path, uint64_t* out) {
+    ag_blob_t b;
+    if (ag_blob_open_oid(repo, blob_oid, &b) < 0) return -1;
+    return blob_text_hash(&b, path, out);
+}
+
+int ag_geometry_text_hash_commit(git_repository* repo, git_commit* commit,
+                                 const char* path, uint64_t* out) {
+    ag_blob_t b;
+    if (ag_blob_open_commit(repo, commit, path, &b) < 0) return -1;
+    return blob_text_hash(&b, path, out);
+}
+
+int ag_geometry_text_hash_staged(git_repository* repo, const char* path,
+                                 uint64_t* out) {
+    ag_blob_t b;
+    if (ag_blob_open_staged(repo, path, &b) < 0) return -1;
+    return blob_text_hash(&b, path, out);
+}
+
+int ag_geometry_text_hash_workdir(git_repository* repo, const char* path,
+                                  uint64_t* out) {
+    const char* data;
+    size_t len;
+    if (ag_workdir_map(repo, path, &data, &len) < 0) return -1;
+    int rc = buffer_text_hash(data, len, path, out);
+    ag_workdir_unmap(data, len);
+    return rc;
 }
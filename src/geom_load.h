@@ -8,13 +8,27 @@
 #include "aleagit.h"
 #include <git2.h>
 
+/* How much of a deck to parse. AG_LOAD_GEOMETRY is enough for
+   fingerprints: MCNP decks are cut down to their cell and surface
+   blocks plus the geometry data cards (ag_mcnp_geometry_deck()), and
+   materials, tallies and source cards are never parsed. Decks that do
+   not reduce, or whose reduced form fails to parse, are loaded in
+   full, as is every other format. Set ALEAGIT_FULL_PARSE=1 to always
+   load in full. */
+typedef enum {
+    AG_LOAD_FULL,
+    AG_LOAD_GEOMETRY
+} ag_load_mode_t;
+
 /* Detect format from filename and/or content */
 geom_format_t ag_detect_format(const char* path, const char* data, size_t len);
 
-/* Load geometry from an in-memory buffer.
-   Returns a new alea_system_t* or NULL on error. */
+/* Load geometry from an in-memory buffer. data need not be
+   NUL-terminated: an MCNP deck is copied into a terminated buffer before
+   it reaches the parser. Returns a new alea_system_t* or NULL on error. */
 alea_system_t* ag_load_geometry_buffer(const char* data, size_t len,
-                                       geom_format_t format);
+                                       geom_format_t format,
+                                       ag_load_mode_t mode);
 
 /* Load geometry from a file path on disk. */
 alea_system_t* ag_load_geometry_file(const char* path);
@@ -24,7 +38,37 @@ alea_system_t* ag_load_geometry_commit(git_repository* repo,
                                        git_commit* commit,
                                        const char* path);
 
+/* Load geometry from a blob by object id. The path is only used for
+   format detection. */
+alea_system_t* ag_load_geometry_blob(git_repository* repo,
+                                     const git_oid* blob_oid,
+                                     const char* path,
+                                     ag_load_mode_t mode);
+
+/* Load geometry from the index (staged content). */
+alea_system_t* ag_load_geometry_staged(git_repository* repo, const char* path);
+
 /* Load geometry from the working tree (on disk, relative to repo root). */
-alea_system_t* ag_load_geometry_workdir(git_repository* repo, const char* path);
+alea_system_t* ag_load_geometry_workdir(git_repository* repo, const char* path,
+                                        ag_load_mode_t mode);
+
+/* Map a working-tree file read-only. Returns 0 and sets *data and *len,
+   or -1 if it cannot be mapped (always on Windows). Release with
+   ag_workdir_unmap(). */
+int ag_workdir_map(git_repository* repo, const char* path,
+                   const char** data, size_t* len);
+void ag_workdir_unmap(const char* data, size_t len);
+
+/* Normalized text hash (ag_mcnp_geometry_hash()) of a file from the same
+   sources, without parsing it. Return 0 and set *out, or -1 if the file
+   cannot be read or is not an MCNP deck that normalizes. */
+int ag_geometry_text_hash_blob(git_repository* repo, const git_oid* blob_oid,
+                               const char* path, uint64_t* out);
+int ag_geometry_text_hash_commit(git_repository* repo, git_commit* commit,
+                                 const char* path, uint64_t* out);
+int ag_geometry_text_hash_staged(git_repository* repo, const char* path,
+                                 uint64_t* out);
+int ag_geometry_text_hash_workdir(git_repository* repo, const char* path,
+                                  uint64_t* out);
 
 #endif /* ALEAGIT_GEOM_LOAD_H */
@@ -3,6 +3,7 @@
 // SPDX-License-Identifier: MPL-2.0
 
 #include "git_helpers.h"
+#include "commit_graph.h"
 #include "util.h"
 #include "aleagit.h"
 #include <stdlib.h>
@@ -19,6 +20,14 @@ git_repository* ag_repo_open(void) {
     return repo;
 }
 
+git_repository* ag_repo_reopen(git_repository* repo) {
+    const char* workdir = git_repository_workdir(repo);
+    git_repository* other = NULL;
+    if (git_repository_open(&other, workdir ? workdir : git_repository_path(repo)) < 0)
+        return NULL;
+    return other;
+}
+
 git_commit* ag_resolve_commit(git_repository* repo, const char* spec) {
     git_object* obj = NULL;
     int err = git_revparse_single(&obj, repo, spec);
@@ -39,68 +48,76 @@ git_commit* ag_resolve_commit(git_repository* repo, const char* spec) {
     return commit;
 }
 
-char* ag_read_blob(git_repository* repo, git_commit* commit,
-                   const char* path, size_t* out_len) {
-    git_tree* tree = NULL;
-    if (git_commit_tree(&tree, commit) < 0) return NULL;
+int ag_blob_open_oid(git_repository* repo, const git_oid* blob_oid,
+                     ag_blob_t* out) {
+    memset(out, 0, sizeof(*out));
+    if (git_blob_lookup(&out->blob, repo, blob_oid) < 0) return -1;
+    out->data = git_blob_rawcontent(out->blob);
+    out->len = (size_t)git_blob_rawsize(out->blob);
+    return 0;
+}
 
-    git_tree_entry* entry = NULL;
-    int err = git_tree_entry_bypath(&entry, tree, path);
-    if (err < 0) {
-        git_tree_free(tree);
-        return NULL;
-    }
+int ag_blob_open_commit(git_repository* repo, git_commit* commit,
+                        const char* path, ag_blob_t* out) {
+    git_oid blob_oid;
+    memset(out, 0, sizeof(*out));
+    if (ag_commit_blob_oid(repo, commit, path, &blob_oid) < 0) return -1;
+    return ag_blob_open_oid(repo, &blob_oid, out);
+}
 
-    git_blob* blob = NULL;
-    err = git_blob_lookup(&blob, repo, git_tree_entry_id(entry));
-    git_tree_entry_free(entry);
-    git_tree_free(tree);
-    if (err < 0) return NULL;
+int ag_blob_open_staged(git_repository* repo, const char* path, ag_blob_t* out) {
+    git_oid blob_oid;
+    memset(out, 0, sizeof(*out));
+    if (ag_staged_blob_oid(repo, path, &blob_oid) < 0) return -1;
+    return ag_blob_open_oid(repo, &blob_oid, out);
+}
 
-    size_t len = git_blob_rawsize(blob);
-    char* data = malloc(len + 1);
-    if (!data) {
-        git_blob_free(blob);
-        return NULL;
+void ag_blob_release(ag_blob_t* b) {
+    if (b->blob) git_blob_free(b->blob);
+    memset(b, 0, sizeof(*b));
+}
+
+/* Copy a borrowed blob into a NUL-terminated malloc'd buffer */
+static char* blob_copy(ag_blob_t* b, size_t* out_len) {
+    char* data = malloc(b->len + 1);
+    if (data) {
+        memcpy(data, b->data, b->len);
+        data[b->len] = '\0';
+        *out_len = b->len;
     }
-    memcpy(data, git_blob_rawcontent(blob), len);
-    data[len] = '\0';
-    *out_len = len;
-    git_blob_free(blob);
+    ag_blob_release(b);
     return data;
 }
 
+char* ag_read_blob(git_repository* repo, git_commit* commit,
+                   const char* path, size_t* out_len) {
+    ag_blob_t b;
+    if (ag_blob_open_commit(repo, commit, path, &b) < 0) return NULL;
+    return blob_copy(&b, out_len);
+}
+
 char* ag_read_staged_blob(git_repository* repo, const char* path,
                           size_t* out_len) {
+    ag_blob_t b;
+    if (ag_blob_open_staged(repo, path, &b) < 0) return NULL;
+    return blob_copy(&b, out_len);
+}
+
+int ag_staged_blob_oid(git_repository* repo, const char* path, git_oid* out) {
     git_index* index = NULL;
-    if (git_repository_index(&index, repo) < 0) return NULL;
+    if (git_repository_index(&index, repo) < 0) return -1;
 
     const git_index_entry* entry = git_index_get_bypath(index, path, 0);
     if (!entry) {
         git_index_free(index);
-        return NULL;
+        return -1;
     }
-
-    git_blob* blob = NULL;
-    int err = git_blob_lookup(&blob, repo, &entry->id);
+    git_oid_cpy(out, &entry->id);
     git_index_free(index);
-    if (err < 0) return NULL;
-
-    size_t len = git_blob_rawsize(blob);
-    char* data = malloc(len + 1);
-    if (!data) {
-        git_blob_free(blob);
-        return NULL;
-    }
-    memcpy(data, git_blob_rawcontent(blob), len);
-    data[len] = '\0';
-    *out_len = len;
-    git_blob_free(blob);
-    return data;
+    return 0;
 }
 
-/* Check if a path looks like a geometry file */
-static bool is_geometry_file(const char* path) {
+bool ag_is_geometry_file(const char* path) {
     for (int i = 0; GEOM_EXTENSIONS[i]; i++) {
         if (ag_str_ends_with(path, GEOM_EXTENSIONS[i]))
             return true;
@@ -125,7 +142,7 @@ static int tree_walk_cb(const char* root, const git_tree_entry* entry,
     char path[1024];
     snprintf(path, sizeof(path), "%s%s", root, git_tree_entry_name(entry));
 
-    if (is_geometry_file(path))
+    if (ag_is_geometry_file(path))
         file_list_add(list, path);
     return 0;
 }
@@ -167,7 +184,7 @@ ag_file_list_t* ag_find_geometry_files_workdir(git_repository* repo) {
         const char* path = se->index_to_workdir ? se->index_to_workdir->new_file.path
                          : se->head_to_index   ? se->head_to_index->new_file.path
                          : NULL;
-        if (path && is_geometry_file(path)) {
+        if (path && ag_is_geometry_file(path)) {
             /* Check for duplicates */
             bool dup = false;
             for (size_t j = 0; j < list->count; j++) {
@@ -181,6 +198,40 @@ ag_file_list_t* ag_find_geometry_files_workdir(git_repository* repo) {
     return list;
 }
 
+git_diff* ag_diff_trees(git_repository* repo, git_commit* c1, git_commit* c2,
+                        const char* path) {
+    git_tree* t1 = NULL;
+    git_tree* t2 = NULL;
+    git_diff* diff = NULL;
+
+    if (git_commit_tree(&t1, c1) < 0) goto done;
+    if (c2 && git_commit_tree(&t2, c2) < 0) goto done;
+
+    git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+    /* Blob contents are never needed to build the delta list */
+    opts.flags = GIT_DIFF_SKIP_BINARY_CHECK;
+    char* pathspec[1];
+    if (path) {
+        pathspec[0] = (char*)path;
+        opts.pathspec.strings = pathspec;
+        opts.pathspec.count = 1;
+        opts.flags |= GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+    }
+
+    int err = c2 ? git_diff_tree_to_tree(&diff, repo, t1, t2, &opts)
+                 : git_diff_tree_to_workdir_with_index(&diff, repo, t1, &opts);
+    if (err < 0) {
+        const git_error* e = git_error_last();
+        ag_error("cannot diff trees: %s", e ? e->message : "unknown error");
+        diff = NULL;
+    }
+
+done:
+    if (t1) git_tree_free(t1);
+    if (t2) git_tree_free(t2);
+    return diff;
+}
+
 void ag_file_list_free(ag_file_list_t* list) {
     if (!list) return;
     for (size_t i = 0; i < list->count; i++)
@@ -189,9 +240,8 @@ void ag_file_list_free(ag_file_list_t* list) {
     free(list);
 }
 
-/* Get the blob OID for a file at a given commit */
-static int get_blob_oid(git_repository* repo, git_commit* commit,
-                        const char* path, git_oid* out) {
+int ag_commit_blob_oid(git_repository* repo, git_commit* commit,
+                       const char* path, git_oid* out) {
     (void)repo;
     git_tree* tree = NULL;
     if (git_commit_tree(&tree, commit) < 0) return -1;
@@ -208,49 +258,100 @@ static int get_blob_oid(git_repository* repo, git_commit* commit,
     return 0;
 }
 
-int ag_walk_history(git_repository* repo, const char* path,
-                    ag_history_cb callback, void* payload) {
-    git_revwalk* walker = NULL;
-    if (git_revwalk_new(&walker, repo) < 0) return -1;
+struct ag_history_iter {
+    git_repository*    repo;
+    git_revwalk*       walker;
+    char*              path;
+    ag_commit_graph_t* graph;          /* NULL without Bloom filters */
+    git_oid            prev_blob_oid;
+    bool               have_prev;
+    git_oid            same_commit;    /* known to match the last visited */
+    bool               have_same;
+};
+
+ag_history_iter_t* ag_history_iter_new(git_repository* repo, const char* path) {
+    ag_history_iter_t* it = calloc(1, sizeof(ag_history_iter_t));
+    if (!it) return NULL;
+
+    it->repo = repo;
+    it->path = ag_strdup(path);
+    if (!it->path || git_revwalk_new(&it->walker, repo) < 0) {
+        free(it->path);
+        free(it);
+        return NULL;
+    }
+
+    git_revwalk_sorting(it->walker, GIT_SORT_TIME);
+    git_revwalk_push_head(it->walker);
 
-    git_revwalk_sorting(walker, GIT_SORT_TIME);
-    git_revwalk_push_head(walker);
+    if (!getenv("ALEAGIT_NO_COMMIT_GRAPH"))
+        it->graph = ag_commit_graph_open(repo);
+    return it;
+}
 
+int ag_history_iter_next(ag_history_iter_t* it, git_commit** out_commit,
+                         git_oid* out_blob_oid) {
     git_oid oid;
-    git_oid prev_blob_oid;
-    bool have_prev = false;
+    while (git_revwalk_next(&oid, it->walker) == 0) {
+        /* When the last visited commit's Bloom filter ruled out a change
+           to the path and this is its first parent, the file is in the
+           same state here: no tree descent needed. */
+        bool same = it->have_same && git_oid_cmp(&oid, &it->same_commit) == 0;
+        it->have_same = it->graph &&
+            ag_commit_graph_same_as_parent(it->graph, &oid, it->path,
+                                           &it->same_commit);
+        if (same) continue;
 
-    while (git_revwalk_next(&oid, walker) == 0) {
         git_commit* commit = NULL;
-        if (git_commit_lookup(&commit, repo, &oid) < 0) continue;
+        if (git_commit_lookup(&commit, it->repo, &oid) < 0) continue;
 
         git_oid blob_oid;
-        int found = get_blob_oid(repo, commit, path, &blob_oid);
+        int found = ag_commit_blob_oid(it->repo, commit, it->path, &blob_oid);
 
         if (found < 0) {
-            /* File doesn't exist at this commit */
-            if (have_prev) {
-                /* File was deleted/added boundary */
-                have_prev = false;
-            }
+            /* File doesn't exist at this commit: deleted/added boundary */
+            it->have_prev = false;
             git_commit_free(commit);
             continue;
         }
 
-        if (!have_prev || git_oid_cmp(&blob_oid, &prev_blob_oid) != 0) {
-            int ret = callback(commit, path, &blob_oid, payload);
-            if (ret != 0) {
-                git_commit_free(commit);
-                break;
-            }
+        bool changed = !it->have_prev ||
+                       git_oid_cmp(&blob_oid, &it->prev_blob_oid) != 0;
+        git_oid_cpy(&it->prev_blob_oid, &blob_oid);
+        it->have_prev = true;
+
+        if (changed) {
+            *out_commit = commit;
+            git_oid_cpy(out_blob_oid, &blob_oid);
+            return 0;
         }
+        git_commit_free(commit);
+    }
+    return 1;
+}
+
+void ag_history_iter_free(ag_history_iter_t* it) {
+    if (!it) return;
+    git_revwalk_free(it->walker);
+    ag_commit_graph_free(it->graph);
+    free(it->path);
+    free(it);
+}
 
-        git_oid_cpy(&prev_blob_oid, &blob_oid);
-        have_prev = true;
+int ag_walk_history(git_repository* repo, const char* path,
+                    ag_history_cb callback, void* payload) {
+    ag_history_iter_t* it = ag_history_iter_new(repo, path);
+    if (!it) return -1;
+
+    git_commit* commit = NULL;
+    git_oid blob_oid;
+    while (ag_history_iter_next(it, &commit, &blob_oid) == 0) {
+        int ret = callback(commit, path, &blob_oid, payload);
         git_commit_free(commit);
+        if (ret != 0) break;
     }
 
-    git_revwalk_free(walker);
+    ag_history_iter_free(it);
     return 0;
 }
 
@@ -12,10 +12,35 @@
 /* Open repository at or above CWD. Caller must git_repository_free(). */
 git_repository* ag_repo_open(void);
 
+/* Open a second handle on the same repository, for use on another
+   thread (libgit2 objects must not be shared across threads).
+   Caller must git_repository_free(). Returns NULL on error. */
+git_repository* ag_repo_reopen(git_repository* repo);
+
 /* Resolve a revision spec ("HEAD", "HEAD~3", sha, branch) to a commit.
    Caller must git_commit_free(). Returns NULL on error. */
 git_commit* ag_resolve_commit(git_repository* repo, const char* spec);
 
+/* Borrowed view of a blob's content. data points into libgit2's copy of
+   the object and stays valid until ag_blob_release(); it is not
+   guaranteed to be NUL-terminated. */
+typedef struct {
+    git_blob*   blob;
+    const char* data;
+    size_t      len;
+} ag_blob_t;
+
+/* Open a blob by object id, by path at a commit, or by path in the
+   index. Return 0 on success, -1 if it does not exist. */
+int ag_blob_open_oid(git_repository* repo, const git_oid* blob_oid,
+                     ag_blob_t* out);
+int ag_blob_open_commit(git_repository* repo, git_commit* commit,
+                        const char* path, ag_blob_t* out);
+int ag_blob_open_staged(git_repository* repo, const char* path, ag_blob_t* out);
+
+/* Drop the reference taken by ag_blob_open_*(). */
+void ag_blob_release(ag_blob_t* b);
+
 /* Read file content from a specific commit. Returns malloc'd buffer.
    Sets *out_len to the size. Returns NULL if file not found. */
 char* ag_read_blob(git_repository* repo, git_commit* commit,
@@ -26,6 +51,18 @@ char* ag_read_blob(git_repository* repo, git_commit* commit,
 char* ag_read_staged_blob(git_repository* repo, const char* path,
                           size_t* out_len);
 
+/* Get the blob OID of a file at a commit. Returns 0 on success,
+   -1 if the file does not exist there. */
+int ag_commit_blob_oid(git_repository* repo, git_commit* commit,
+                       const char* path, git_oid* out);
+
+/* Get the blob OID of a file in the index (staged).
+   Returns 0 on success, -1 if the path is not staged. */
+int ag_staged_blob_oid(git_repository* repo, const char* path, git_oid* out);
+
+/* Check if a path has a recognized geometry file extension. */
+bool ag_is_geometry_file(const char* path);
+
 /* Geometry file list */
 typedef struct {
     char** paths;
@@ -42,6 +79,13 @@ ag_file_list_t* ag_find_geometry_files_workdir(git_repository* repo);
 
 void ag_file_list_free(ag_file_list_t* list);
 
+/* Tree-level diff between c1 and c2, or between c1 and the working tree
+   (through the index) when c2 is NULL. Only paths whose blob OIDs differ
+   are reported. If path is non-NULL, only that exact path is considered.
+   Caller must git_diff_free(). Returns NULL on error. */
+git_diff* ag_diff_trees(git_repository* repo, git_commit* c1, git_commit* c2,
+                        const char* path);
+
 /* History walking callback. Return 0 to continue, non-zero to stop. */
 typedef int (*ag_history_cb)(git_commit* commit, const char* path,
                              const git_oid* blob_oid, void* payload);
@@ -50,6 +94,20 @@ typedef int (*ag_history_cb)(git_commit* commit, const char* path,
 int ag_walk_history(git_repository* repo, const char* path,
                     ag_history_cb callback, void* payload);
 
+/* Iterator over the same commits ag_walk_history visits: newest first,
+   only where the file's blob OID differs from the previously visited
+   commit. */
+typedef struct ag_history_iter ag_history_iter_t;
+
+ag_history_iter_t* ag_history_iter_new(git_repository* repo, const char* path);
+
+/* Next commit that changed the file. Returns 0 and sets *out_commit
+   (caller must git_commit_free()) and *out_blob_oid, or 1 at the end. */
+int ag_history_iter_next(ag_history_iter_t* it, git_commit** out_commit,
+                         git_oid* out_blob_oid);
+
+void ag_history_iter_free(ag_history_iter_t* it);
+
 /* Get short sha string (caller must free). */
 char* ag_short_oid(const git_oid* oid);
 
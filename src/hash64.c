@@ -0,0 +1,211 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+#include "hash64.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HASH_AVX2 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__) && \
+      defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define HASH_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* wyhash primes */
+#define P0 0xa0761d6478bd642fULL
+#define P1 0xe7037ed1a0b428dbULL
+#define P2 0x8ebc6af09c88c6e3ULL
+#define P3 0x589965cc75374cc3ULL
+
+#define PRIME32 0x9E3779B1U
+
+/* Bulk kernel: 32-byte stripes over 4 lanes, scrambled every 16 stripes */
+#define STRIPE_SIZE      32
+#define SCRAMBLE_STRIPES 16
+
+static const uint64_t LANE_KEY[4] = {
+    0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL,
+    0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL
+};
+
+static const uint64_t SCRAMBLE_KEY[4] = {
+    0x78e5c0cc4ee679cbULL, 0x2172ffcc7dd05a82ULL,
+    0x8e2443f7744608b8ULL, 0x4c263a81e69035e0ULL
+};
+
+/* 64x64 -> 128 multiply, folded to 64 bits */
+static uint64_t mum(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 r = (unsigned __int128)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+    uint64_t ha = a >> 32, la = (uint32_t)a, hb = b >> 32, lb = (uint32_t)b;
+    uint64_t hh = ha * hb, hl = ha * lb, lh = la * hb, ll = la * lb;
+    uint64_t mid = (ll >> 32) + (uint32_t)hl + (uint32_t)lh;
+    uint64_t lo = (mid << 32) | (uint32_t)ll;
+    uint64_t hi = hh + (hl >> 32) + (lh >> 32) + (mid >> 32);
+    return lo ^ hi;
+#endif
+}
+
+static uint64_t read_u64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+uint64_t ag_hash_init(void) {
+    return 0x243f6a8885a308d3ULL;
+}
+
+uint64_t ag_hash_u64(uint64_t h, uint64_t v) {
+    return mum(h ^ P1, v ^ P2);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Striped accumulator                                               */
+/* ------------------------------------------------------------------ */
+
+/* Per stripe, lane i takes word v: acc[i] += lo32(v ^ key) * hi32(v ^ key)
+   and acc[i ^ 1] += v. Every SCRAMBLE_STRIPES stripes each lane is
+   scrambled: acc ^= acc >> 47, acc ^= key, acc *= PRIME32. */
+
+static void accumulate_scalar(uint64_t acc[4], const uint8_t* p, size_t stripes) {
+    for (size_t s = 0; s < stripes; s++, p += STRIPE_SIZE) {
+        for (int i = 0; i < 4; i++) {
+            uint64_t v = read_u64(p + 8 * i);
+            uint64_t dk = v ^ LANE_KEY[i];
+            acc[i ^ 1] += v;
+            acc[i] += (dk & 0xffffffffULL) * (dk >> 32);
+        }
+        if ((s + 1) % SCRAMBLE_STRIPES == 0) {
+            for (int i = 0; i < 4; i++) {
+                uint64_t a = acc[i];
+                a ^= a >> 47;
+                a ^= SCRAMBLE_KEY[i];
+                acc[i] = a * PRIME32;
+            }
+        }
+    }
+}
+
+#ifdef HASH_AVX2
+__attribute__((target("avx2")))
+static void accumulate_avx2(uint64_t acc[4], const uint8_t* p, size_t stripes) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)acc);
+    const __m256i key   = _mm256_loadu_si256((const __m256i*)LANE_KEY);
+    const __m256i skey  = _mm256_loadu_si256((const __m256i*)SCRAMBLE_KEY);
+    const __m256i prime = _mm256_set1_epi32((int)PRIME32);
+
+    for (size_t s = 0; s < stripes; s++, p += STRIPE_SIZE) {
+        __m256i v    = _mm256_loadu_si256((const __m256i*)p);
+        __m256i dk   = _mm256_xor_si256(v, key);
+        __m256i prod = _mm256_mul_epu32(dk, _mm256_srli_epi64(dk, 32));
+        __m256i swap = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+        a = _mm256_add_epi64(a, _mm256_add_epi64(prod, swap));
+
+        if ((s + 1) % SCRAMBLE_STRIPES == 0) {
+            a = _mm256_xor_si256(a, _mm256_srli_epi64(a, 47));
+            a = _mm256_xor_si256(a, skey);
+            __m256i lo = _mm256_mul_epu32(a, prime);
+            __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), prime);
+            a = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+        }
+    }
+    _mm256_storeu_si256((__m256i*)acc, a);
+}
+#endif
+
+#ifdef HASH_NEON
+static void accumulate_neon(uint64_t acc[4], const uint8_t* p, size_t stripes) {
+    uint64x2_t a[2]    = { vld1q_u64(acc), vld1q_u64(acc + 2) };
+    const uint64x2_t key[2]  = { vld1q_u64(LANE_KEY), vld1q_u64(LANE_KEY + 2) };
+    const uint64x2_t skey[2] = { vld1q_u64(SCRAMBLE_KEY), vld1q_u64(SCRAMBLE_KEY + 2) };
+    const uint32x2_t prime   = vdup_n_u32(PRIME32);
+
+    for (size_t s = 0; s < stripes; s++, p += STRIPE_SIZE) {
+        for (int k = 0; k < 2; k++) {
+            uint64x2_t v    = vreinterpretq_u64_u8(vld1q_u8(p + 16 * k));
+            uint64x2_t dk   = veorq_u64(v, key[k]);
+            uint64x2_t prod = vmull_u32(vmovn_u64(dk), vshrn_n_u64(dk, 32));
+            a[k] = vaddq_u64(a[k], vaddq_u64(prod, vextq_u64(v, v, 1)));
+        }
+        if ((s + 1) % SCRAMBLE_STRIPES == 0) {
+            for (int k = 0; k < 2; k++) {
+                uint64x2_t x = veorq_u64(a[k], vshrq_n_u64(a[k], 47));
+                x = veorq_u64(x, skey[k]);
+                uint64x2_t lo = vmull_u32(vmovn_u64(x), prime);
+                uint64x2_t hi = vmull_u32(vshrn_n_u64(x, 32), prime);
+                a[k] = vaddq_u64(lo, vshlq_n_u64(hi, 32));
+            }
+        }
+    }
+    vst1q_u64(acc, a[0]);
+    vst1q_u64(acc + 2, a[1]);
+}
+#endif
+
+typedef void (*accumulate_fn)(uint64_t acc[4], const uint8_t* p, size_t stripes);
+
+enum { KERNEL_UNSET = 0, KERNEL_SCALAR, KERNEL_AVX2, KERNEL_NEON };
+
+static atomic_int kernel_choice;
+
+/* Resolved once; a racing first call just picks the same kernel twice */
+static accumulate_fn kernel(void) {
+    int k = atomic_load_explicit(&kernel_choice, memory_order_relaxed);
+    if (k == KERNEL_UNSET) {
+        k = KERNEL_SCALAR;
+        if (!getenv("ALEAGIT_NO_SIMD")) {
+#if defined(HASH_AVX2)
+            if (__builtin_cpu_supports("avx2")) k = KERNEL_AVX2;
+#elif defined(HASH_NEON)
+            k = KERNEL_NEON;
+#endif
+        }
+        atomic_store_explicit(&kernel_choice, k, memory_order_relaxed);
+    }
+    switch (k) {
+#ifdef HASH_AVX2
+        case KERNEL_AVX2: return accumulate_avx2;
+#endif
+#ifdef HASH_NEON
+        case KERNEL_NEON: return accumulate_neon;
+#endif
+        default: return accumulate_scalar;
+    }
+}
+
+uint64_t ag_hash_bytes(uint64_t h, const void* data, size_t len) {
+    const uint8_t* p = data;
+    size_t n = len;
+
+    /* Whole stripes through the bulk kernel, folded into h */
+    size_t stripes = n / STRIPE_SIZE;
+    if (stripes > 1) {
+        uint64_t acc[4] = { h ^ P0, h ^ P1, h ^ P2, h ^ P3 };
+        kernel()(acc, p, stripes);
+        h = ag_hash_u64(h, mum(acc[0] ^ P0, acc[1] ^ P1));
+        h = ag_hash_u64(h, mum(acc[2] ^ P2, acc[3] ^ P3));
+        p += stripes * STRIPE_SIZE;
+        n -= stripes * STRIPE_SIZE;
+    }
+
+    /* Remaining words, then a zero-padded partial word */
+    for (; n >= 8; p += 8, n -= 8)
+        h = ag_hash_u64(h, read_u64(p));
+    if (n > 0) {
+        uint8_t tail[8] = { 0 };
+        memcpy(tail, p, n);
+        h = ag_hash_u64(h, read_u64(tail));
+    }
+    return ag_hash_u64(h, (uint64_t)len);
+}
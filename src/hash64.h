@@ -0,0 +1,26 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+#ifndef ALEAGIT_HASH64_H
+#define ALEAGIT_HASH64_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* 64-bit word-at-a-time hash used by the fingerprint scheme. Words are
+   absorbed with a wyhash-style 128-bit multiply-fold; byte buffers are
+   run through an XXH3-style 4-lane striped accumulator, vectorized with
+   AVX2 or NEON when available. Every code path yields the same value.
+   Set ALEAGIT_NO_SIMD=1 to force the scalar kernel. */
+
+/* Initial state; also the hash of an empty structure */
+uint64_t ag_hash_init(void);
+
+/* Absorb one 64-bit word */
+uint64_t ag_hash_u64(uint64_t h, uint64_t v);
+
+/* Absorb a byte buffer (length included) */
+uint64_t ag_hash_bytes(uint64_t h, const void* data, size_t len);
+
+#endif /* ALEAGIT_HASH64_H */
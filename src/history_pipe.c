@@ -0,0 +1,212 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+#define _POSIX_C_SOURCE 200809L
+#include "history_pipe.h"
+#include "git_helpers.h"
+#include "fp_cache.h"
+#include "workers.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+/*
+ * Pipeline layout. Revisions get consecutive sequence numbers and live in
+ * a ring of slots (slot = seq % cap). Three cursors only ever move forward:
+ *
+ *   head <= claimed <= produced,   produced - head <= cap
+ *
+ * [head, claimed) are being fingerprinted or done, [claimed, produced)
+ * are queued. Worker 0 (the calling thread) runs the revwalk, delivers
+ * done slots in order and, when it can neither queue nor deliver,
+ * fingerprints the oldest queued slot itself. So the walk always
+ * completes even if no extra thread could be started.
+ */
+
+enum { SLOT_EMPTY = 0, SLOT_QUEUED, SLOT_BUSY, SLOT_DONE };
+
+typedef struct {
+    git_commit*           commit;   /* owned by worker 0 */
+    git_oid               blob_oid;
+    ag_fingerprint_set_t* fp;
+    int                   state;
+} pipe_slot_t;
+
+typedef struct {
+    git_repository*  repo;
+    const char*      path;
+    ag_history_fp_cb callback;
+    void*            payload;
+    int              error;
+
+    pipe_slot_t*     slots;
+    size_t           cap;
+    size_t           head;      /* next revision to deliver */
+    size_t           claimed;   /* next revision to fingerprint */
+    size_t           produced;  /* next revision to queue */
+    bool             finished;  /* no more revisions will be queued */
+
+    pthread_mutex_t  lock;
+    pthread_cond_t   queued;    /* slot queued, or finished */
+    pthread_cond_t   done;      /* slot done */
+} history_pipe_t;
+
+/* Fingerprint revision seq. Called and returns with the lock held. */
+static void fingerprint_slot(history_pipe_t* hp, git_repository* repo, size_t seq) {
+    pipe_slot_t* s = &hp->slots[seq % hp->cap];
+    git_oid blob_oid = s->blob_oid;
+    s->state = SLOT_BUSY;
+    pthread_mutex_unlock(&hp->lock);
+
+    ag_fingerprint_set_t* fp = ag_fingerprint_blob(repo, &blob_oid, hp->path);
+
+    pthread_mutex_lock(&hp->lock);
+    s->fp = fp;
+    s->state = SLOT_DONE;
+    pthread_cond_signal(&hp->done);
+}
+
+static void parse_worker(history_pipe_t* hp) {
+    git_repository* repo = ag_repo_reopen(hp->repo);
+    if (!repo) return; /* worker 0 picks up the slack */
+
+    pthread_mutex_lock(&hp->lock);
+    for (;;) {
+        if (hp->claimed < hp->produced) {
+            fingerprint_slot(hp, repo, hp->claimed++);
+            continue;
+        }
+        if (hp->finished) break;
+        pthread_cond_wait(&hp->queued, &hp->lock);
+    }
+    pthread_mutex_unlock(&hp->lock);
+
+    git_repository_free(repo);
+}
+
+static void walk_and_deliver(history_pipe_t* hp) {
+    ag_history_iter_t* it = ag_history_iter_new(hp->repo, hp->path);
+    bool walking = it != NULL;
+    bool stop = false;
+    if (!it) hp->error = -1;
+
+    pthread_mutex_lock(&hp->lock);
+    while (!stop) {
+        /* Deliver finished revisions in history order */
+        pipe_slot_t* s = &hp->slots[hp->head % hp->cap];
+        if (hp->head < hp->produced && s->state == SLOT_DONE) {
+            git_commit* commit = s->commit;
+            ag_fingerprint_set_t* fp = s->fp;
+            git_oid blob_oid = s->blob_oid;
+            s->commit = NULL;
+            s->fp = NULL;
+            s->state = SLOT_EMPTY;
+            hp->head++;
+            pthread_mutex_unlock(&hp->lock);
+
+            stop = hp->callback(commit, hp->path, &blob_oid, fp, hp->payload) != 0;
+            git_commit_free(commit);
+            ag_fingerprint_set_free(fp);
+
+            pthread_mutex_lock(&hp->lock);
+            continue;
+        }
+
+        /* Queue the next changed revision while there is room */
+        if (walking && hp->produced - hp->head < hp->cap) {
+            pthread_mutex_unlock(&hp->lock);
+            git_commit* commit = NULL;
+            git_oid blob_oid;
+            walking = ag_history_iter_next(it, &commit, &blob_oid) == 0;
+            pthread_mutex_lock(&hp->lock);
+
+            if (walking) {
+                s = &hp->slots[hp->produced % hp->cap];
+                s->commit = commit;
+                git_oid_cpy(&s->blob_oid, &blob_oid);
+                s->state = SLOT_QUEUED;
+                hp->produced++;
+                pthread_cond_signal(&hp->queued);
+            }
+            continue;
+        }
+
+        if (hp->head == hp->produced) break; /* walked and drained */
+
+        /* Queue full or walk over: help out, or wait for the head slot */
+        if (hp->claimed < hp->produced)
+            fingerprint_slot(hp, hp->repo, hp->claimed++);
+        else
+            pthread_cond_wait(&hp->done, &hp->lock);
+    }
+
+    /* After a stop, revisions still queued are dropped, not parsed */
+    hp->claimed = hp->produced;
+    hp->finished = true;
+    pthread_cond_broadcast(&hp->queued);
+    pthread_mutex_unlock(&hp->lock);
+
+    ag_history_iter_free(it);
+}
+
+static void pipe_worker(int worker, void* arg) {
+    if (worker == 0)
+        walk_and_deliver(arg);
+    else
+        parse_worker(arg);
+}
+
+/* Single-threaded path: plain revwalk, fingerprint in the callback */
+typedef struct {
+    git_repository*  repo;
+    ag_history_fp_cb callback;
+    void*            payload;
+} serial_ctx_t;
+
+static int serial_callback(git_commit* commit, const char* path,
+                           const git_oid* blob_oid, void* payload) {
+    serial_ctx_t* ctx = payload;
+    ag_fingerprint_set_t* fp = ag_fingerprint_blob(ctx->repo, blob_oid, path);
+    int ret = ctx->callback(commit, path, blob_oid, fp, ctx->payload);
+    ag_fingerprint_set_free(fp);
+    return ret;
+}
+
+int ag_walk_history_fp(git_repository* repo, const char* path,
+                       ag_history_fp_cb callback, void* payload) {
+    int nworkers = ag_thread_count();
+    if (nworkers <= 1) {
+        serial_ctx_t ctx = { repo, callback, payload };
+        return ag_walk_history(repo, path, serial_callback, &ctx);
+    }
+
+    history_pipe_t hp = {
+        .repo = repo,
+        .path = path,
+        .callback = callback,
+        .payload = payload,
+        .cap = 4 * (size_t)nworkers
+    };
+    hp.slots = calloc(hp.cap, sizeof(pipe_slot_t));
+    if (!hp.slots) return -1;
+
+    pthread_mutex_init(&hp.lock, NULL);
+    pthread_cond_init(&hp.queued, NULL);
+    pthread_cond_init(&hp.done, NULL);
+
+    ag_run_workers(nworkers, pipe_worker, &hp);
+
+    /* Slots left behind by an early stop */
+    for (size_t seq = hp.head; seq < hp.produced; seq++) {
+        pipe_slot_t* s = &hp.slots[seq % hp.cap];
+        if (s->commit) git_commit_free(s->commit);
+        ag_fingerprint_set_free(s->fp);
+    }
+
+    pthread_cond_destroy(&hp.done);
+    pthread_cond_destroy(&hp.queued);
+    pthread_mutex_destroy(&hp.lock);
+    free(hp.slots);
+    return hp.error;
+}
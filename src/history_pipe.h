@@ -0,0 +1,27 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+#ifndef ALEAGIT_HISTORY_PIPE_H
+#define ALEAGIT_HISTORY_PIPE_H
+
+#include "geom_fingerprint.h"
+#include <git2.h>
+
+/* History callback with the file's fingerprint set at that commit
+   (NULL if it could not be loaded). fp is owned by the walker and only
+   valid during the call. Return 0 to continue, non-zero to stop. */
+typedef int (*ag_history_fp_cb)(git_commit* commit, const char* path,
+                                const git_oid* blob_oid,
+                                const ag_fingerprint_set_t* fp, void* payload);
+
+/* Walk the commits that changed a file (same order as ag_walk_history)
+   and fingerprint each revision. The revwalk runs on the calling thread
+   and feeds a bounded queue; ag_thread_count() workers, each with its
+   own repository handle, fingerprint the queued blobs; the callback is
+   invoked on the calling thread, in history order. Blobs queued past
+   the point where the callback stops are fingerprinted but discarded. */
+int ag_walk_history_fp(git_repository* repo, const char* path,
+                       ag_history_fp_cb callback, void* payload);
+
+#endif /* ALEAGIT_HISTORY_PIPE_H */
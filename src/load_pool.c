@@ -0,0 +1,243 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+#include "load_pool.h"
+#include "geom_load.h"
+#include "git_helpers.h"
+#include "fp_cache.h"
+#include "workers.h"
+#include "util.h"
+#include <alea.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+typedef struct {
+    git_repository* repo;       /* caller's handle, used by worker 0 only */
+    ag_load_job_t*  jobs;
+    size_t          njobs;
+    atomic_size_t   next;
+    uint64_t*       text_hash;  /* set: hash the jobs' text instead of loading */
+    bool*           hashed;
+    bool            pairs;      /* set: patch pairs (njobs counts pairs) */
+    bool*           done;       /* jobs already served by the pair pass */
+} load_pool_t;
+
+static alea_system_t* load_system(git_repository* repo, const ag_load_job_t* job) {
+    switch (job->source) {
+        case AG_SRC_BLOB:
+            return ag_load_geometry_blob(repo, &job->oid, job->path, AG_LOAD_FULL);
+        case AG_SRC_COMMIT: {
+            git_commit* commit = NULL;
+            if (git_commit_lookup(&commit, repo, &job->oid) < 0) return NULL;
+            alea_system_t* sys = ag_load_geometry_commit(repo, commit, job->path);
+            git_commit_free(commit);
+            return sys;
+        }
+        case AG_SRC_STAGED:
+            return ag_load_geometry_staged(repo, job->path);
+        case AG_SRC_WORKDIR:
+            return ag_load_geometry_workdir(repo, job->path, AG_LOAD_FULL);
+    }
+    return NULL;
+}
+
+/* Blob OID of a job's file; the working tree has none */
+static int job_blob_oid(git_repository* repo, const ag_load_job_t* job, git_oid* out) {
+    switch (job->source) {
+        case AG_SRC_BLOB:
+            git_oid_cpy(out, &job->oid);
+            return 0;
+        case AG_SRC_COMMIT: {
+            git_commit* commit = NULL;
+            if (git_commit_lookup(&commit, repo, &job->oid) < 0) return -1;
+            int rc = ag_commit_blob_oid(repo, commit, job->path, out);
+            git_commit_free(commit);
+            return rc;
+        }
+        case AG_SRC_STAGED:
+            return ag_staged_blob_oid(repo, job->path, out);
+        case AG_SRC_WORKDIR:
+            return -1;
+    }
+    return -1;
+}
+
+/* base, if set, is an earlier version to patch from on a cache miss */
+static ag_fingerprint_set_t* fingerprint_job(git_repository* repo,
+                                             const ag_load_job_t* job,
+                                             const ag_fp_base_t* base) {
+    if (job->source == AG_SRC_WORKDIR)
+        return ag_fingerprint_workdir_from(repo, job->path, base);
+    git_oid blob_oid;
+    if (job_blob_oid(repo, job, &blob_oid) < 0) return NULL;
+    return ag_fingerprint_blob_from(repo, &blob_oid, job->path, base);
+}
+
+static int text_hash_job(git_repository* repo, const ag_load_job_t* job,
+                         uint64_t* out) {
+    switch (job->source) {
+        case AG_SRC_BLOB:
+            return ag_geometry_text_hash_blob(repo, &job->oid, job->path, out);
+        case AG_SRC_COMMIT: {
+            git_commit* commit = NULL;
+            if (git_commit_lookup(&commit, repo, &job->oid) < 0) return -1;
+            int rc = ag_geometry_text_hash_commit(repo, commit, job->path, out);
+            git_commit_free(commit);
+            return rc;
+        }
+        case AG_SRC_STAGED:
+            return ag_geometry_text_hash_staged(repo, job->path, out);
+        case AG_SRC_WORKDIR:
+            return ag_geometry_text_hash_workdir(repo, job->path, out);
+    }
+    return -1;
+}
+
+static void run_job(git_repository* repo, ag_load_job_t* job) {
+    if (job->want_system) {
+        job->sys = load_system(repo, job);
+        if (job->sys && job->want_fp)
+            job->fp = ag_fingerprint(job->sys);
+    } else if (job->want_fp) {
+        job->fp = fingerprint_job(repo, job, NULL);
+    }
+}
+
+/* Whether a pair (old side, new side) goes through the text pre-filter */
+static bool prefilter_pair(const ag_load_job_t* pair) {
+    return pair[0].want_fp && pair[1].want_fp &&
+           !pair[0].want_system && !pair[1].want_system;
+}
+
+/* Fingerprint the new side of a pair by patching the old side's cached
+   fingerprints. A pair whose old side is not cached is left to the
+   regular pass, which loads both sides in parallel. */
+static void patch_pair(git_repository* repo, ag_load_job_t* pair, bool* done) {
+    git_oid oid;
+    if (!prefilter_pair(pair) || pair[0].same_geometry ||
+        job_blob_oid(repo, &pair[0], &oid) < 0)
+        return;
+    ag_fingerprint_set_t* base_fp = ag_fingerprint_cached(repo, &oid);
+    if (!base_fp) return;
+
+    pair[0].fp = base_fp;
+    done[0] = done[1] = true;
+    ag_blob_t b;
+    bool have_text = ag_blob_open_oid(repo, &oid, &b) == 0;
+    ag_fp_base_t base = { base_fp, have_text ? b.data : NULL, have_text ? b.len : 0 };
+    pair[1].fp = fingerprint_job(repo, &pair[1], have_text ? &base : NULL);
+    if (have_text) ag_blob_release(&b);
+}
+
+static void load_worker(int worker, void* arg) {
+    load_pool_t* pool = arg;
+
+    git_repository* repo = worker > 0 ? ag_repo_reopen(pool->repo) : pool->repo;
+    if (!repo) return; /* the remaining workers pick up its share */
+
+    for (;;) {
+        size_t i = atomic_fetch_add(&pool->next, 1);
+        if (i >= pool->njobs) break;
+        if (pool->text_hash) {
+            if (prefilter_pair(&pool->jobs[i & ~(size_t)1]))
+                pool->hashed[i] = text_hash_job(repo, &pool->jobs[i], &pool->text_hash[i]) == 0;
+        } else if (pool->pairs) {
+            patch_pair(repo, &pool->jobs[2 * i], &pool->done[2 * i]);
+        } else if (!pool->done || !pool->done[i]) {
+            run_job(repo, &pool->jobs[i]);
+        }
+    }
+
+    if (worker > 0) git_repository_free(repo);
+}
+
+static void run_pool(load_pool_t* pool) {
+    atomic_init(&pool->next, 0);
+    int nworkers = ag_thread_count();
+    if ((size_t)nworkers > pool->njobs) nworkers = (int)pool->njobs;
+    ag_run_workers(nworkers, load_worker, pool);
+}
+
+void ag_load_jobs_run(git_repository* repo, ag_load_job_t* jobs, size_t njobs) {
+    if (njobs == 0) return;
+
+    load_pool_t pool = {
+        .repo = repo,
+        .jobs = jobs,
+        .njobs = njobs
+    };
+    run_pool(&pool);
+}
+
+void ag_load_pairs_run(git_repository* repo, ag_load_job_t* jobs, size_t npairs) {
+    size_t njobs = 2 * npairs;
+    if (njobs == 0) return;
+
+    /* Hash the text of both sides of every pair that only wants
+       fingerprints; reading and normalizing a deck is far cheaper than
+       parsing it. Out of memory just skips the pre-filter. */
+    size_t candidates = 0;
+    for (size_t i = 0; i < npairs; i++)
+        if (prefilter_pair(&jobs[2 * i])) candidates++;
+    uint64_t* text_hash = NULL;
+    bool* hashed = NULL;
+    if (candidates > 0 && !getenv("ALEAGIT_NO_PREFILTER")) {
+        text_hash = malloc(njobs * sizeof(uint64_t));
+        hashed = calloc(njobs, sizeof(bool));
+    }
+    if (text_hash && hashed) {
+        load_pool_t pool = {
+            .repo = repo,
+            .jobs = jobs,
+            .njobs = njobs,
+            .text_hash = text_hash,
+            .hashed = hashed
+        };
+        run_pool(&pool);
+
+        for (size_t i = 0; i < npairs; i++) {
+            ag_load_job_t* pair = &jobs[2 * i];
+            if (!hashed[2 * i] || !hashed[2 * i + 1] ||
+                text_hash[2 * i] != text_hash[2 * i + 1]) continue;
+            pair[0].same_geometry = pair[1].same_geometry = true;
+            pair[0].want_fp = pair[1].want_fp = false;
+        }
+    }
+    free(text_hash);
+    free(hashed);
+
+    /* Where the old side is already cached, the new side is patched
+       from it card by card instead of being parsed in full */
+    bool* done = NULL;
+    if (candidates > 0 && !getenv("ALEAGIT_FULL_PARSE"))
+        done = calloc(njobs, sizeof(bool));
+    if (done) {
+        load_pool_t pool = {
+            .repo = repo,
+            .jobs = jobs,
+            .njobs = npairs,
+            .pairs = true,
+            .done = done
+        };
+        run_pool(&pool);
+    }
+
+    load_pool_t pool = {
+        .repo = repo,
+        .jobs = jobs,
+        .njobs = njobs,
+        .done = done
+    };
+    run_pool(&pool);
+    free(done);
+}
+
+void ag_load_jobs_release(ag_load_job_t* jobs, size_t njobs) {
+    for (size_t i = 0; i < njobs; i++) {
+        if (jobs[i].sys) alea_destroy(jobs[i].sys);
+        ag_fingerprint_set_free(jobs[i].fp);
+        jobs[i].sys = NULL;
+        jobs[i].fp = NULL;
+    }
+}
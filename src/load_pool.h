@@ -0,0 +1,56 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+#ifndef ALEAGIT_LOAD_POOL_H
+#define ALEAGIT_LOAD_POOL_H
+
+#include "geom_fingerprint.h"
+#include <git2.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Where a load job reads its geometry from */
+typedef enum {
+    AG_SRC_BLOB = 0,   /* blob by OID (oid field) */
+    AG_SRC_COMMIT,     /* path at a commit (oid field = commit OID) */
+    AG_SRC_STAGED,     /* path in the index */
+    AG_SRC_WORKDIR     /* path in the working tree */
+} ag_load_source_t;
+
+/* One file to load and/or fingerprint */
+typedef struct {
+    /* Input */
+    const char*           path;
+    ag_load_source_t      source;
+    git_oid               oid;
+    bool                  want_system;  /* keep the parsed system */
+    bool                  want_fp;      /* compute (or fetch cached) fingerprints */
+
+    /* Output */
+    alea_system_t*        sys;
+    ag_fingerprint_set_t* fp;
+    bool                  same_geometry;  /* ag_load_pairs_run(): see there */
+} ag_load_job_t;
+
+/* Load and fingerprint a batch of files on ag_thread_count() workers.
+   Each worker opens its own repository handle, since libgit2 objects
+   must not be shared across threads. Results land in each job's output
+   fields, so callers consume them in their own deterministic order.
+   Jobs that fail leave sys/fp NULL. */
+void ag_load_jobs_run(git_repository* repo, ag_load_job_t* jobs, size_t njobs);
+
+/* Run pairs of jobs, jobs[2*i] the old and jobs[2*i+1] the new side of
+   a file, like ag_load_jobs_run(). Pairs that only want fingerprints are
+   first compared as normalized MCNP text (ag_mcnp_geometry_hash()):
+   when the hashes match, both jobs get same_geometry set and are
+   neither parsed nor fingerprinted. Set ALEAGIT_NO_PREFILTER to always
+   fingerprint. For the other such pairs whose old side is cached, the
+   new side is patched from it (ag_fingerprint_blob_from()) unless
+   ALEAGIT_FULL_PARSE is set. */
+void ag_load_pairs_run(git_repository* repo, ag_load_job_t* jobs, size_t npairs);
+
+/* Free the outputs of a batch (sys and fp of every job). */
+void ag_load_jobs_release(ag_load_job_t* jobs, size_t njobs);
+
+#endif /* ALEAGIT_LOAD_POOL_H */
@@ -3,9 +3,12 @@
 // SPDX-License-Identifier: MPL-2.0
 
 #include "aleagit.h"
+#include "fp_cache.h"
+#include "workers.h"
 #include "util.h"
 #include <git2.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 /* Command handlers (defined in cmd_*.c) */
@@ -18,6 +21,8 @@ int cmd_blame(int argc, char** argv);
 int cmd_validate(int argc, char** argv);
 int cmd_add(int argc, char** argv);
 int cmd_commit(int argc, char** argv);
+int cmd_backfill(int argc, char** argv);
+int cmd_bench(int argc, char** argv);
 
 typedef struct {
     const char* name;
@@ -29,27 +34,45 @@ static const aleagit_command_t commands[] = {
     {"init",     cmd_init,     "Initialize repo with geometry-aware settings"},
     {"summary",  cmd_summary,  "Print cell/surface/universe counts at a revision"},
     {"status",   cmd_status,   "Geometry-aware status of changed files"},
-    {"diff",     cmd_diff,     "Semantic diff between revisions [--visual]"},
+    {"diff",     cmd_diff,     "Semantic diff between revisions [--visual] [--quiet]"},
     {"log",      cmd_log,      "Per-element change history [--cell N] [--surface N]"},
     {"blame",    cmd_blame,    "Who last modified each element"},
     {"validate", cmd_validate, "Parse check + overlap detection [--pre-commit]"},
     {"add",      cmd_add,      "Stage files for commit"},
     {"commit",   cmd_commit,   "Commit with geometry change info [-m msg] [-a]"},
+    {"backfill", cmd_backfill, "Store fingerprints of past revisions in git notes"},
+    {"bench",    cmd_bench,    "Time fingerprinting of a file at increasing thread counts"},
     {NULL, NULL, NULL}
 };
 
 static void print_usage(void) {
     printf("aleagit %s - geometry-aware version control for nuclear models\n\n",
            ALEAGIT_VERSION_STRING);
-    printf("Usage: aleagit <command> [options]\n\n");
+    printf("Usage: aleagit [-j N] <command> [options]\n\n");
     printf("Commands:\n");
     for (int i = 0; commands[i].name; i++) {
         printf("  %-12s %s\n", commands[i].name, commands[i].description);
     }
+    printf("\nGlobal options:\n");
+    printf("  -j, --threads N  Worker threads for loading and fingerprinting (default: CPUs)\n");
     printf("\nRun 'aleagit <command> --help' for command-specific help.\n");
 }
 
 int main(int argc, char** argv) {
+    /* Global options come before the command name */
+    while (argc >= 3 && (strcmp(argv[1], "-j") == 0 ||
+                         strcmp(argv[1], "--threads") == 0)) {
+        int n = atoi(argv[2]);
+        if (n < 1) {
+            ag_error("invalid thread count '%s'", argv[2]);
+            return 1;
+        }
+        ag_set_thread_count(n);
+        argv[2] = argv[0];
+        argc -= 2;
+        argv += 2;
+    }
+
     if (argc < 2) {
         print_usage();
         return 1;
@@ -80,6 +103,12 @@ int main(int argc, char** argv) {
     print_usage();
 
 done:
+    if (getenv("ALEAGIT_CACHE_STATS")) {
+        size_t hits = 0, note_hits = 0, misses = 0, patched = 0;
+        ag_fp_cache_stats(&hits, &note_hits, &misses, &patched);
+        fprintf(stderr, "fingerprint cache: %zu hits, %zu from notes, %zu misses (%zu patched)\n",
+                hits, note_hits, misses, patched);
+    }
     git_libgit2_shutdown();
     return rc;
 }
@@ -0,0 +1,506 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+#include "mcnp_norm.h"
+#include "hash64.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Normalized text is hashed in chunks of this many bytes */
+#define NORM_CHUNK 4096
+
+/* Markers in the normalized stream */
+#define MARK_CARD   '\n'   /* a new card starts */
+#define MARK_BLOCK  '\f'   /* blank line ending the cell or surface block */
+#define MARK_EMPTY  '\v'   /* line left empty by a '$' comment */
+
+static bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static char lower(char c) {
+    return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+}
+
+/* Case-insensitive match of a lowercase word at [s, e) */
+static bool word_is(const char* s, const char* e, const char* word) {
+    size_t n = strlen(word);
+    if ((size_t)(e - s) != n) return false;
+    for (size_t i = 0; i < n; i++)
+        if (lower(s[i]) != word[i]) return false;
+    return true;
+}
+
+static bool is_blank_line(const char* s, const char* e) {
+    while (s < e && is_blank(*s)) s++;
+    return s == e;
+}
+
+/* A 'c' in columns 1-5 followed by a blank or the end of the line */
+static bool is_comment_line(const char* s, const char* e) {
+    for (int col = 0; col < 5 && s < e; col++, s++) {
+        if (*s == ' ') continue;
+        return (*s == 'c' || *s == 'C') && (s + 1 == e || is_blank(s[1]));
+    }
+    return false;
+}
+
+/* Data cards that affect geometry, by name: transformations and the
+   cell parameters that may be given in the data block */
+static bool is_geometry_data_card(const char* s, const char* e) {
+    if (s < e && *s == '#') return true;
+    if (s < e && *s == '*') s++;
+    if (e - s >= 2 && lower(s[0]) == 't' && lower(s[1]) == 'r') return true;
+    return word_is(s, e, "u") || word_is(s, e, "lat") || word_is(s, e, "fill");
+}
+
+/* ------------------------------------------------------------------ */
+/*  Line scanner                                                      */
+/* ------------------------------------------------------------------ */
+
+typedef enum {
+    LINE_IGNORED,      /* message block, title or comment card */
+    LINE_BREAK,        /* blank line ending the cell or surface block */
+    LINE_CARD,         /* first line of a card */
+    LINE_MORE,         /* continuation line */
+    LINE_EMPTY,        /* left empty by a '$' comment */
+    LINE_DONE,         /* end of the data block or of the deck */
+    LINE_UNSUPPORTED   /* READ card or tab indentation */
+} line_kind_t;
+
+typedef struct {
+    const char* p;
+    const char* end;
+    int         block;      /* -1 message/title, 0 cells, 1 surfaces, 2 data */
+    bool        first;
+    bool        message;
+    bool        cont;       /* previous card line ended with '&' */
+    bool        vertical;   /* inside a vertical-format '#' table */
+
+    /* Last line scanned */
+    const char* raw;        /* whole line, newline included */
+    const char* raw_end;
+    const char* t;          /* content: no indentation, '$' comment, '&' */
+    const char* e;
+    const char* name_end;   /* end of the card name (LINE_CARD) */
+    bool        continued;  /* the line continues the previous card */
+} deck_scan_t;
+
+static void scan_init(deck_scan_t* d, const char* data, size_t len) {
+    memset(d, 0, sizeof(*d));
+    d->p = data;
+    d->end = data + len;
+    d->block = -1;
+    d->first = true;
+}
+
+static line_kind_t scan_line(deck_scan_t* d) {
+    if (d->p >= d->end) return LINE_DONE;
+
+    const char* s = d->p;
+    const char* e = memchr(s, '\n', (size_t)(d->end - s));
+    d->p = e ? e + 1 : d->end;
+    if (!e) e = d->end;
+    d->raw = s;
+    d->raw_end = d->p;
+    bool first = d->first;
+    d->first = false;
+
+    /* Optional message block, ended by a blank line, then the title */
+    if (d->block < 0) {
+        const char* t = s;
+        while (t < e && *t == ' ') t++;
+        if (first && e - t >= 8 && word_is(t, t + 8, "message:")) d->message = true;
+        if (d->message) {
+            if (!first && is_blank_line(s, e)) d->message = false;
+        } else {
+            d->block = 0;   /* this line is the title */
+        }
+        return LINE_IGNORED;
+    }
+
+    if (is_blank_line(s, e)) {
+        if (d->block == 2) {
+            d->p = d->end;   /* anything after the data block is ignored */
+            return LINE_DONE;
+        }
+        d->block++;
+        d->cont = false;
+        return LINE_BREAK;
+    }
+    if (is_comment_line(s, e)) return LINE_IGNORED;
+
+    /* Leading blanks: five or more continue the previous card */
+    const char* t = s;
+    while (t < e && *t == ' ') t++;
+    if (t < e && *t == '\t') return LINE_UNSUPPORTED;
+    d->continued = d->cont || t - s >= 5;
+
+    /* Drop a '$' comment and trailing blanks, then a trailing '&' */
+    const char* dollar = memchr(t, '$', (size_t)(e - t));
+    if (dollar) e = dollar;
+    while (e > t && is_blank(e[-1])) e--;
+    d->cont = e > t && e[-1] == '&';
+    if (d->cont) {
+        e--;
+        while (e > t && is_blank(e[-1])) e--;
+    }
+    d->t = t;
+    d->e = e;
+    if (e == t) return LINE_EMPTY;
+
+    const char* w = t;
+    while (w < e && !is_blank(*w)) w++;
+    d->name_end = w;
+    if (d->continued) return LINE_MORE;
+
+    /* Rows of a '#' table run until the next card name */
+    bool name = (*t >= 'a' && *t <= 'z') || (*t >= 'A' && *t <= 'Z') || *t == '*';
+    if (d->vertical && !name) return LINE_MORE;
+    d->vertical = d->block == 2 && *t == '#';
+    return word_is(t, w, "read") ? LINE_UNSUPPORTED : LINE_CARD;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Normalized hash                                                   */
+/* ------------------------------------------------------------------ */
+
+typedef struct {
+    uint64_t h;
+    size_t   len;
+    char     buf[NORM_CHUNK];
+} norm_out_t;
+
+static void out_byte(norm_out_t* o, char c) {
+    if (o->len == NORM_CHUNK) {
+        o->h = ag_hash_bytes(o->h, o->buf, o->len);
+        o->len = 0;
+    }
+    o->buf[o->len++] = c;
+}
+
+int ag_mcnp_geometry_hash(const char* data, size_t len, uint64_t* out) {
+    deck_scan_t d;
+    scan_init(&d, data, len);
+    norm_out_t o;
+    o.h = ag_hash_init();
+    o.len = 0;
+    bool keep = false;   /* current card is hashed */
+
+    for (;;) {
+        line_kind_t k = scan_line(&d);
+        if (k == LINE_DONE) break;
+        if (k == LINE_UNSUPPORTED) return -1;
+        if (k == LINE_IGNORED) continue;
+        if (k == LINE_BREAK) {
+            out_byte(&o, MARK_BLOCK);
+            keep = false;
+            continue;
+        }
+        if (k == LINE_EMPTY) {
+            if (keep || !d.continued) out_byte(&o, MARK_EMPTY);
+            continue;
+        }
+
+        if (k == LINE_CARD) {
+            keep = d.block < 2 || is_geometry_data_card(d.t, d.name_end);
+            if (keep) out_byte(&o, MARK_CARD);
+        } else if (keep) {
+            out_byte(&o, ' ');
+        }
+        if (!keep) continue;
+
+        /* Card text, lowercased, blank runs folded to one space */
+        bool gap = false;
+        for (const char* c = d.t; c < d.e; c++) {
+            if (is_blank(*c)) {
+                gap = true;
+                continue;
+            }
+            if (gap) out_byte(&o, ' ');
+            gap = false;
+            out_byte(&o, lower(*c));
+        }
+    }
+
+    *out = ag_hash_bytes(o.h, o.buf, o.len);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Geometry-only deck                                                */
+/* ------------------------------------------------------------------ */
+
+size_t ag_mcnp_geometry_deck(const char* data, size_t len, char* out, size_t* head) {
+    deck_scan_t d;
+    scan_init(&d, data, len);
+    size_t n = 0;
+    bool keep = false;
+    *head = len;
+
+    for (;;) {
+        line_kind_t k = scan_line(&d);
+        if (k == LINE_DONE) break;
+        if (k == LINE_UNSUPPORTED) return 0;
+        if (d.block < 2) continue;
+
+        /* The blank line that opens the data block ends the head */
+        if (k == LINE_BREAK) {
+            *head = n = (size_t)(d.raw_end - data);
+            if (out) memcpy(out, data, n);
+            continue;
+        }
+        if (k == LINE_CARD) keep = is_geometry_data_card(d.t, d.name_end);
+        if (k == LINE_IGNORED || !keep) continue;
+
+        /* Raw lines of a kept card; only the last line of the deck
+           may lack its newline, and it stays last */
+        size_t rn = (size_t)(d.raw_end - d.raw);
+        if (out) memcpy(out + n, d.raw, rn);
+        n += rn;
+    }
+    return *head == len ? len : n;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Card index                                                        */
+/* ------------------------------------------------------------------ */
+
+/* Make room for need elements of size elem in *items */
+static int reserve(void** items, size_t* cap, size_t need, size_t elem) {
+    if (need <= *cap) return 0;
+    size_t c = *cap ? *cap : 64;
+    while (c < need) c *= 2;
+    void* p = realloc(*items, c * elem);
+    if (!p) return -1;
+    *items = p;
+    *cap = c;
+    return 0;
+}
+
+typedef struct {
+    int*   items;
+    size_t count, cap;
+} int_list_t;
+
+static int int_push(int_list_t* l, int v) {
+    if (reserve((void**)&l->items, &l->cap, l->count + 1, sizeof(int)) < 0) return -1;
+    l->items[l->count++] = v;
+    return 0;
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+/* Unsigned decimal at *p, advancing past it; -1 if none or too large */
+static int parse_number(const char** p, const char* e) {
+    const char* s = *p;
+    long v = 0;
+    while (s < e && is_digit(*s)) {
+        v = v * 10 + (*s++ - '0');
+        if (v > 0x7fffffff) return -1;
+    }
+    if (s == *p) return -1;
+    *p = s;
+    return (int)v;
+}
+
+/* Card number: the whole name, after a '*' or '+' boundary prefix */
+static int card_number(const char* s, const char* e) {
+    if (s < e && (*s == '*' || *s == '+')) s++;
+    int v = parse_number(&s, e);
+    return s == e ? v : -1;
+}
+
+static ag_mcnp_card_kind_t data_card_kind(const char* s, const char* e) {
+    if (!is_geometry_data_card(s, e)) return AG_CARD_DATA;
+    if (*s == '*') s++;
+    if (e - s >= 2 && lower(s[0]) == 't' && lower(s[1]) == 'r') return AG_CARD_TRANSFORM;
+    return AG_CARD_CELL_PARAM;
+}
+
+/* Next blank-separated token of normalized text */
+static bool next_token(const char** p, const char* e, const char** ts, const char** te) {
+    const char* s = *p;
+    while (s < e && (*s == ' ' || *s == MARK_EMPTY)) s++;
+    const char* t = s;
+    while (t < e && *t != ' ' && *t != MARK_EMPTY) t++;
+    *ts = s;
+    *te = t;
+    *p = t;
+    return s < t;
+}
+
+/* Cells and surfaces that a cell card's normalized text refers to: the
+   "LIKE n BUT" cell, or the geometry's #n complements and surfaces, up
+   to the first parameter. Clears *exact on anything else in the
+   geometry, such as a macrobody facet. */
+static int cell_refs(const char* p, const char* e, int_list_t* surfaces,
+                     int_list_t* cells, bool* exact) {
+    const char *ts, *te;
+    *exact = true;
+    if (!next_token(&p, e, &ts, &te) || !next_token(&p, e, &ts, &te)) {
+        *exact = false;
+        return 0;
+    }
+
+    if (word_is(ts, te, "like")) {
+        int n = next_token(&p, e, &ts, &te) ? card_number(ts, te) : -1;
+        if (n < 0) {
+            *exact = false;
+            return 0;
+        }
+        return int_push(cells, n);
+    }
+    if (!word_is(ts, te, "0") && !next_token(&p, e, &ts, &te)) return 0;   /* density */
+
+    while (next_token(&p, e, &ts, &te)) {
+        char c = *ts;
+        if ((c >= 'a' && c <= 'z') || c == '*') break;   /* parameters */
+        for (const char* s = ts; s < te; ) {
+            if (*s == '(' || *s == ')' || *s == ':') {
+                s++;
+            } else if (*s == '#') {
+                s++;
+                if (s < te && is_digit(*s)) {
+                    int n = parse_number(&s, te);
+                    if (n < 0 || int_push(cells, n) < 0) return -1;
+                }
+            } else if (*s == '-' || *s == '+' || is_digit(*s)) {
+                if (*s == '-' || *s == '+') s++;
+                int n = parse_number(&s, te);
+                if (n < 0 || (s < te && *s == '.')) {
+                    *exact = false;
+                    return 0;
+                }
+                if (int_push(surfaces, n) < 0) return -1;
+            } else {
+                *exact = false;
+                return 0;
+            }
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    ag_mcnp_deck_t* deck;
+    size_t          cap;
+    size_t          ref_cap;
+    char*           norm;      /* normalized text of the current card */
+    size_t          norm_len, norm_cap;
+    int_list_t      surfaces;  /* refs of the current card */
+    int_list_t      cells;
+} split_t;
+
+static int norm_push(split_t* sp, char c) {
+    if (reserve((void**)&sp->norm, &sp->norm_cap, sp->norm_len + 1, 1) < 0) return -1;
+    sp->norm[sp->norm_len++] = c;
+    return 0;
+}
+
+/* Hash the current card and record its refs */
+static int finish_card(split_t* sp) {
+    ag_mcnp_deck_t* deck = sp->deck;
+    if (deck->count == 0) return 0;
+    ag_mcnp_card_t* card = &deck->cards[deck->count - 1];
+    card->hash = ag_hash_bytes(ag_hash_init(), sp->norm, sp->norm_len);
+    card->exact = true;
+    if (card->kind != AG_CARD_CELL) return 0;
+
+    sp->surfaces.count = sp->cells.count = 0;
+    if (cell_refs(sp->norm, sp->norm + sp->norm_len, &sp->surfaces,
+                  &sp->cells, &card->exact) < 0)
+        return -1;
+    size_t n = sp->surfaces.count + sp->cells.count;
+    if (deck->ref_count + n >= UINT32_MAX ||
+        reserve((void**)&deck->refs, &sp->ref_cap, deck->ref_count + n, sizeof(int)) < 0)
+        return -1;
+    card->first_ref = (uint32_t)deck->ref_count;
+    card->surface_refs = (uint32_t)sp->surfaces.count;
+    card->cell_refs = (uint32_t)sp->cells.count;
+    if (sp->surfaces.count > 0)
+        memcpy(deck->refs + deck->ref_count, sp->surfaces.items,
+               sp->surfaces.count * sizeof(int));
+    if (sp->cells.count > 0)
+        memcpy(deck->refs + deck->ref_count + sp->surfaces.count, sp->cells.items,
+               sp->cells.count * sizeof(int));
+    deck->ref_count += n;
+    return 0;
+}
+
+static int split_lines(split_t* sp, const char* data, size_t len) {
+    ag_mcnp_deck_t* deck = sp->deck;
+    deck_scan_t d;
+    scan_init(&d, data, len);
+    bool open = false;   /* lines still belong to the last card */
+
+    for (;;) {
+        line_kind_t k = scan_line(&d);
+        if (k == LINE_DONE) break;
+        if (k == LINE_UNSUPPORTED) return -1;
+        if (k == LINE_IGNORED) continue;
+        if (k == LINE_BREAK) {
+            open = false;
+            continue;
+        }
+
+        if (k == LINE_CARD) {
+            if (finish_card(sp) < 0 ||
+                reserve((void**)&deck->cards, &sp->cap, deck->count + 1,
+                        sizeof(ag_mcnp_card_t)) < 0)
+                return -1;
+            ag_mcnp_card_t* card = &deck->cards[deck->count++];
+            memset(card, 0, sizeof(*card));
+            card->offset = (size_t)(d.raw - data);
+            card->kind = d.block == 0 ? AG_CARD_CELL
+                       : d.block == 1 ? AG_CARD_SURFACE
+                       : data_card_kind(d.t, d.name_end);
+            card->id = d.block < 2 ? card_number(d.t, d.name_end) : -1;
+            sp->norm_len = 0;
+            open = true;
+        } else if (!open) {
+            continue;
+        } else if (k == LINE_EMPTY) {
+            if (norm_push(sp, MARK_EMPTY) < 0) return -1;
+        } else if (norm_push(sp, ' ') < 0) {
+            return -1;
+        }
+
+        ag_mcnp_card_t* card = &deck->cards[deck->count - 1];
+        card->length = (size_t)(d.raw_end - data) - card->offset;
+        if (k == LINE_EMPTY) continue;
+
+        bool gap = false;
+        for (const char* c = d.t; c < d.e; c++) {
+            if (is_blank(*c)) {
+                gap = true;
+                continue;
+            }
+            if ((gap && norm_push(sp, ' ') < 0) || norm_push(sp, lower(*c)) < 0)
+                return -1;
+            gap = false;
+        }
+    }
+    return finish_card(sp);
+}
+
+int ag_mcnp_split(const char* data, size_t len, ag_mcnp_deck_t* out) {
+    memset(out, 0, sizeof(*out));
+    split_t sp = { .deck = out };
+    int rc = split_lines(&sp, data, len);
+    free(sp.norm);
+    free(sp.surfaces.items);
+    free(sp.cells.items);
+    if (rc < 0) ag_mcnp_deck_free(out);
+    return rc;
+}
+
+void ag_mcnp_deck_free(ag_mcnp_deck_t* deck) {
+    free(deck->cards);
+    free(deck->refs);
+    memset(deck, 0, sizeof(*deck));
+}
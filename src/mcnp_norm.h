@@ -0,0 +1,74 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+#ifndef ALEAGIT_MCNP_NORM_H
+#define ALEAGIT_MCNP_NORM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Hash of the structure-bearing text of an MCNP deck, in one streaming
+   pass: the cell and surface blocks, plus the data cards that affect
+   geometry (TRn/TRCL, U, LAT, FILL and vertical-format '#' cards).
+   Comment cards, '$' comments, the title and message block, other data
+   cards, case, and whitespace within and between cards are ignored;
+   card boundaries and continuations are not. Decks with equal hashes
+   parse to the same geometry. Returns 0 and sets *out, or -1 if the
+   deck uses READ cards or tab indentation, which are not normalized. */
+int ag_mcnp_geometry_hash(const char* data, size_t len, uint64_t* out);
+
+/* Geometry-only copy of an MCNP deck: everything up to and including
+   the blank line that ends the surface block, followed by the raw lines
+   of the data cards that affect geometry (as above) and nothing else.
+   Writes to out (which must hold len bytes) unless it is NULL, and
+   returns the length. *head is set to the length of the leading part
+   taken verbatim. Returns 0 if the deck uses READ
+   cards or tab indentation, and len if it has no data block. */
+size_t ag_mcnp_geometry_deck(const char* data, size_t len, char* out, size_t* head);
+
+/* Kind of an MCNP card */
+typedef enum {
+    AG_CARD_CELL = 0,
+    AG_CARD_SURFACE,
+    AG_CARD_TRANSFORM,    /* TRn or *TRn data card */
+    AG_CARD_CELL_PARAM,   /* U, LAT or FILL data card, or a '#' table */
+    AG_CARD_DATA          /* any other data card */
+} ag_mcnp_card_kind_t;
+
+/* One card of a split deck. Its raw text runs from its first line to
+   its last continuation line, newline included, and may hold comment
+   cards. hash covers the normalized text of the card alone, so an edit
+   elsewhere in the deck leaves it unchanged. Cell cards list the
+   surfaces, then the cells (#n complements, LIKE n BUT), they refer
+   to in the deck's refs; exact is false when that list may be
+   incomplete, e.g. for a macrobody facet. */
+typedef struct {
+    size_t   offset;
+    size_t   length;
+    uint64_t hash;
+    int      kind;          /* ag_mcnp_card_kind_t */
+    int      id;            /* cell or surface number, -1 if none */
+    uint32_t first_ref;
+    uint32_t surface_refs;
+    uint32_t cell_refs;
+    bool     exact;
+} ag_mcnp_card_t;
+
+typedef struct {
+    ag_mcnp_card_t* cards;  /* in deck order */
+    size_t          count;
+    int*            refs;
+    size_t          ref_count;
+} ag_mcnp_deck_t;
+
+/* Split a deck into its cell, surface and data cards (the title,
+   message block and anything after the data block are skipped).
+   Returns 0, or -1 if the deck uses READ cards or tab indentation or
+   memory runs out. Free with ag_mcnp_deck_free(). */
+int ag_mcnp_split(const char* data, size_t len, ag_mcnp_deck_t* out);
+
+void ag_mcnp_deck_free(ag_mcnp_deck_t* deck);
+
+#endif /* ALEAGIT_MCNP_NORM_H */
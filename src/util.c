@@ -60,3 +60,68 @@ char* ag_strdup(const char* s) {
     if (d) memcpy(d, s, len);
     return d;
 }
+
+static const char B64_ALPHABET[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+char* ag_base64_encode(const uint8_t* data, size_t len) {
+    size_t outlen = 4 * ((len + 2) / 3);
+    char* out = malloc(outlen + 1);
+    if (!out) return NULL;
+
+    char* p = out;
+    size_t i = 0;
+    for (; i + 2 < len; i += 3) {
+        uint32_t v = (uint32_t)data[i] << 16 | (uint32_t)data[i + 1] << 8 | data[i + 2];
+        *p++ = B64_ALPHABET[(v >> 18) & 63];
+        *p++ = B64_ALPHABET[(v >> 12) & 63];
+        *p++ = B64_ALPHABET[(v >> 6) & 63];
+        *p++ = B64_ALPHABET[v & 63];
+    }
+    if (i < len) {
+        uint32_t v = (uint32_t)data[i] << 16;
+        if (i + 1 < len) v |= (uint32_t)data[i + 1] << 8;
+        *p++ = B64_ALPHABET[(v >> 18) & 63];
+        *p++ = B64_ALPHABET[(v >> 12) & 63];
+        *p++ = i + 1 < len ? B64_ALPHABET[(v >> 6) & 63] : '=';
+        *p++ = '=';
+    }
+    *p = '\0';
+    return out;
+}
+
+static int b64_value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+uint8_t* ag_base64_decode(const char* text, size_t* out_len) {
+    size_t tlen = strlen(text);
+    uint8_t* out = malloc(tlen / 4 * 3 + 3);
+    if (!out) return NULL;
+
+    size_t n = 0;
+    uint32_t acc = 0;
+    int bits = 0;
+    for (const char* p = text; *p; p++) {
+        if (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t') continue;
+        if (*p == '=') break;
+        int v = b64_value(*p);
+        if (v < 0) {
+            free(out);
+            return NULL;
+        }
+        acc = (acc << 6) | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out[n++] = (uint8_t)(acc >> bits);
+        }
+    }
+    *out_len = n;
+    return out;
+}
@@ -8,6 +8,8 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /* Color output */
 #define COL_RESET   "\033[0m"
@@ -33,4 +35,11 @@ void ag_warn(const char* fmt, ...);
 bool ag_str_ends_with(const char* str, const char* suffix);
 char* ag_strdup(const char* s);
 
+/* Base64 (RFC 4648) encoding. Returns a malloc'd NUL-terminated string. */
+char* ag_base64_encode(const uint8_t* data, size_t len);
+
+/* Base64 decoding; whitespace is skipped. Returns malloc'd bytes and sets
+   *out_len, or NULL on malformed input. */
+uint8_t* ag_base64_decode(const char* text, size_t* out_len);
+
 #endif /* ALEAGIT_UTIL_H */
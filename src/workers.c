@@ -0,0 +1,97 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+#define _POSIX_C_SOURCE 200809L
+#define _DARWIN_C_SOURCE
+#include "workers.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+static int thread_override = 0;
+static _Thread_local bool in_worker = false;
+
+static int online_cpus(void) {
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return (int)si.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+int ag_thread_count(void) {
+    if (thread_override > 0) return thread_override;
+
+    const char* env = getenv("ALEAGIT_THREADS");
+    if (env) {
+        int n = atoi(env);
+        if (n > 0) return n;
+    }
+    return online_cpus();
+}
+
+void ag_set_thread_count(int n) {
+    thread_override = n > 0 ? n : 0;
+}
+
+typedef struct {
+    ag_worker_fn fn;
+    void*        arg;
+    int          worker;
+} worker_start_t;
+
+static void* worker_main(void* p) {
+    worker_start_t* ws = p;
+    in_worker = true;
+    ws->fn(ws->worker, ws->arg);
+    return NULL;
+}
+
+bool ag_in_worker(void) {
+    return in_worker;
+}
+
+int ag_run_workers(int nworkers, ag_worker_fn fn, void* arg) {
+    if (nworkers <= 1) {
+        fn(0, arg);
+        return 0;
+    }
+
+    pthread_t* threads = malloc((size_t)nworkers * sizeof(pthread_t));
+    worker_start_t* starts = malloc((size_t)nworkers * sizeof(worker_start_t));
+    if (!threads || !starts) {
+        free(threads);
+        free(starts);
+        fn(0, arg);
+        return -1;
+    }
+
+    int spawned = 0;
+    for (int w = 1; w < nworkers; w++) {
+        starts[w] = (worker_start_t){ fn, arg, w };
+        if (pthread_create(&threads[w], NULL, worker_main, &starts[w]) != 0)
+            break;
+        spawned = w;
+    }
+
+    bool was_worker = in_worker;
+    in_worker = true;
+    fn(0, arg);
+    in_worker = was_worker;
+
+    for (int w = 1; w <= spawned; w++)
+        pthread_join(threads[w], NULL);
+
+    free(threads);
+    free(starts);
+    return spawned == nworkers - 1 ? 0 : -1;
+}
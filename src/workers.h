@@ -0,0 +1,31 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+#ifndef ALEAGIT_WORKERS_H
+#define ALEAGIT_WORKERS_H
+
+#include <stdbool.h>
+
+/* Number of worker threads to use. Defaults to the number of online CPUs;
+   overridden by ALEAGIT_THREADS or ag_set_thread_count(). */
+int ag_thread_count(void);
+
+/* Override the worker thread count (n < 1 restores the default). */
+void ag_set_thread_count(int n);
+
+/* Worker body. worker is in [0, nworkers). */
+typedef void (*ag_worker_fn)(int worker, void* arg);
+
+/* Run fn on nworkers threads and wait for all of them. The calling thread
+   acts as worker 0, so nworkers == 1 runs inline without spawning.
+   Returns 0 on success, -1 if threads could not be created (the work is
+   then finished on the calling thread). */
+int ag_run_workers(int nworkers, ag_worker_fn fn, void* arg);
+
+/* True on a thread currently running a worker body of a multi-threaded
+   ag_run_workers() call. Lets nested work stay serial instead of
+   oversubscribing the CPUs. */
+bool ag_in_worker(void);
+
+#endif /* ALEAGIT_WORKERS_H */
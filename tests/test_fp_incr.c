@@ -0,0 +1,175 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+/* Patched fingerprints (ag_fingerprint_incremental()) must equal those of
+   a full parse of the edited deck, row for row. Run by make check, once
+   as is and once with ALEAGIT_FULL_PARSE=1. */
+
+#include "fp_incr.h"
+#include "geom_fingerprint.h"
+#include "geom_load.h"
+#include <alea.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Spheres 1..SHELLS; cells 3..SHELLS are the shells between them */
+#define SHELLS 40
+
+typedef enum {
+    EDIT_NONE,
+    EDIT_CELL,          /* density of cell 10 */
+    EDIT_SURFACE,       /* radius of sphere 20 only */
+    EDIT_HASH_DEP,      /* material of cell 1, which cell 2 excludes with #1 */
+    EDIT_LIKE_DEP,      /* density of cell 3, which cell 41 is LIKE 3 BUT */
+    EDIT_LIKE_BUT,      /* the BUT clause of cell 41 */
+    DROP_SURFACE,       /* unused plane 41 */
+    DROP_CELL,          /* shell 20, nothing refers to it */
+    DROP_USED_SURFACE,  /* sphere 40, still bounding cells 40 and 42 */
+    DROP_USED_CELL      /* cell 1, still excluded by cell 2 */
+} edit_t;
+
+typedef struct {
+    const char* name;
+    edit_t      edit;
+    bool        patch;  /* expected to patch rather than fall back */
+} test_case_t;
+
+static const test_case_t CASES[] = {
+    { "unchanged",                EDIT_NONE,         true  },
+    { "one cell card",            EDIT_CELL,         true  },
+    { "surface only",             EDIT_SURFACE,      true  },
+    { "#n dependent",             EDIT_HASH_DEP,     true  },
+    { "LIKE n BUT dependent",     EDIT_LIKE_DEP,     true  },
+    { "LIKE n BUT card",          EDIT_LIKE_BUT,     true  },
+    { "deleted surface",          DROP_SURFACE,      true  },
+    { "deleted cell",             DROP_CELL,         true  },
+    { "deleted surface in use",   DROP_USED_SURFACE, false },
+    { "deleted cell in use",      DROP_USED_CELL,    false },
+};
+
+typedef struct {
+    char*  data;
+    size_t len, cap;
+} deck_t;
+
+static void put(deck_t* d, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(d->data + d->len, d->cap - d->len, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= d->cap - d->len) {
+        fprintf(stderr, "test_fp_incr: deck buffer too small\n");
+        exit(2);
+    }
+    d->len += (size_t)n;
+}
+
+static void build_deck(deck_t* d, edit_t edit) {
+    d->len = 0;
+    put(d, "aleagit incremental fingerprint check\n");
+    if (edit != DROP_USED_CELL)
+        put(d, "1 %d -1.0 -1 imp:n=1\n", edit == EDIT_HASH_DEP ? 2 : 1);
+    put(d, "2 0 -2 #1 imp:n=1\n");
+    for (int i = 3; i <= SHELLS; i++) {
+        if (edit == DROP_CELL && i == 20) continue;
+        double rho = (edit == EDIT_CELL && i == 10) || (edit == EDIT_LIKE_DEP && i == 3)
+                   ? -3.0 : -2.0;
+        put(d, "%d 2 %.1f %d -%d imp:n=1\n", i, rho, i - 1, i);
+    }
+    put(d, "41 like 3 but mat=%d rho=-1.0\n", edit == EDIT_LIKE_BUT ? 2 : 1);
+    put(d, "42 0 %d imp:n=0\n", SHELLS);
+    put(d, "\n");
+
+    for (int i = 1; i <= SHELLS; i++) {
+        if (edit == DROP_USED_SURFACE && i == SHELLS) continue;
+        put(d, "%d so %.1f\n", i, edit == EDIT_SURFACE && i == 20 ? 20.5 : (double)i);
+    }
+    if (edit != DROP_SURFACE) put(d, "%d pz 0.0\n", SHELLS + 1);
+    put(d, "\n");
+
+    put(d, "m1 1001.80c 2 8016.80c 1\n");
+    put(d, "m2 26056.80c 1\n");
+}
+
+/* Fingerprints of a deck parsed in full, or NULL if it does not parse */
+static ag_fingerprint_set_t* fingerprint_full(const deck_t* d, ag_load_mode_t mode) {
+    alea_system_t* sys = ag_load_geometry_buffer(d->data, d->len, GEOM_FORMAT_MCNP, mode);
+    if (!sys) return NULL;
+    ag_fingerprint_set_t* fp = ag_fingerprint(sys);
+    alea_destroy(sys);
+    return fp;
+}
+
+/* Every row and every set hash equal. Returns the first difference or NULL. */
+static const char* compare_sets(const ag_fingerprint_set_t* a, const ag_fingerprint_set_t* b) {
+    if (a->cell_count != b->cell_count) return "cell count";
+    if (a->surface_count != b->surface_count) return "surface count";
+    if (ag_cell_fp_equal_run(a, 0, b, 0) != a->cell_count) return "cell rows";
+    if (ag_surface_fp_equal_run(a, 0, b, 0) != a->surface_count) return "surface rows";
+    for (size_t i = 0; i < a->cell_count; i++)
+        if (a->cell_fill_hash[i] != b->cell_fill_hash[i]) return "cell fill hashes";
+    if (a->universe_count != b->universe_count) return "universe count";
+    for (size_t i = 0; i < a->universe_count; i++)
+        if (a->universes[i].universe_id != b->universes[i].universe_id ||
+            a->universes[i].count != b->universes[i].count ||
+            a->universes[i].cell_hash != b->universes[i].cell_hash ||
+            a->universes[i].hash != b->universes[i].hash)
+            return "universes";
+    if (a->surface_hash != b->surface_hash) return "surface hash";
+    if (a->root_hash != b->root_hash) return "root hash";
+    return NULL;
+}
+
+static bool run_case(const test_case_t* tc, const deck_t* base_deck,
+                     const ag_fingerprint_set_t* base_fp, deck_t* d) {
+    build_deck(d, tc->edit);
+    ag_fp_base_t base = { base_fp, base_deck->data, base_deck->len };
+    ag_fingerprint_set_t* patched = ag_fingerprint_incremental(&base, d->data, d->len);
+    ag_fingerprint_set_t* full = fingerprint_full(d, AG_LOAD_FULL);
+
+    const char* fail = NULL;
+    if (tc->patch && !patched)
+        fail = "fell back to a full parse";
+    else if (!tc->patch && patched)
+        fail = "patched a deck that must fall back";
+    else if (patched && !full)
+        fail = "patched a deck that does not parse";
+    else if (patched)
+        fail = compare_sets(patched, full);
+
+    printf("%-24s %s%s\n", tc->name, fail ? "FAIL: " : "ok", fail ? fail : "");
+    ag_fingerprint_set_free(patched);
+    ag_fingerprint_set_free(full);
+    return fail == NULL;
+}
+
+int main(void) {
+    deck_t base_deck = { malloc(1 << 16), 0, 1 << 16 };
+    deck_t d = { malloc(1 << 16), 0, 1 << 16 };
+    if (!base_deck.data || !d.data) {
+        fprintf(stderr, "test_fp_incr: out of memory\n");
+        return 2;
+    }
+
+    /* The base set comes from the same load a commit would use */
+    build_deck(&base_deck, EDIT_NONE);
+    ag_fingerprint_set_t* base_fp = fingerprint_full(&base_deck, AG_LOAD_GEOMETRY);
+    if (!base_fp) {
+        fprintf(stderr, "test_fp_incr: base deck does not parse\n");
+        return 2;
+    }
+
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(CASES) / sizeof(CASES[0]); i++)
+        failed += !run_case(&CASES[i], &base_deck, base_fp, &d);
+
+    ag_fingerprint_set_free(base_fp);
+    free(base_deck.data);
+    free(d.data);
+    if (failed) printf("%d case(s) failed\n", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,159 @@
+// SPDX-FileCopyrightText: 2026 Giovanni MARIANO
+//
+// SPDX-License-Identifier: MPL-2.0
+
+/* The normalized text hash (ag_mcnp_geometry_hash()) must ignore edits
+   that cannot change the geometry and see every edit that can. Each case
+   makes one text substitution in a base deck. Run by make check. */
+
+#include "mcnp_norm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    SAME,         /* hash equal to the base deck's */
+    DIFFERENT,    /* hash differs */
+    UNSUPPORTED   /* deck not normalized, hash returns -1 */
+} expect_t;
+
+typedef struct {
+    const char* name;
+    const char* find;     /* must occur exactly once in BASE */
+    const char* replace;
+    expect_t    expect;
+} test_case_t;
+
+static const char BASE[] =
+    "message: outp=base.o\n"
+    "\n"
+    "aleagit normalizer check\n"
+    "c cell block\n"
+    "1 1 -1.0 -1 imp:n=1 $ fuel\n"
+    "2 0 -2 1 #1 imp:n=1\n"
+    "     trcl=3\n"
+    "3 2 -2.0 2 -3 &\n"
+    "  imp:n=1\n"
+    "4 0 -4 fill=5 imp:n=1\n"
+    "5 0 -5 lat=1 imp:n=1\n"
+    "   c indented comment card\n"
+    "6 0 3 imp:n=0\n"
+    "\n"
+    "1 so 1.0\n"
+    "2 so 2.0\n"
+    "3 so 3.0\n"
+    "4 rpp -1 1 -1 1 -1 1\n"
+    "5 1 px 0.0\n"
+    "\n"
+    "m1 1001.80c 2 8016.80c 1\n"
+    "*tr1 0 0 1\n"
+    "tr3 1 0 0\n"
+    "u 0 0 0 0 5 0\n"
+    "fill 0 0 0 0 0 0\n"
+    "m2 26056.80c 1\n"
+    "#   vol  tmp\n"
+    "1   1.0  2.5e-8\n"
+    "2   2.0  2.5e-8\n"
+    "sdef pos=0 0 0\n";
+
+static const test_case_t CASES[] = {
+    /* Comments, title and message block */
+    { "comment card",           "c cell block",       "C  core geometry",       SAME },
+    { "indented comment card",  "   c indented",      "    C indented",          SAME },
+    { "new comment card",       "3 so 3.0\n",         "3 so 3.0\nc added\n",    SAME },
+    { "$ comment",              "$ fuel",             "$ fuel pin",             SAME },
+    { "new $ comment",          "2 so 2.0",           "2 so 2.0 $ outer",       SAME },
+    { "title",                  "normalizer check",   "other title",            SAME },
+    { "message block",          "outp=base.o",        "outp=other.o",           SAME },
+
+    /* Whitespace and case */
+    { "blanks within a card",   "1 1 -1.0 -1",        "1  1   -1.0 -1",         SAME },
+    { "tab within a card",      "1 so 1.0",           "1 so\t1.0",              SAME },
+    { "trailing blanks",        "6 0 3 imp:n=0",      "6 0 3 imp:n=0   ",       SAME },
+    { "continuation indent",    "     trcl=3",        "          trcl=3",       SAME },
+    { "blanks before &",        "2 -3 &",             "2 -3&",                  SAME },
+    { "case",                   "4 rpp",              "4 RPP",                  SAME },
+
+    /* Data cards that do not affect geometry */
+    { "material",               "1001.80c 2",         "1001.80c 3",             SAME },
+    { "new material",           "m2 26056.80c 1\n",   "m2 26056.80c 1\nm3 6000.80c 1\n", SAME },
+    { "source",                 "pos=0 0 0",          "pos=0 0 1",              SAME },
+
+    /* Cell and surface cards */
+    { "cell density",           "1 1 -1.0",           "1 1 -1.1",               DIFFERENT },
+    { "cell #n complement",     "-2 1 #1",            "-2 1 #3",                DIFFERENT },
+    { "& continuation line",    "  imp:n=1\n4",       "  imp:n=2\n4",           DIFFERENT },
+    { "TRCL",                   "trcl=3",             "trcl=4",                 DIFFERENT },
+    { "LAT",                    "lat=1",              "lat=2",                  DIFFERENT },
+    { "FILL",                   "fill=5",             "fill=6",                 DIFFERENT },
+    { "surface coefficient",    "2 so 2.0",           "2 so 2.5",               DIFFERENT },
+    { "surface transform",      "5 1 px",             "5 2 px",                 DIFFERENT },
+    { "card boundary",          "2 so 2.0",           "     2 so 2.0",          DIFFERENT },
+    { "dropped &",              "2 -3 &",             "2 -3",                   DIFFERENT },
+
+    /* Data cards that affect geometry */
+    { "*TRn card",              "*tr1 0 0 1",         "*tr1 0 0 2",             DIFFERENT },
+    { "TRn card",               "tr3 1 0 0",          "tr3 1 0 0 30",           DIFFERENT },
+    { "U data card",            "u 0 0 0 0 5 0",      "u 0 0 0 0 7 0",          DIFFERENT },
+    { "FILL data card",         "fill 0 0 0 0 0 0",   "fill 0 0 0 0 0 5",       DIFFERENT },
+    { "# table row",            "2   2.0",            "2   2.5",                DIFFERENT },
+
+    /* Not normalized */
+    { "READ card",              "m2 26056.80c 1\n",   "read file=mats.i\nm2 26056.80c 1\n", UNSUPPORTED },
+    { "tab indentation",        "     trcl=3",        "\ttrcl=3",               UNSUPPORTED },
+};
+
+/* BASE with tc->find replaced, or NULL if find does not occur exactly once */
+static char* edit_deck(const test_case_t* tc, size_t* len) {
+    const char* at = strstr(BASE, tc->find);
+    if (!at || strstr(at + 1, tc->find)) return NULL;
+
+    size_t pre = (size_t)(at - BASE);
+    size_t flen = strlen(tc->find), rlen = strlen(tc->replace);
+    size_t post = sizeof(BASE) - 1 - pre - flen;
+    char* d = malloc(pre + rlen + post + 1);
+    if (!d) return NULL;
+    memcpy(d, BASE, pre);
+    memcpy(d + pre, tc->replace, rlen);
+    memcpy(d + pre + rlen, at + flen, post + 1);
+    *len = pre + rlen + post;
+    return d;
+}
+
+static int run_case(const test_case_t* tc, uint64_t base_hash) {
+    size_t len = 0;
+    char* deck = edit_deck(tc, &len);
+    const char* fail = NULL;
+    uint64_t h = 0;
+
+    if (!deck) {
+        fail = "substitution does not apply";
+    } else if (ag_mcnp_geometry_hash(deck, len, &h) < 0) {
+        if (tc->expect != UNSUPPORTED) fail = "deck not normalized";
+    } else if (tc->expect == UNSUPPORTED) {
+        fail = "deck normalized";
+    } else if (tc->expect == SAME && h != base_hash) {
+        fail = "hash changed";
+    } else if (tc->expect == DIFFERENT && h == base_hash) {
+        fail = "hash unchanged";
+    }
+
+    printf("%-24s %s%s\n", tc->name, fail ? "FAIL: " : "ok", fail ? fail : "");
+    free(deck);
+    return fail == NULL;
+}
+
+int main(void) {
+    uint64_t base_hash;
+    if (ag_mcnp_geometry_hash(BASE, sizeof(BASE) - 1, &base_hash) < 0) {
+        fprintf(stderr, "test_mcnp_norm: base deck not normalized\n");
+        return 2;
+    }
+
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(CASES) / sizeof(CASES[0]); i++)
+        failed += !run_case(&CASES[i], base_hash);
+
+    if (failed) printf("%d case(s) failed\n", failed);
+    return failed ? 1 : 0;
+}